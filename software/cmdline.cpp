@@ -0,0 +1,62 @@
+//==========================================================================================================
+// cmdline.cpp - Implements helpers for parsing command-line arguments
+//==========================================================================================================
+#include <stdlib.h>
+#include "cmdline.h"
+using namespace std;
+
+
+//==========================================================================================================
+// parse_size() - Parses a size with an optional K, M or G suffix (powers of 1024)
+//
+// Passed:  text   = the text to parse.  The number may be decimal, or hex with a leading "0x"
+//          result = where to store the size
+//
+// Returns: true if the text was a valid size
+//==========================================================================================================
+bool parse_size(const char* text, size_t* result)
+{
+    char* p;
+    size_t size = strtoull(text, &p, 0);
+
+    // There has to be a number
+    if (p == text) return false;
+
+    // Apply the suffix, if there is one
+    switch (*p)
+    {
+        case 'k': case 'K': size <<= 10; ++p; break;
+        case 'm': case 'M': size <<= 20; ++p; break;
+        case 'g': case 'G': size <<= 30; ++p; break;
+    }
+
+    // There mustn't be anything after the suffix
+    if (*p) return false;
+
+    // Hand the caller the size
+    *result = size;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// parse_int_list() - Parses a comma separated list of integers
+//==========================================================================================================
+bool parse_int_list(const char* text, vector<int>* result)
+{
+    char* p = (char*)text;
+
+    result->clear();
+    while (*p)
+    {
+        char* start = p;
+        result->push_back(strtol(p, &p, 10));
+        if (p == start) return false;
+        if (*p == ',') ++p;
+        else if (*p) return false;
+    }
+    return true;
+}
+//==========================================================================================================
@@ -0,0 +1,12 @@
+//==========================================================================================================
+// cmdline.h - Defines helpers for parsing command-line arguments that the tools in this folder share
+//==========================================================================================================
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Parses a size with an optional K, M or G suffix.  Returns false if the text isn't a valid size
+bool parse_size(const char* text, size_t* result);
+
+// Parses a comma separated list of integers.  Returns false if the text isn't a valid list
+bool parse_int_list(const char* text, std::vector<int>* result);
@@ -0,0 +1,410 @@
+//==========================================================================================================
+// disk_sink.cpp - Implements a sink that streams RDMA payloads to a file at their target addresses
+//==========================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "disk_sink.h"
+#include "rdma.h"
+using namespace std;
+
+// The most extents that are written with a single pwritev()
+const int SINK_MAX_IOV = 64;
+
+
+//==========================================================================================================
+// now_ns() - Returns the monotonic clock in nanoseconds
+//==========================================================================================================
+static uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// create() - Opens the file, allocates the staging buffers and starts the writer thread
+//
+// Passed:  filename    = the file to write.  It's created if it doesn't exist, and isn't truncated
+//          base_addr   = the RDMA address that corresponds to offset 0 of the file
+//          extent_size = the size of each staging buffer.  It's rounded up to a multiple of SINK_ALIGN
+//          buffers     = the number of staging buffers.  Two is enough to keep the disk busy while the
+//                        receiving thread fills the next extent; more rides out hiccups in the disk
+//
+// Returns: true on success
+//==========================================================================================================
+bool DiskSink::create(string filename, uint64_t base_addr, size_t extent_size, int buffers)
+{
+    // Staging buffers have to be big enough for a payload, and aligned for O_DIRECT
+    extent_size = (extent_size + SINK_ALIGN - 1) / SINK_ALIGN * SINK_ALIGN;
+    if (extent_size < RDMA_MAX_PAYLOAD || extent_size > UINT32_MAX || buffers < 2) return false;
+
+    // Open the file.  Not every filesystem supports O_DIRECT; without it, every extent is buffered
+    m_fd = open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (m_fd < 0) return false;
+    m_direct_fd = open(filename.c_str(), O_WRONLY | O_DIRECT);
+
+    // Allocate the staging buffers.  Mappings are page-aligned, which O_DIRECT requires
+    for (int i=0; i<buffers; ++i)
+    {
+        void* p = mmap(NULL, extent_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                       -1, 0);
+        if (p == MAP_FAILED)
+        {
+            for (auto q : m_buffer) munmap(q, extent_size);
+            m_buffer.clear();
+            close(m_fd);
+            if (m_direct_fd >= 0) close(m_direct_fd);
+            m_fd = m_direct_fd = -1;
+            return false;
+        }
+        m_buffer.push_back((uint8_t*)p);
+    }
+
+    // Every buffer starts out free
+    m_ready.create(buffers);
+    m_free.create(buffers);
+    for (int i=0; i<buffers; ++i) m_free.push(i);
+
+    m_filename    = filename;
+    m_base        = base_addr;
+    m_extent_size = extent_size;
+
+    // Start the writer
+    m_thread = thread(&DiskSink::run, this);
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// write() - Stages the payload of an RDMA packet.  Called by the receiving thread only
+//
+// Passed:  packet = the packet, starting with its RDMA header
+//          length = the length of the packet in bytes
+//
+// Returns: false if the packet isn't an RDMA packet we can place, or if no staging buffer was free
+//==========================================================================================================
+bool DiskSink::write(const void* packet, int length)
+{
+    // Announce that we're using the staging buffers, then (in stage) check whether we've been told to stop
+    m_gate.enter();
+    bool staged = stage(packet, length);
+    m_gate.leave();
+    return staged;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// stage() - Does the work of write(), between entering and leaving m_gate
+//==========================================================================================================
+bool DiskSink::stage(const void* packet, int length)
+{
+    const rdma_header_t* header = (const rdma_header_t*)packet;
+
+    // Once we've been told to stop, we hand our last extent to the writer, and the staging buffers
+    // belong to finish()
+    if (m_gate.stopped())
+    {
+        if (m_current >= 0 && m_current_fill) seal_extent();
+        m_current = -1;
+        return false;
+    }
+
+    // Like rdma_recv.v, we need a valid header to know where the payload goes
+    if (length < RDMA_HDR_LEN || header->magic() != RDMA_MAGIC || header->target_addr() < m_base)
+    {
+        bump(stats.rejected);
+        return false;
+    }
+    uint64_t offset  = header->target_addr() - m_base;
+    uint32_t payload = length - RDMA_HDR_LEN;
+    if (payload == 0) return true;
+
+    // If this payload doesn't carry on where the current extent leaves off, or won't fit in it, the
+    // current extent is finished
+    if (m_current >= 0 && (offset != m_current_offset + m_current_fill ||
+                           m_current_fill + payload > m_extent_size))
+    {
+        seal_extent();
+    }
+
+    // If we need a new extent and every buffer is waiting for the disk, drop the payload
+    if (m_current < 0 && !open_extent(offset))
+    {
+        bump(stats.dropped);
+        bump(stats.dropped_bytes, payload);
+        return false;
+    }
+
+    // Append the payload to the extent
+    memcpy(m_buffer[m_current] + m_current_fill, header + 1, payload);
+    m_current_fill += payload;
+    bump(stats.payloads);
+    bump(stats.staged_bytes, payload);
+
+    // A full extent can go to the writer right away
+    if (m_current_fill == m_extent_size) seal_extent();
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// open_extent() - Takes a free staging buffer for a new extent that starts at the specified file offset
+//
+// Returns: false if no staging buffer is free
+//==========================================================================================================
+bool DiskSink::open_extent(uint64_t offset)
+{
+    uint32_t buffer;
+    if (m_free.pop(&buffer, 1) == 0) return false;
+
+    m_current        = buffer;
+    m_current_offset = offset;
+    m_current_fill   = 0;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// seal_extent() - Hands the current extent to the writer.  There's a slot in m_ready for every buffer,
+//                 so this never fails
+//==========================================================================================================
+void DiskSink::seal_extent()
+{
+    m_ready.push({(uint32_t)m_current, m_current_fill, m_current_offset});
+    m_current = -1;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run() - The writer thread: writes extents as they're sealed, and hands their buffers back
+//==========================================================================================================
+void DiskSink::run()
+{
+    int      buffers = m_buffer.size();
+    extent_t extent[SINK_MAX_IOV];
+    int      spins = 0;
+
+    while (true)
+    {
+        // Note how many staging buffers are full or being filled
+        uint64_t in_use = buffers - m_free.size();
+        stats.occupancy_now.store(in_use, memory_order_relaxed);
+
+        // Fetch the extents that are ready to be written
+        int count = m_ready.pop(extent, SINK_MAX_IOV);
+        if (count == 0)
+        {
+            // When we're draining, the last extent has been sealed before m_draining was set
+            if (m_draining.load()) count = m_ready.pop(extent, SINK_MAX_IOV);
+            if (count == 0 && m_draining.load()) break;
+            if (count == 0)
+            {
+                if (++spins < 100) sched_yield(); else usleep(50);
+                continue;
+            }
+        }
+        spins = 0;
+
+        // Keep track of the average and peak occupancy while there's work to do
+        bump(stats.occupancy_sum, in_use);
+        bump(stats.occupancy_samples);
+        if (in_use > stats.occupancy_max.load(memory_order_relaxed))
+        {
+            stats.occupancy_max.store(in_use, memory_order_relaxed);
+        }
+
+        // Write each run of extents that follow on from one another in the file with one system call
+        auto is_direct = [&](const extent_t& e)
+        {
+            return m_direct_fd >= 0 && e.offset % SINK_ALIGN == 0 && e.length % SINK_ALIGN == 0;
+        };
+        int start = 0;
+        for (int i=1; i<=count; ++i)
+        {
+            if (i < count && extent[i].offset == extent[i-1].offset + extent[i-1].length
+                          && is_direct(extent[i]) == is_direct(extent[start])) continue;
+            write_extents(extent + start, i - start, is_direct(extent[start]));
+            start = i;
+        }
+
+        // Hand the buffers back to the receiving thread
+        for (int i=0; i<count; ++i) m_free.push(extent[i].buffer);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// write_extents() - Writes extents that are contiguous in the file with a single pwritev()
+//
+// Passed:  extent = the extents, in file order
+//          count  = how many there are
+//          direct = true to write them with O_DIRECT
+//==========================================================================================================
+void DiskSink::write_extents(const extent_t* extent, int count, bool direct)
+{
+    iovec  iov[SINK_MAX_IOV];
+    size_t total = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        iov[i].iov_base = m_buffer[extent[i].buffer];
+        iov[i].iov_len  = extent[i].length;
+        total += extent[i].length;
+    }
+
+    int      fd     = direct ? m_direct_fd : m_fd;
+    uint64_t offset = extent[0].offset;
+    uint64_t start  = now_ns();
+    int      first  = 0;
+
+    // Keep writing until it's all gone, in case the kernel writes less than we asked for
+    for (size_t done = 0; done < total; )
+    {
+        ssize_t rc = pwritev(fd, iov + first, count - first, offset + done);
+        bump(stats.write_calls);
+        if (rc < 0)
+        {
+            if (errno == EINTR) continue;
+            if (stats.write_errors.load(memory_order_relaxed) == 0) perror(m_filename.c_str());
+            bump(stats.write_errors);
+            return;
+        }
+        done += rc;
+
+        // Skip past whatever was written
+        while (first < count && (size_t)rc >= iov[first].iov_len) rc -= iov[first++].iov_len;
+        if (rc)
+        {
+            iov[first].iov_base = (uint8_t*)iov[first].iov_base + rc;
+            iov[first].iov_len -= rc;
+        }
+    }
+
+    // Keep track of how fast the disk is going
+    uint64_t end = now_ns();
+    if (stats.first_write_ns.load(memory_order_relaxed) == 0) stats.first_write_ns.store(start);
+    stats.last_write_ns.store(end, memory_order_relaxed);
+    bump(stats.busy_ns, end - start);
+    bump(stats.extents, count);
+    bump(stats.written_bytes, total);
+    if (direct) bump(stats.direct_extents, count);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// finish() - Stops accepting payloads, writes whatever is staged, waits for the disk, and closes the file
+//==========================================================================================================
+void DiskSink::finish()
+{
+    if (m_fd < 0) return;
+
+    // Tell the receiving thread to stop, and wait for it to leave write() if it's inside.  After that it
+    // will never touch the staging buffers again
+    m_gate.stop();
+
+    // If the receiving thread didn't get to seal its last extent itself, do it on its behalf.  It can
+    // no longer push into m_ready, so we're its only producer.  An empty extent is simply abandoned
+    if (m_current >= 0 && m_current_fill) seal_extent();
+    m_current = -1;
+
+    // Wait for the writer to write everything
+    m_draining = true;
+    if (m_thread.joinable()) m_thread.join();
+
+    // Make sure it's all on the disk
+    fdatasync(m_fd);
+    close(m_fd);
+    if (m_direct_fd >= 0) close(m_direct_fd);
+    m_fd = m_direct_fd = -1;
+
+    for (auto p : m_buffer) munmap(p, m_extent_size);
+    m_buffer.clear();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Finishes one or more sinks, and displays the throughput and staging occupancy
+//==========================================================================================================
+void DiskSink::show_summary(DiskSink** sink, int count)
+{
+    uint64_t written = 0, extents = 0, direct = 0, calls = 0, errors = 0, dropped = 0, dropped_bytes = 0;
+    uint64_t rejected = 0, peak = 0, occupancy_sum = 0, samples = 0, first_ns = 0, last_ns = 0, busy_ns = 0;
+    int      buffers = 0;
+    bool     any_direct = false;
+
+    for (int i=0; i<count; ++i)
+    {
+        // Capture whether O_DIRECT was available before finish() closes the file
+        any_direct |= sink[i]->is_direct();
+        buffers    += sink[i]->m_buffer.size();
+        sink[i]->finish();
+
+        sink_stats_t& s = sink[i]->stats;
+        written       += s.written_bytes.load(memory_order_relaxed);
+        extents       += s.extents.load(memory_order_relaxed);
+        direct        += s.direct_extents.load(memory_order_relaxed);
+        calls         += s.write_calls.load(memory_order_relaxed);
+        errors        += s.write_errors.load(memory_order_relaxed);
+        dropped       += s.dropped.load(memory_order_relaxed);
+        dropped_bytes += s.dropped_bytes.load(memory_order_relaxed);
+        rejected      += s.rejected.load(memory_order_relaxed);
+        peak          += s.occupancy_max.load(memory_order_relaxed);
+        occupancy_sum += s.occupancy_sum.load(memory_order_relaxed);
+        samples       += s.occupancy_samples.load(memory_order_relaxed);
+        busy_ns       += s.busy_ns.load(memory_order_relaxed);
+
+        // The disk was busy from the first write by any sink to the last write by any sink
+        uint64_t first = s.first_write_ns.load(memory_order_relaxed);
+        uint64_t last  = s.last_write_ns.load(memory_order_relaxed);
+        if (first && (first_ns == 0 || first < first_ns)) first_ns = first;
+        if (last > last_ns) last_ns = last;
+    }
+
+    // The sustained rate is over the whole time the disk was in use.  The rate while writing shows what
+    // the disk could do if it were kept busy
+    double seconds = (last_ns - first_ns) / 1e9;
+    double rate    = (seconds > 0) ? written / seconds / 1e9 : 0;
+    double peak_rate = busy_ns ? (double)written / busy_ns : 0;
+
+    printf("disk sink : %llu bytes to %s in %llu extents (%llu with O_DIRECT%s), %llu writes\n",
+           (unsigned long long)written, sink[0]->filename().c_str(), (unsigned long long)extents,
+           (unsigned long long)direct, any_direct ? "" : ", unsupported here", (unsigned long long)calls);
+    printf("            %.3f GB/s sustained, %.3f GB/s while writing\n", rate, peak_rate);
+    printf("            staging peak %llu of %d buffers in use, average %.2f\n", (unsigned long long)peak,
+           buffers, samples ? (double)occupancy_sum / samples : 0.0);
+
+    // These only show up when something went wrong
+    if (dropped || rejected || errors)
+    {
+        printf("            %llu payloads (%llu bytes) dropped with staging full, %llu rejected, %llu write errors\n",
+               (unsigned long long)dropped, (unsigned long long)dropped_bytes, (unsigned long long)rejected,
+               (unsigned long long)errors);
+    }
+}
+//==========================================================================================================
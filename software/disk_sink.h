@@ -0,0 +1,156 @@
+//==========================================================================================================
+// disk_sink.h - Defines a sink that streams RDMA payloads to a file (typically on NVMe) at their target
+//               addresses
+//
+// Like rdma_recv.v, the sink takes the target address and payload length from each RDMA header, and the
+// payload belongs at (target address - base address) in the file.  Writing each payload on its own would
+// cost a system call per 8 KB, so payloads whose addresses follow on from one another are coalesced into
+// large staging extents first.  A writer thread of its own writes each full extent with pwritev(), using
+// O_DIRECT when the extent is block-aligned (and the filesystem allows it).
+//
+// The receiving thread never waits for the disk: it fills one staging buffer while the writer drains
+// another.  If the writer falls so far behind that no staging buffer is free, payloads are dropped and
+// counted, rather than stalling the network.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spsc_ring.h"
+#include "stats.h"
+#include "writer_gate.h"
+
+// Default size of a staging extent, and the default number of staging buffers
+const size_t SINK_DEFAULT_EXTENT  = 4 << 20;
+const int    SINK_DEFAULT_BUFFERS = 2;
+
+// O_DIRECT writes must start and end on this boundary
+const size_t SINK_ALIGN = 4096;
+
+//==========================================================================================================
+// sink_stats_t - Counters for a DiskSink.  Each group is written by exactly one thread
+//==========================================================================================================
+struct sink_stats_t
+{
+    // Written by the receiving thread
+    alignas(64) std::atomic<uint64_t> payloads{0};
+    std::atomic<uint64_t>   staged_bytes{0};
+    std::atomic<uint64_t>   rejected{0};            // Not an RDMA packet, or below the base address
+    std::atomic<uint64_t>   dropped{0};             // No staging buffer was free
+    std::atomic<uint64_t>   dropped_bytes{0};
+
+    // Written by the writer thread
+    alignas(64) std::atomic<uint64_t> extents{0};
+    std::atomic<uint64_t>   written_bytes{0};
+    std::atomic<uint64_t>   direct_extents{0};      // Written with O_DIRECT
+    std::atomic<uint64_t>   write_calls{0};
+    std::atomic<uint64_t>   write_errors{0};
+    std::atomic<uint64_t>   busy_ns{0};             // Time spent in pwritev()
+    std::atomic<uint64_t>   first_write_ns{0};
+    std::atomic<uint64_t>   last_write_ns{0};
+
+    // Written by the writer thread: staging buffers in use, sampled each time it looks for work
+    std::atomic<uint64_t>   occupancy_now{0};
+    std::atomic<uint64_t>   occupancy_max{0};
+    std::atomic<uint64_t>   occupancy_sum{0};
+    std::atomic<uint64_t>   occupancy_samples{0};
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// DiskSink - Coalesces RDMA payloads into staging extents, and writes them to a file from its own thread
+//==========================================================================================================
+class DiskSink
+{
+public:
+
+    // Constructor, marks the sink as closed
+    DiskSink() {m_fd = m_direct_fd = -1; m_base = 0; m_extent_size = 0; m_current = -1;}
+
+    // Destructor - writes whatever is staged and closes the file
+    ~DiskSink() {finish();}
+
+    // Opens (or creates) the file and allocates "buffers" staging buffers of "extent_size" bytes each.
+    // The payload for RDMA address "base_addr" goes at offset 0 of the file
+    bool    create(std::string filename, uint64_t base_addr, size_t extent_size = SINK_DEFAULT_EXTENT,
+                   int buffers = SINK_DEFAULT_BUFFERS);
+
+    // Called by the receiving thread to stage the payload of an RDMA packet.  Returns false if the packet
+    // was rejected or dropped
+    bool    write(const void* packet, int length);
+
+    // Stops accepting payloads, writes everything that's staged, and closes the file.  This can be called
+    // from another thread while the receiving thread is running (see WriterGate for how they hand over)
+    void    finish();
+
+    // Returns true if O_DIRECT is available on the file
+    bool    is_direct() const {return m_direct_fd >= 0;}
+
+    // Returns the name of the file
+    std::string filename() const {return m_filename;}
+
+    // Counters
+    sink_stats_t stats;
+
+    // Finishes one or more sinks and displays what went into them
+    static void show_summary(DiskSink** sink, int count);
+
+protected:
+
+    // An extent that's ready to be written: which staging buffer holds it, and where it goes in the file
+    struct extent_t
+    {
+        uint32_t    buffer;
+        uint32_t    length;
+        uint64_t    offset;
+    };
+
+    // Called by write() to stage a payload once it has entered m_gate
+    bool    stage(const void* packet, int length);
+
+    // Called by the receiving thread to start a new extent at the specified file offset
+    bool    open_extent(uint64_t offset);
+
+    // Called by the receiving thread to hand the current extent to the writer
+    void    seal_extent();
+
+    // This is the body of the writer thread
+    void    run();
+
+    // Writes a run of extents that are contiguous in the file with a single pwritev()
+    void    write_extents(const extent_t* extent, int count, bool direct);
+
+    // The file, opened both with and without O_DIRECT
+    std::string m_filename;
+    int         m_fd, m_direct_fd;
+
+    // The RDMA address that corresponds to offset 0 of the file
+    uint64_t    m_base;
+
+    // The staging buffers, and how big each one is
+    std::vector<uint8_t*> m_buffer;
+    size_t      m_extent_size;
+
+    // Owned by the receiving thread: the buffer being filled (or -1), where it goes in the file, and how
+    // much of it has been filled
+    int         m_current;
+    uint64_t    m_current_offset;
+    uint32_t    m_current_fill;
+
+    // Full extents headed for the writer, and empty buffers headed back to the receiving thread
+    SPSCRing<extent_t> m_ready;
+    SPSCRing<uint32_t> m_free;
+
+    // Lets finish() stop the receiving thread from touching the staging buffers
+    WriterGate  m_gate;
+
+    // Set by finish() to tell the writer to exit once it's idle
+    std::atomic<bool> m_draining{false};
+
+    // The writer thread
+    std::thread m_thread;
+};
+//==========================================================================================================
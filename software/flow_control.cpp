@@ -0,0 +1,273 @@
+//==========================================================================================================
+// flow_control.cpp - Implements credit-based flow control, carried in the reserved bytes of the RDMA header
+//==========================================================================================================
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "flow_control.h"
+#include "pacer.h"
+using namespace std;
+
+
+//==========================================================================================================
+// configure() - Sets the window that we grant to every sender
+//
+// Passed:  window = the most packets a sender may have in flight beyond the newest one we've dealt with
+//          rcvbuf = the size of the socket's receive buffer, or 0 to take "window" at its word
+//==========================================================================================================
+void CreditGranter::configure(int window, int rcvbuf)
+{
+    if (window > RDMA_FC_WINDOW) window = RDMA_FC_WINDOW;
+    m_window    = window;
+    m_threshold = (window >= 4) ? window / 4 : 1;
+    m_rcvbuf    = rcvbuf;
+    m_largest   = 0;
+    m_sender.clear();
+    m_sender.reserve(FC_MAX_SENDERS);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// window() - Works out the window to grant each sender.  To avoid drops, every sender's window has to
+//            fit in the receive buffer at once, at the size of the largest packet we've seen
+//
+// Returns: the window in packets, at least 1
+//==========================================================================================================
+int CreditGranter::window() const
+{
+    if (m_rcvbuf == 0 || m_sender.empty()) return m_window;
+
+    int cost   = 2 * m_largest + FC_PACKET_OVERHEAD;
+    int window = m_rcvbuf / cost / (int)m_sender.size();
+    if (window > m_window) window = m_window;
+    return (window < 1) ? 1 : window;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// note() - Notes that a packet has been dealt with (written into the target, staged for the disk, or
+//          echoed), so its sender is owed a credit
+//
+// Passed:  source = the key that identifies the sender (see UDPSock::source_key())
+//          packet = the packet, starting with its RDMA header
+//          length = the length of the packet
+//          stats  = the counters to update
+//==========================================================================================================
+void CreditGranter::note(uint64_t source, const void* packet, int length, credit_stats_t& stats)
+{
+    // Only flow-controlled senders are owed credits
+    if (length < RDMA_HDR_LEN) return;
+    const rdma_header_t& header = *(const rdma_header_t*)packet;
+    if (header.magic() != RDMA_MAGIC || (header.flow() & RDMA_FC_DATA) == 0) return;
+    uint32_t next = header.sequence() + 1;
+    if (length > m_largest) m_largest = length;
+
+    // Find this sender, or start following it if it's new and we have room
+    sender_t* sender = NULL;
+    for (auto& s : m_sender) if (s.source == source) {sender = &s; break;}
+    if (sender == NULL)
+    {
+        if (m_sender.size() == FC_MAX_SENDERS)
+        {
+            bump(stats.untracked);
+            return;
+        }
+        m_sender.push_back({source, next, 0});
+        sender = &m_sender.back();
+        bump(stats.senders);
+    }
+
+    // Lost and reordered packets mustn't hold the sender up, so credits are relative to the newest
+    if ((int32_t)(next - sender->next) > 0) sender->next = next;
+    ++sender->pending;
+    bump(stats.packets);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// grant() - Sends a credit packet to every sender that is owed one
+//
+// Passed:  sock    = the socket to send the credits on, normally the one the packets arrived on
+//          drained = true if the receive queue has run dry, in which case any credits owed go out now
+//          stats   = the counters to update
+//==========================================================================================================
+void CreditGranter::grant(UDPSock& sock, bool drained, credit_stats_t& stats)
+{
+    int      window    = this->window();
+    uint32_t threshold = drained ? 1 : m_threshold;
+    if (threshold > (uint32_t)(window + 3) / 4) threshold = (window + 3) / 4;
+    stats.window.store(window, memory_order_relaxed);
+
+    for (auto& sender : m_sender)
+    {
+        if (sender.pending < threshold) continue;
+
+        // A credit packet is a bare RDMA header
+        rdma_header_t credit;
+        credit.set(0);
+        credit.set_sequence(sender.next);
+        credit.set_flow(RDMA_FC_CREDIT | window);
+        if (sock.send_to(&credit, sizeof credit, sender.source)) bump(stats.credits);
+        sender.pending = 0;
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays the totals of the credit counters from one or more workers
+//==========================================================================================================
+void CreditGranter::show_summary(credit_stats_t** stats, int count, int window)
+{
+    uint64_t senders = 0, packets = 0, credits = 0, untracked = 0, granted = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        senders   += stats[i]->senders.load(memory_order_relaxed);
+        packets   += stats[i]->packets.load(memory_order_relaxed);
+        credits   += stats[i]->credits.load(memory_order_relaxed);
+        untracked += stats[i]->untracked.load(memory_order_relaxed);
+        granted    = max(granted, stats[i]->window.load(memory_order_relaxed));
+    }
+
+    printf("credits   : window %d (granting %llu), %llu credit packets to %llu senders for %llu packets\n",
+           window, (unsigned long long)granted, (unsigned long long)credits, (unsigned long long)senders,
+           (unsigned long long)packets);
+    if (untracked)
+    {
+        printf("            %llu packets from senders beyond the first %d got no credits\n",
+               (unsigned long long)untracked, FC_MAX_SENDERS);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// start() - Turns flow control on
+//
+// Passed:  window = the number of packets the receiver is assumed to take before it has sent any credits
+//==========================================================================================================
+void CreditWindow::start(int window)
+{
+    if (window > RDMA_FC_WINDOW) window = RDMA_FC_WINDOW;
+    m_window = window;
+    m_next   = 0;
+    m_limit  = window;
+    m_heard  = false;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// acquire() - Waits until the receiver's credits allow at least one more packet to be sent
+//
+// Passed:  sock   = the socket we send on, which is where the receiver's credits arrive
+//          wanted = the number of packets the caller would like to send
+//
+// Returns: the number of packets (between 1 and "wanted") the caller may send now
+//==========================================================================================================
+int CreditWindow::acquire(UDPSock& sock, int wanted)
+{
+    if (m_window == 0) return wanted;
+
+    // Pick up whatever credits have arrived
+    read_credits(sock);
+
+    // If we're out of credits, wait for more
+    int64_t start_ns = 0;
+    while ((int32_t)(m_limit - m_next) <= 0)
+    {
+        int64_t now_ns = Pacer::now_ns();
+        if (start_ns == 0)
+        {
+            start_ns = now_ns;
+            bump(stats.waits);
+        }
+
+        // A receiver that has never sent credits doesn't know how to, so we carry on without them
+        int timeout_ms = m_heard ? FC_STALL_MS : FC_LEGACY_MS;
+        int waited_ms  = (now_ns - start_ns) / 1000000;
+        if (waited_ms >= timeout_ms && !m_heard)
+        {
+            stats.legacy.store(true, memory_order_relaxed);
+            m_window = 0;
+            bump(stats.wait_ns, now_ns - start_ns);
+            return wanted;
+        }
+
+        // A receiver that has gone quiet has probably lost its credits on the way, so we award ourselves
+        // another window's worth
+        if (waited_ms >= timeout_ms)
+        {
+            m_limit = m_next + m_window;
+            bump(stats.stalls);
+            break;
+        }
+
+        if (sock.wait_for_data(timeout_ms - waited_ms)) read_credits(sock);
+    }
+    if (start_ns) bump(stats.wait_ns, Pacer::now_ns() - start_ns);
+
+    // We may send as many as we want, up to the limit
+    int room = (int32_t)(m_limit - m_next);
+    return (room < wanted) ? room : wanted;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// read_credits() - Reads every credit packet waiting on the socket, without blocking
+//==========================================================================================================
+void CreditWindow::read_credits(UDPSock& sock)
+{
+    char buffer[64];
+
+    while (sock.wait_for_data(0))
+    {
+        // Anything that isn't a credit packet is of no interest
+        int length = sock.receive(buffer, sizeof buffer);
+        if (length < RDMA_HDR_LEN) continue;
+        rdma_header_t header;
+        memcpy(&header, buffer, sizeof header);
+        uint16_t flow = header.flow();
+        if (header.magic() != RDMA_MAGIC || (flow & RDMA_FC_CREDIT) == 0) continue;
+
+        // Credits only ever move the limit forward.  Older ones may arrive late
+        uint32_t limit = header.sequence() + (flow & RDMA_FC_WINDOW);
+        if ((int32_t)(limit - m_limit) > 0) m_limit = limit;
+        m_heard = true;
+        bump(stats.credits);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays how often the receiver held us back
+//==========================================================================================================
+void CreditWindow::show_summary() const
+{
+    if (stats.legacy.load(memory_order_relaxed))
+    {
+        printf("flow ctl  : the receiver sent no credits, so we carried on without flow control\n");
+        return;
+    }
+
+    printf("flow ctl  : %llu credit packets, waited for credits %llu times (%.1f ms in all), %llu stalls\n",
+           (unsigned long long)stats.credits.load(memory_order_relaxed),
+           (unsigned long long)stats.waits.load(memory_order_relaxed),
+           stats.wait_ns.load(memory_order_relaxed) / 1e6,
+           (unsigned long long)stats.stalls.load(memory_order_relaxed));
+}
+//==========================================================================================================
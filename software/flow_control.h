@@ -0,0 +1,173 @@
+//==========================================================================================================
+// flow_control.h - Defines credit-based flow control, carried in the reserved bytes of the RDMA header
+//
+// A sender that wants flow control numbers its packets (bytes 0-3 of the reserved field) and sets
+// RDMA_FC_DATA in the flow-control word (bytes 10-11).  A receiver that understands this sends credit
+// packets back to the sender's address.  A credit packet is an RDMA header with no payload.  Its sequence
+// number is one past the newest packet the receiver has finished with, and its flow-control word is
+// RDMA_FC_CREDIT plus a window: the number of packets beyond that sequence number the receiver can take.
+// The sender may send every sequence number below (sequence + window), and stops there until more
+// credits arrive.  The receiver picks a window it can hold without dropping packets (its socket receive
+// buffer, say), so the sender runs as fast as the receiver keeps up, and no faster.
+//
+// Both sides interoperate with peers that leave the flow-control word zero:
+//
+//     - A receiver sends credits only to senders whose packets have RDMA_FC_DATA set
+//     - A sender that has heard no credits at all by FC_LEGACY_MS after running out concludes that the
+//       receiver (the FPGA, for instance) doesn't do flow control, and carries on without it
+//     - A sender that has been hearing credits, but hears none for FC_STALL_MS, assumes the credits were
+//       lost and grants itself a fresh window
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "rdma.h"
+#include "stats.h"
+#include "udpsock.h"
+
+// The default window, in packets.  This matches MAX_PACKET_COUNT, the depth of rdma_xmit.v's FIFO
+const int FC_DEFAULT_WINDOW = 256;
+
+// How long a sender that is out of credits waits for a receiver it has never heard from, and for one
+// it has heard from before, in milliseconds
+const int FC_LEGACY_MS = 500;
+const int FC_STALL_MS  = 100;
+
+// The number of senders each CreditGranter follows.  Senders beyond this get no credits
+const int FC_MAX_SENDERS = 64;
+
+// The kernel charges a received datagram against the socket's receive buffer at roughly twice its length
+// (the buffer it lands in is rounded up), plus this much bookkeeping
+const int FC_PACKET_OVERHEAD = 1024;
+
+// The receive buffer a receiver asks for, per packet of window, so that jumbo frames fit
+const int FC_BUFFER_PER_PACKET = 2 * 9216 + FC_PACKET_OVERHEAD;
+
+//==========================================================================================================
+// credit_stats_t - Counters for the receiving side of flow control, written by the thread that receives
+//==========================================================================================================
+struct alignas(64) credit_stats_t
+{
+    std::atomic<uint64_t>   senders{0};         // Flow-controlled senders we've heard from
+    std::atomic<uint64_t>   packets{0};         // Flow-controlled packets we've finished with
+    std::atomic<uint64_t>   credits{0};         // Credit packets sent
+    std::atomic<uint64_t>   untracked{0};       // Packets from senders beyond FC_MAX_SENDERS
+    std::atomic<uint64_t>   window{0};          // The window most recently granted
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// flow_stats_t - Counters for the sending side of flow control, written by the thread that sends
+//==========================================================================================================
+struct alignas(64) flow_stats_t
+{
+    std::atomic<uint64_t>   credits{0};         // Credit packets received
+    std::atomic<uint64_t>   waits{0};           // Times we ran out of credits and had to wait
+    std::atomic<uint64_t>   wait_ns{0};         // Total time spent waiting for credits
+    std::atomic<uint64_t>   stalls{0};          // Times credits stopped and we granted ourselves a window
+    std::atomic<bool>       legacy{false};      // The receiver never sent credits, so we stopped waiting
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CreditGranter - The receiving side: keeps track of how far each flow-controlled sender has got, and
+//                 sends each one credits as its packets are dealt with.  Used by exactly one thread
+//==========================================================================================================
+class CreditGranter
+{
+public:
+
+    // Constructor, flow control off
+    CreditGranter() {m_window = 0; m_threshold = 1; m_rcvbuf = 0; m_largest = 0;}
+
+    // Sets the window granted to every sender, in packets (at most RDMA_FC_WINDOW).  If "rcvbuf" isn't
+    // 0, the window is trimmed so that every sender's window fits in a receive buffer that size
+    void    configure(int window, int rcvbuf = 0);
+
+    // Returns the window currently granted to each sender, in packets
+    int     window() const;
+
+    // Notes that a packet has been dealt with.  Packets without RDMA_FC_DATA are ignored
+    void    note(uint64_t source, const void* packet, int length, credit_stats_t& stats);
+
+    // Sends credits, through "sock", to every sender that is owed them.  Credits go out once a quarter
+    // of the window has been dealt with or, if "drained" is true (the receive queue has run dry), as
+    // soon as any packets have been
+    void    grant(UDPSock& sock, bool drained, credit_stats_t& stats);
+
+    // Displays the counters of one or more granters
+    static void show_summary(credit_stats_t** stats, int count, int window);
+
+protected:
+
+    // What we know about one sender: one past the newest sequence number we've seen from it, and the
+    // number of its packets we've dealt with since we last sent it credits
+    struct sender_t
+    {
+        uint64_t    source;
+        uint32_t    next;
+        uint32_t    pending;
+    };
+    std::vector<sender_t> m_sender;
+
+    // The window we grant, and how many packets we deal with before granting more
+    int         m_window;
+    uint32_t    m_threshold;
+
+    // The size of the receive buffer the windows have to fit in, and the largest packet seen so far
+    int         m_rcvbuf;
+    int         m_largest;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CreditWindow - The sending side: numbers outgoing packets, and holds the sender back when the receiver
+//                hasn't granted it enough credits
+//==========================================================================================================
+class CreditWindow
+{
+public:
+
+    // Constructor, flow control off
+    CreditWindow() {m_window = 0; m_next = 0; m_limit = 0; m_heard = false;}
+
+    // Turns flow control on, assuming the receiver starts out willing to take "window" packets
+    void    start(int window);
+
+    // Returns true if flow control is on
+    bool    is_enabled() const {return m_window != 0;}
+
+    // Returns the sequence number of the next packet to be sent
+    uint32_t sequence() const {return m_next;}
+
+    // Returns how many of the next "wanted" packets may be sent now, reading credits from "sock" and
+    // waiting for them if there are none.  Returns "wanted" if flow control is off
+    int     acquire(UDPSock& sock, int wanted);
+
+    // Notes that "count" packets have been sent
+    void    sent(int count) {m_next += count;}
+
+    // Counters
+    flow_stats_t stats;
+
+    // Displays the counters of a window
+    void    show_summary() const;
+
+protected:
+
+    // Reads every credit packet waiting on the socket, without blocking
+    void    read_credits(UDPSock& sock);
+
+    // The window we started with, the next sequence number to send, and the first sequence number we
+    // may not send yet
+    int         m_window;
+    uint32_t    m_next, m_limit;
+
+    // True once the receiver has sent us credits
+    bool        m_heard;
+};
+//==========================================================================================================
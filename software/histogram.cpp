@@ -0,0 +1,83 @@
+//==========================================================================================================
+// histogram.cpp - Implements a fixed-size, log-linear histogram of latencies
+//==========================================================================================================
+#include "histogram.h"
+using namespace std;
+
+
+//==========================================================================================================
+// percentile() - Returns the value below which the specified percentage of recorded values fall
+//
+// Passed:  percent = a percentage, 0 thru 100
+//
+// Returns: the upper limit of the bucket that holds that percentile (never more than the maximum value
+//          recorded), or 0 if nothing has been recorded
+//==========================================================================================================
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+    uint64_t total = count();
+    if (total == 0) return 0;
+
+    // This is how many values must be at or below the value we return
+    uint64_t wanted = (uint64_t)(total * percent / 100 + 0.5);
+    if (wanted < 1) wanted = 1;
+
+    // Walk the buckets until we've passed that many values
+    uint64_t seen = 0;
+    for (int i=0; i<HIST_BUCKETS; ++i)
+    {
+        seen += m_bucket[i].load(memory_order_relaxed);
+        if (seen >= wanted)
+        {
+            uint64_t limit = bucket_limit(i);
+            return (limit < max()) ? limit : max();
+        }
+    }
+
+    // We only get here if values were recorded while we were looking
+    return max();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// merge() - Adds every value recorded in another histogram to this one
+//
+// Passed:  other = the histogram to add in.  Its writer may still be recording values
+//==========================================================================================================
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i=0; i<HIST_BUCKETS; ++i)
+    {
+        uint64_t value = m_bucket[i].load(memory_order_relaxed) + other.m_bucket[i].load(memory_order_relaxed);
+        m_bucket[i].store(value, memory_order_relaxed);
+    }
+
+    m_count.store(count() + other.count(), memory_order_relaxed);
+    if (other.max() > max()) m_max.store(other.max(), memory_order_relaxed);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// load() - Replaces the contents of this histogram with a set of raw bucket counts
+//
+// Passed:  bucket = HIST_BUCKETS counts, one per bucket
+//          max    = the largest value that was recorded
+//==========================================================================================================
+void LatencyHistogram::load(const uint64_t* bucket, uint64_t max)
+{
+    uint64_t total = 0;
+
+    for (int i=0; i<HIST_BUCKETS; ++i)
+    {
+        m_bucket[i].store(bucket[i], memory_order_relaxed);
+        total += bucket[i];
+    }
+
+    m_count.store(total, memory_order_relaxed);
+    m_max.store(max, memory_order_relaxed);
+}
+//==========================================================================================================
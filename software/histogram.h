@@ -0,0 +1,76 @@
+//==========================================================================================================
+// histogram.h - Defines a fixed-size, log-linear histogram of latencies
+//
+// Values are grouped by power of two, and each power of two is split into 16 linear sub-buckets, so any
+// value is recorded with better than 7% precision in a constant amount of memory.  A histogram is written
+// by exactly one thread and may be read by any number of others.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "stats.h"
+
+// Each power of two is split into 2^HIST_SUB_BITS sub-buckets
+const int HIST_SUB_BITS = 4;
+const int HIST_SUB_COUNT = 1 << HIST_SUB_BITS;
+
+// Enough buckets to hold any 64-bit value
+const int HIST_BUCKETS = (64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT;
+
+//==========================================================================================================
+// LatencyHistogram - Counts of values, typically latencies in nanoseconds
+//==========================================================================================================
+class LatencyHistogram
+{
+public:
+
+    // Call this from the owning thread to record a value
+    void        record(uint64_t value)
+    {
+        bump(m_bucket[bucket(value)]);
+        bump(m_count);
+        if (value > m_max.load(std::memory_order_relaxed)) m_max.store(value, std::memory_order_relaxed);
+    }
+
+    // Returns the number of values that have been recorded
+    uint64_t    count() const {return m_count.load(std::memory_order_relaxed);}
+
+    // Returns the largest value that has been recorded
+    uint64_t    max()   const {return m_max.load(std::memory_order_relaxed);}
+
+    // Returns the value below which "percent" percent of the recorded values fall
+    uint64_t    percentile(double percent) const;
+
+    // Adds the values recorded in another histogram to this one.  Used to total up several writers
+    void        merge(const LatencyHistogram& other);
+
+    // Returns the number of values recorded in one bucket
+    uint64_t    bucket_count(int index) const {return m_bucket[index].load(std::memory_order_relaxed);}
+
+    // Replaces the contents of this histogram with raw bucket counts, e.g. from another process
+    void        load(const uint64_t* bucket, uint64_t max);
+
+    // Returns the index of the bucket that holds a value
+    static int  bucket(uint64_t value)
+    {
+        if (value < HIST_SUB_COUNT) return value;
+        int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+        return (shift + 1) * HIST_SUB_COUNT + ((value >> shift) & (HIST_SUB_COUNT - 1));
+    }
+
+    // Returns the largest value that lands in a bucket
+    static uint64_t bucket_limit(int index)
+    {
+        if (index < HIST_SUB_COUNT) return index;
+        int shift = index / HIST_SUB_COUNT - 1;
+        uint64_t low = (uint64_t)(HIST_SUB_COUNT + index % HIST_SUB_COUNT) << shift;
+        return low + ((1ULL << shift) - 1);
+    }
+
+protected:
+
+    std::atomic<uint64_t>   m_bucket[HIST_BUCKETS] = {};
+    std::atomic<uint64_t>   m_count{0};
+    std::atomic<uint64_t>   m_max{0};
+};
+//==========================================================================================================
@@ -0,0 +1,908 @@
+//==========================================================================================================
+// loopback.cpp - Implements a worker thread that receives RDMA packets and echoes them back
+//==========================================================================================================
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include "loopback.h"
+#include "pacer.h"
+using namespace std;
+
+// The size of each receive buffer.  This is large enough for any UDP datagram
+static const int BUFFER_SIZE = 64 * 1024;
+
+// A NIC hardware timestamp further than this from the kernel's software timestamp means the NIC's clock
+// isn't synchronised with the system clock, so the wire->socket latency would be meaningless
+static const uint64_t WIRE_PLAUSIBLE_NS = 100000000;
+
+// A pipeline stage that finds nothing to do this many times in a row starts sleeping between looks
+static const int IDLE_SPINS = 64;
+
+
+//==========================================================================================================
+// idle() - Called by a pipeline stage that has nothing to do.  Yields the CPU at first, then backs off to
+//          short sleeps so that an idle pipeline doesn't starve the threads that feed it
+//==========================================================================================================
+static void idle(int& spins)
+{
+    if (++spins < IDLE_SPINS)
+        sched_yield();
+    else
+        usleep(20);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// create() - Creates the sockets and receive buffers for this worker
+//
+// Passed:  config     = settings shared by all workers
+//          index      = this worker's index.  With AF_XDP, this is the receive queue we bind to
+//          cpu        = the CPU to pin this worker to, or -1
+//          reuse_port = true if other workers will be listening on the same port
+//
+// Returns: true on success, false if either socket couldn't be created
+//==========================================================================================================
+bool Loopback::create(const loop_config_t& config, int index, int cpu, bool reuse_port)
+{
+    // Save our configuration
+    m_config = config;
+    m_cpu    = cpu;
+
+    // Make room for every packet in a batch to be rejected
+    m_rejected.resize(config.batch_size);
+
+    // Create the capture file.  When there are several workers, each gets its own
+    if (!config.capture.empty())
+    {
+        string filename = config.capture + (reuse_port ? "." + to_string(index) : "");
+        if (!capture.create(filename, config.capture_size, config.server_port)) return false;
+    }
+
+    // Open the disk sink.  Every worker writes its own extents into the same file
+    if (!config.sink.empty())
+    {
+        if (!sink.create(config.sink, config.sink_base, config.sink_extent, config.sink_buffers)) return false;
+    }
+
+    // In AF_XDP mode, packets live in the UMEM of our XDP socket instead of in our own buffers
+    if (config.xdp)
+    {
+        m_packet.resize(config.batch_size);
+        return m_xdp.create(*config.xdp, index, config.server_port, config.dest_ip, config.dest_port,
+                            config.xdp_frame_size);
+    }
+
+    // Create the UDP server socket, or in reactor mode, a server socket for every listen address
+    if (config.listen.empty())
+    {
+        if (!m_server.create_server(config.server_port, "", AF_UNSPEC, reuse_port, config.iface)) return false;
+        if (config.gro && !m_server.enable_gro()) return false;
+        if (config.busy_poll_us && !m_server.enable_busy_poll(config.busy_poll_us)) return false;
+
+        // Credits promise senders room in the receive buffer, so make it as big as the window needs
+        if (config.credit_window)
+        {
+            int rcvbuf = m_server.set_receive_buffer(config.credit_window * FC_BUFFER_PER_PACKET);
+            m_granter.configure(config.credit_window, rcvbuf);
+        }
+    }
+    else if (!create_reactor(reuse_port)) return false;
+
+    // Create the UDP sender socket in broadcast mode
+    if (!m_sender.create_broadcaster(config.dest_port, config.dest_ip)) return false;
+
+    // When we're serving one interface, echoes go back out the way they came in
+    if (!config.iface.empty() && !m_sender.bind_to_interface(config.iface)) return false;
+
+    // Hold our echoes to a rate the far end can absorb
+    if (config.rate_gbps > 0 && !m_sender.enable_pacing(config.rate_gbps, config.burst_size, config.txtime))
+    {
+        return false;
+    }
+
+    // Have the kernel timestamp what we receive and send
+    if (config.timestamps)
+    {
+        if (config.listen.empty() && !m_server.enable_rx_timestamps()) return false;
+        if (!m_sender.enable_tx_timestamps(&latency_stats.send)) return false;
+    }
+
+    // In io_uring mode, packets live in the engine's provided buffers instead of in our own
+    if (config.uring)
+    {
+        m_packet.resize(config.batch_size);
+        return m_uring.create(m_server, m_sender);
+    }
+
+    // In pipeline mode, packets live in a pool that is shared by our receive and transmit stages
+    if (config.pipeline_depth)
+    {
+        if (!m_pool.create(config.pipeline_depth, BUFFER_SIZE, config.hugepages)) return false;
+        m_ready.create(config.pipeline_depth);
+        m_free.create(config.pipeline_depth);
+        for (uint32_t handle = 0; handle < m_pool.count(); ++handle) m_free.push(handle);
+        m_packet.resize(config.batch_size);
+        m_rx_handle.resize(config.batch_size);
+        m_tx_item.resize(config.batch_size);
+
+        // With zero-copy sends, buffers wait here until the kernel is done with them
+        if (config.zerocopy_threshold)
+        {
+            if (!m_sender.enable_zerocopy(config.zerocopy_threshold)) return false;
+            m_zc_pending.create(config.pipeline_depth);
+        }
+        return true;
+    }
+
+    // Allocate a receive buffer for each packet in a batch
+    m_buffer.resize((size_t)config.batch_size * BUFFER_SIZE);
+
+    // Build the packet descriptors that point into those buffers
+    m_packet.resize(config.batch_size);
+    for (int i=0; i<config.batch_size; ++i)
+    {
+        m_packet[i].data     = &m_buffer[(size_t)i * BUFFER_SIZE];
+        m_packet[i].capacity = BUFFER_SIZE;
+        m_packet[i].length   = 0;
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// start() - Starts the worker thread
+//==========================================================================================================
+void Loopback::start()
+{
+    m_start_ns = Pacer::now_ns();
+    m_thread = thread(&Loopback::run, this);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// join() - Waits for the worker thread to end
+//==========================================================================================================
+void Loopback::join()
+{
+    if (m_thread.joinable()) m_thread.join();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run() - Pins this thread to its CPU, then echoes packets forever
+//==========================================================================================================
+void Loopback::run()
+{
+    // If we've been assigned a CPU, pin ourselves to it
+    if (m_cpu >= 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(m_cpu, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    }
+
+    // If we've been asked to, run as a real-time thread so that nothing else gets scheduled on our CPU
+    if (m_config.fifo_priority)
+    {
+        sched_param param = {};
+        param.sched_priority = m_config.fifo_priority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+        {
+            printf("Can't switch worker to SCHED_FIFO (needs CAP_SYS_NICE), continuing without it\n");
+        }
+    }
+
+    // Echo packets via AF_XDP, io_uring, an event loop over several ports, a receive/transmit pipeline,
+    // or via UDP sockets one at a time or in batches
+    if (m_config.xdp)
+        loop_batch(m_xdp, m_xdp);
+    else if (m_config.uring)
+        loop_batch(m_uring, m_uring);
+    else if (!m_config.listen.empty())
+        loop_reactor();
+    else if (m_config.pipeline_depth)
+        run_pipeline();
+    else if (m_config.batch_size > 1 || m_config.gro || m_config.timestamps || !m_config.capture.empty()
+             || m_config.track_streams || m_config.verifier || !m_config.sink.empty() || m_config.credit_window)
+        loop_batch(m_server, m_sender);
+    else
+        loop_single();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// loop_single() - Receives and echoes packets one at a time
+//==========================================================================================================
+void Loopback::loop_single()
+{
+    char* buffer = m_buffer.data();
+
+    while (true)
+    {
+        // Wait for a packet to arrive
+        int packet_len = m_server.receive(buffer, BUFFER_SIZE);
+        if (packet_len < 0) continue;
+
+        // Keep track of how many packets we've received
+        stats.count(packet_len);
+
+        // If we're validating packets, drop any that the classifier rejects
+        if (m_config.filter)
+        {
+            udp_packet_t packet = {buffer, BUFFER_SIZE, packet_len};
+            int verdict = m_config.filter->classify(packet, NULL);
+            filter_stats.count(verdict);
+            if (verdict != FILTER_PASS) continue;
+        }
+
+        // If we're acting as an RDMA target, write the packet into the target region
+        if (m_config.target)
+        {
+            m_config.target->apply(buffer, packet_len, target_stats);
+            continue;
+        }
+
+        // Send the packet back to whomever sent it
+        m_sender.send(buffer, packet_len);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// loop_batch() - Receives packets in batches and echoes each batch with a single system call
+//
+// Passed:  rx = the socket to receive on (a UDPSock, UringSock or XDPSock)
+//          tx = the socket to echo on (a UDPSock, or the same UringSock or XDPSock)
+//==========================================================================================================
+template <class RX, class TX> void Loopback::loop_batch(RX& rx, TX& tx)
+{
+    int batch_size = m_config.batch_size;
+
+    while (true)
+    {
+        // Wait for one or more packets to arrive
+        int packet_count = rx.receive_batch(m_packet.data(), batch_size);
+        if (packet_count < 1) continue;
+
+        // Validate it, count it, and echo it
+        handle_batch(rx, tx, packet_count);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// handle_batch() - Counts, validates, and echoes (or sinks into the RDMA target) a batch of packets that
+//                  has just been received into m_packet
+//
+// Passed:  rx           = the socket the batch was received on
+//          tx           = the socket to echo on
+//          packet_count = the number of packets in the batch
+//==========================================================================================================
+template <class RX, class TX> void Loopback::handle_batch(RX& rx, TX& tx, int packet_count)
+{
+    udp_packet_t* packet = m_packet.data();
+
+    // Note how long the batch took to reach us
+    if (m_config.timestamps) record_rx_latency(packet, packet_count);
+
+    // Keep a copy of everything we've received
+    if (!m_config.capture.empty()) capture_batch(packet, packet_count);
+
+    // With GRO, a buffer may hold many packets.  Split them apart if anything needs to look at them
+    // one at a time.  If not, we'll echo each buffer whole, and GSO will split it on the way out
+    if (m_config.gro)
+    {
+        bool split = m_config.filter || m_config.target || m_config.track_streams || m_config.verifier
+                  || !m_config.sink.empty() || m_config.credit_window;
+        packet_count = split_batch(packet_count, split);
+        if (split) packet = m_split.data();
+    }
+    else for (int i=0; i<packet_count; ++i) stats.count(packet[i].length);
+
+    // If we're validating packets, drop any that the classifier rejects
+    if (m_config.filter)
+    {
+        packet_count = filter_batch(rx, packet, packet_count);
+        if (packet_count == 0) return;
+    }
+
+    // Look for lost and reordered packets
+    if (m_config.track_streams) track_batch(packet, packet_count);
+
+    // Make sure the data is what the FPGA would have sent
+    if (m_config.verifier) verify_batch(packet, packet_count);
+
+    // If we're acting as an RDMA target or streaming to disk, sink the batch and free it
+    if (m_config.target || !m_config.sink.empty())
+    {
+        sink_batch(packet, packet_count);
+        if (m_config.credit_window) grant_credits(packet, packet_count);
+        rx.release_batch(packet, packet_count);
+        return;
+    }
+
+    // Send the whole batch back to whomever sent it
+    tx.send_batch(packet, packet_count);
+    if (m_config.credit_window) grant_credits(packet, packet_count);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// record_rx_latency() - Records, for each packet in a batch that the kernel timestamped, the time from the
+//                       NIC to the kernel and the time from the kernel to now
+//
+// Passed:  packet = the packets that have just been received
+//          count  = the number of packets
+//==========================================================================================================
+void Loopback::record_rx_latency(const udp_packet_t* packet, int count)
+{
+    // Kernel timestamps are on the realtime clock
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+    for (int i=0; i<count; ++i)
+    {
+        uint64_t software = packet[i].rx_software_ns, hardware = packet[i].rx_hardware_ns;
+        if (software && software <= now) latency_stats.socket.record(now - software);
+        if (hardware == 0) continue;
+        if (software >= hardware && software - hardware <= WIRE_PLAUSIBLE_NS)
+            latency_stats.wire.record(software - hardware);
+        else
+            bump(latency_stats.wire_skipped);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// capture_batch() - Copies every datagram in a batch that has just been received into the capture file
+//
+// Passed:  packet = the packets that have just been received.  With GRO, each may hold several datagrams
+//          count  = the number of packets
+//==========================================================================================================
+void Loopback::capture_batch(const udp_packet_t* packet, int count)
+{
+    // Packets are stamped with the kernel's receive time if we have it, or otherwise with the time now
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+    for (int i=0; i<count; ++i)
+    {
+        uint64_t    time_ns = (m_config.timestamps && packet[i].rx_software_ns) ? packet[i].rx_software_ns : now;
+        const char* data    = (const char*)packet[i].data;
+        int         length  = packet[i].length;
+        int         step    = packet[i].segment_size ? packet[i].segment_size : length;
+
+        // Capture each datagram separately.  If the file is full, there's no point in going on
+        for (int offset = 0; offset < length; offset += step)
+        {
+            int datagram_len = (length - offset < step) ? length - offset : step;
+            if (!capture.capture(data + offset, datagram_len, time_ns)) return;
+        }
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// track_batch() - Runs every packet in a batch through the stream tracker
+//==========================================================================================================
+void Loopback::track_batch(const udp_packet_t* packet, int count)
+{
+    for (int i=0; i<count; ++i)
+    {
+        m_tracker.track(packet[i].source, packet[i].data, packet[i].length, stream_stats);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// verify_batch() - Checks the payload of every packet in a batch against the data_generator pattern
+//==========================================================================================================
+void Loopback::verify_batch(const udp_packet_t* packet, int count)
+{
+    for (int i=0; i<count; ++i)
+    {
+        m_config.verifier->verify(packet[i].data, packet[i].length, verify_stats);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// grant_credits() - Notes that every packet in a batch has been dealt with, then sends credits to the
+//                   senders that are owed them
+//
+// Passed:  packet  = the packets that have been written into the target, staged, or echoed
+//          count   = the number of packets
+//==========================================================================================================
+void Loopback::grant_credits(const udp_packet_t* packet, int count)
+{
+    for (int i=0; i<count; ++i)
+    {
+        m_granter.note(packet[i].source, packet[i].data, packet[i].length, credit_stats);
+    }
+
+    // If we've caught up with everything the kernel had queued for us, whatever is owed goes out now
+    m_granter.grant(m_server, m_server.queue_empty(), credit_stats);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// sink_batch() - Writes every packet in a batch into the RDMA target region and/or the disk sink
+//==========================================================================================================
+void Loopback::sink_batch(const udp_packet_t* packet, int count)
+{
+    if (m_config.target)
+    {
+        for (int i=0; i<count; ++i) m_config.target->apply(packet[i].data, packet[i].length, target_stats);
+    }
+
+    if (!m_config.sink.empty())
+    {
+        for (int i=0; i<count; ++i) sink.write(packet[i].data, packet[i].length);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// split_batch() - Counts each datagram in a batch received with GRO, and optionally splits the batch
+//                 into one descriptor per datagram in m_split
+//
+// Passed:  packet_count = the number of packets in m_packet, each of which may hold several datagrams
+//          split        = true to fill in m_split
+//
+// Returns: the number of descriptors in m_split if "split" is true, otherwise packet_count
+//==========================================================================================================
+int Loopback::split_batch(int packet_count, bool split)
+{
+    int total = 0;
+
+    for (int i=0; i<packet_count; ++i)
+    {
+        // Make sure m_split (and m_rejected) have room for every datagram in this packet.  They only grow
+        int segments = UDPSock::segment_count(m_packet[i]);
+        if (m_split.size() < (size_t)(total + segments))
+        {
+            m_split.resize(total + segments);
+            m_rejected.resize(m_split.size());
+        }
+
+        // Break the packet into its datagrams and count each one
+        UDPSock::split_segments(m_packet[i], &m_split[total]);
+        for (int j=0; j<segments; ++j) stats.count(m_split[total + j].length);
+
+        // If we're keeping the split descriptors, move past them
+        if (split) total += segments;
+    }
+
+    return split ? total : packet_count;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// create_reactor() - Creates a non-blocking server socket for every listen address and registers it with
+//                    the event loop
+//
+// Passed:  reuse_port = true if other workers will be listening on the same ports
+//
+// Returns: true on success
+//==========================================================================================================
+bool Loopback::create_reactor(bool reuse_port)
+{
+    // Create the epoll instance
+    if (!m_reactor.create()) return false;
+
+    for (auto& address : m_config.listen)
+    {
+        string bind_to;
+
+        // Listen addresses are "port" or "ip:port"
+        size_t colon = address.rfind(':');
+        if (colon != string::npos) bind_to = address.substr(0, colon);
+        int port = atoi(address.c_str() + (colon == string::npos ? 0 : colon + 1));
+
+        // Create the server socket for this address
+        m_listen.push_back(make_unique<UDPSock>());
+        UDPSock& sock = *m_listen.back();
+        if (!sock.create_server(port, bind_to, AF_UNSPEC, reuse_port)) return false;
+        if (m_config.gro && !sock.enable_gro()) return false;
+        if (m_config.timestamps && !sock.enable_rx_timestamps()) return false;
+        if (m_config.busy_poll_us && !sock.enable_busy_poll(m_config.busy_poll_us)) return false;
+
+        // Whenever packets arrive, receive batches until the socket is empty, and echo each one
+        auto on_readable = [this](UDPSock& server)
+        {
+            int packet_count;
+            while ((packet_count = server.receive_batch(m_packet.data(), m_config.batch_size)) > 0)
+            {
+                handle_batch(server, m_sender, packet_count);
+            }
+        };
+
+        // And have the event loop watch it
+        if (!m_reactor.add_socket(sock, on_readable)) return false;
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// loop_reactor() - Serves every listen address from a single event loop
+//==========================================================================================================
+void Loopback::loop_reactor()
+{
+    // When busy-polling, never let epoll put us to sleep
+    if (m_config.busy_poll_us)
+        while (true) m_reactor.run_once(0);
+    else
+        m_reactor.run();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run_pipeline() - Starts the transmit stage in its own thread, and runs the receive stage in this one
+//==========================================================================================================
+void Loopback::run_pipeline()
+{
+    m_tx_thread = thread(&Loopback::tx_stage, this);
+    rx_stage();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// rx_stage() - Receives packets into buffers from the pool and hands them to the transmit stage.  If the
+//              ring to the transmit stage is full, the packet is dropped rather than waiting for room
+//==========================================================================================================
+void Loopback::rx_stage()
+{
+    int batch_size = m_config.batch_size;
+    int have = 0, spins = 0;
+
+    while (true)
+    {
+        // Top up the buffers we're holding with empty ones from the transmit stage
+        if (have < batch_size) have += m_free.pop(&m_rx_handle[have], batch_size - have);
+        if (have == 0)
+        {
+            idle(spins);
+            continue;
+        }
+        spins = 0;
+
+        // Point a packet descriptor at each buffer we're holding
+        for (int i=0; i<have; ++i)
+        {
+            m_packet[i].data     = m_pool.data(m_rx_handle[i]);
+            m_packet[i].capacity = m_pool.buffer_size();
+        }
+
+        // Wait for one or more packets to arrive
+        int packet_count = m_server.receive_batch(m_packet.data(), have);
+        if (packet_count < 1) continue;
+
+        // Note how long the batch took to reach us
+        if (m_config.timestamps) record_rx_latency(m_packet.data(), packet_count);
+
+        // Keep a copy of everything we've received
+        if (!m_config.capture.empty()) capture_batch(m_packet.data(), packet_count);
+
+        // Pass each packet to the transmit stage.  We hang on to the buffers of any we don't pass
+        int kept = 0;
+        for (int i=0; i<packet_count; ++i)
+        {
+            const udp_packet_t& packet = m_packet[i];
+            stats.count(packet.length);
+
+            // If we're validating packets, drop any that the classifier rejects
+            if (m_config.filter)
+            {
+                int verdict = m_config.filter->classify(packet, NULL);
+                filter_stats.count(verdict);
+                if (verdict != FILTER_PASS)
+                {
+                    m_rx_handle[kept++] = m_rx_handle[i];
+                    continue;
+                }
+            }
+
+            // Look for lost and reordered packets, and make sure the data is what the FPGA would have sent
+            if (m_config.track_streams) track_batch(&packet, 1);
+            if (m_config.verifier) verify_batch(&packet, 1);
+
+            // Queue the packet for the transmit stage
+            if (!m_ready.push({m_rx_handle[i], (uint32_t)packet.length}))
+            {
+                bump(pipeline_stats.ring_full);
+                m_rx_handle[kept++] = m_rx_handle[i];
+            }
+        }
+
+        // We also still hold the buffers that didn't receive a packet
+        for (int i=packet_count; i<have; ++i) m_rx_handle[kept++] = m_rx_handle[i];
+        have = kept;
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// tx_stage() - Takes filled buffers from the receive stage, echoes them (or writes them into the RDMA
+//              target), then hands the buffers back to the receive stage
+//==========================================================================================================
+void Loopback::tx_stage()
+{
+    int batch_size = m_config.batch_size;
+    int spins = 0;
+
+    while (true)
+    {
+        // Fetch a batch of packets from the receive stage, noting how deep the queue was
+        uint64_t depth = m_ready.size();
+        pipeline_stats.depth_now.store(depth, memory_order_relaxed);
+        int count = m_ready.pop(m_tx_item.data(), batch_size);
+        if (count == 0)
+        {
+            if (m_config.zerocopy_threshold) reclaim_zerocopy();
+            idle(spins);
+            continue;
+        }
+        spins = 0;
+
+        // Keep track of the average and maximum depth of the queue while there's work in it
+        bump(pipeline_stats.depth_sum, depth);
+        bump(pipeline_stats.depth_samples);
+        if (depth > pipeline_stats.depth_max.load(memory_order_relaxed))
+        {
+            pipeline_stats.depth_max.store(depth, memory_order_relaxed);
+        }
+
+        // Point a packet descriptor at each one
+        for (int i=0; i<count; ++i)
+        {
+            m_packet[i].data   = m_pool.data(m_tx_item[i].handle);
+            m_packet[i].length = m_tx_item[i].length;
+        }
+
+        // Write the packets into the RDMA target or the disk sink, or send them back to whomever sent them
+        bool sinking = m_config.target || !m_config.sink.empty();
+        if (sinking)
+            sink_batch(m_packet.data(), count);
+        else
+            m_sender.send_batch(m_packet.data(), count);
+
+        // If we didn't send them zero-copy, we can give the buffers straight back to the receive stage
+        if (m_config.zerocopy_threshold == 0 || sinking)
+        {
+            for (int i=0; i<count; ++i) m_free.push(m_tx_item[i].handle);
+            continue;
+        }
+
+        // Otherwise the buffers can be reused once the kernel has completed everything we've sent so far
+        uint32_t release_at = m_sender.zerocopy_issued();
+        for (int i=0; i<count; ++i) m_zc_pending.push({m_tx_item[i].handle, release_at});
+        reclaim_zerocopy();
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// reclaim_zerocopy() - Collects zero-copy completions from the kernel, and hands every buffer that the
+//                      kernel has finished with back to the receive stage
+//==========================================================================================================
+void Loopback::reclaim_zerocopy()
+{
+    uint32_t completed = m_sender.reap_zerocopy();
+
+    // Buffers become reusable in the order they were sent
+    const pool_packet_t* pending;
+    while ((pending = m_zc_pending.peek()) && (int32_t)(completed - pending->length) >= 0)
+    {
+        pool_packet_t done;
+        m_free.push(pending->handle);
+        m_zc_pending.pop(&done, 1);
+    }
+
+    // Keep the counters up to date
+    pipeline_stats.zerocopy_sent.store(m_sender.zerocopy_issued(), memory_order_relaxed);
+    pipeline_stats.zerocopy_copied.store(m_sender.zerocopy_copied(), memory_order_relaxed);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_pipeline_summary() - Displays the queue-depth counters of one or more pipelines
+//==========================================================================================================
+void Loopback::show_pipeline_summary(pipeline_stats_t** stats, int count)
+{
+    uint64_t max = 0, sum = 0, samples = 0, ring_full = 0, zc_sent = 0, zc_copied = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        uint64_t depth_max = stats[i]->depth_max.load(memory_order_relaxed);
+        if (depth_max > max) max = depth_max;
+        sum       += stats[i]->depth_sum.load(memory_order_relaxed);
+        samples   += stats[i]->depth_samples.load(memory_order_relaxed);
+        ring_full += stats[i]->ring_full.load(memory_order_relaxed);
+        zc_sent   += stats[i]->zerocopy_sent.load(memory_order_relaxed);
+        zc_copied += stats[i]->zerocopy_copied.load(memory_order_relaxed);
+    }
+
+    printf("pipeline  : queue depth average %.1f, max %llu, dropped %llu with the queue full\n",
+           samples ? (double)sum / samples : 0.0, (unsigned long long)max, (unsigned long long)ring_full);
+
+    // If anything went out zero-copy, say how much of it the kernel had to copy after all
+    if (zc_sent)
+    {
+        printf("zero-copy : %llu sends, %llu copied by the kernel anyway\n",
+               (unsigned long long)zc_sent, (unsigned long long)zc_copied);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_latency_summary() - Displays the per-stage latencies of one or more workers
+//==========================================================================================================
+void Loopback::show_latency_summary(latency_stats_t** stats, int count)
+{
+    LatencyHistogram wire, socket, send;
+    uint64_t wire_skipped = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        wire_skipped += stats[i]->wire_skipped.load(memory_order_relaxed);
+        wire.merge(stats[i]->wire);
+        socket.merge(stats[i]->socket);
+        send.merge(stats[i]->send);
+    }
+
+    // One line per stage, skipping any stage the kernel or NIC never timestamped
+    auto show = [](const char* name, const LatencyHistogram& hist)
+    {
+        if (hist.count() == 0)
+        {
+            printf("%-10s: no timestamps\n", name);
+            return;
+        }
+        printf("%-10s: usec p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f  (%llu packets)\n", name,
+               hist.percentile(50) / 1e3, hist.percentile(99) / 1e3, hist.percentile(99.9) / 1e3,
+               hist.max() / 1e3, (unsigned long long)hist.count());
+    };
+
+    show("wire->sock", wire);
+    if (wire_skipped)
+    {
+        printf("            %llu hardware stamps were more than %llu ms from the kernel's and were skipped.\n"
+               "            Is the NIC's clock synchronised with the system clock (phc2sys)?\n",
+               (unsigned long long)wire_skipped, (unsigned long long)(WIRE_PLAUSIBLE_NS / 1000000));
+    }
+    show("sock->app",  socket);
+    show("app->sent",  send);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_cpu_summary() - Displays how much CPU time each worker (and the transmit stage of each pipeline)
+//                      has used, as a percentage of one CPU, next to the latency the worker achieved
+//==========================================================================================================
+void Loopback::show_cpu_summary(Loopback** worker, int count)
+{
+    // Returns the CPU time a thread has used, in nanoseconds
+    auto cpu_ns = [](thread& t) -> int64_t
+    {
+        clockid_t clock;
+        timespec  ts;
+        if (!t.joinable() || pthread_getcpuclockid(t.native_handle(), &clock) != 0) return 0;
+        if (clock_gettime(clock, &ts) != 0) return 0;
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    };
+
+    for (int i=0; i<count; ++i)
+    {
+        Loopback& w = *worker[i];
+        double elapsed = Pacer::now_ns() - w.m_start_ns;
+
+        printf("worker %-3d: %5.1f%% CPU", i, 100 * cpu_ns(w.m_thread) / elapsed);
+        if (w.m_tx_thread.joinable()) printf(" + %.1f%% transmit", 100 * cpu_ns(w.m_tx_thread) / elapsed);
+        if (w.m_cpu >= 0) printf(" on CPU %d", w.m_cpu);
+
+        const LatencyHistogram& socket = w.latency_stats.socket;
+        if (socket.count())
+        {
+            printf(", sock->app usec p50 %.1f  p99 %.1f  p99.9 %.1f", socket.percentile(50) / 1e3,
+                   socket.percentile(99) / 1e3, socket.percentile(99.9) / 1e3);
+        }
+        printf("\n");
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// filter_batch() - Runs a batch of received packets through the classifier.  The packets that pass are
+//                  moved to the front of the array, and the rest are handed back to the receiver
+//
+// Passed:  rx     = the socket the batch was received on
+//          packet = the packets in the batch
+//          count  = the number of packets in the batch
+//
+// Returns: the number of packets that passed
+//==========================================================================================================
+template <class RX> int Loopback::filter_batch(RX& rx, udp_packet_t* packet, int count)
+{
+    int passed = 0, rejected = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        // With AF_XDP, the UDP header is sitting in the frame right in front of the RDMA header
+        const udphdr* udp = m_config.xdp ? (const udphdr*)packet[i].data - 1 : NULL;
+
+        // Classify the packet and count the verdict
+        int verdict = m_config.filter->classify(packet[i], udp);
+        filter_stats.count(verdict);
+
+        // Keep the packets that pass, and set aside the ones that don't
+        if (verdict == FILTER_PASS)
+            packet[passed++] = packet[i];
+        else
+            m_rejected[rejected++] = packet[i];
+    }
+
+    // The receiver gets back the buffers of the packets we've rejected
+    if (rejected) rx.release_batch(m_rejected.data(), rejected);
+
+    // Tell the caller how many packets are left in the batch
+    return passed;
+}
+//==========================================================================================================
@@ -0,0 +1,331 @@
+//==========================================================================================================
+// loopback.h - Defines a worker thread that receives RDMA packets and echoes them back (or sinks them)
+//==========================================================================================================
+#pragma once
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include "udpsock.h"
+#include "xdpsock.h"
+#include "uringsock.h"
+#include "rdma_target.h"
+#include "rdma_filter.h"
+#include "packet_pool.h"
+#include "spsc_ring.h"
+#include "pcap.h"
+#include "stream_tracker.h"
+#include "payload_verifier.h"
+#include "disk_sink.h"
+#include "flow_control.h"
+#include "stats.h"
+
+//==========================================================================================================
+// loop_config_t - Settings shared by every loopback worker
+//==========================================================================================================
+struct loop_config_t
+{
+    // The (broadcast) IP address that packets are echoed to
+    std::string dest_ip = "10.1.1.255";
+
+    // The UDP port that we echo packets to
+    int         dest_port = 11111;
+
+    // The UDP port that we receive packets on
+    int         server_port = 32002;
+
+    // The number of packets to receive and echo per system call
+    int         batch_size = 1;
+
+    // If true, packets are received and echoed via io_uring instead of recvmmsg()/sendmmsg()
+    bool        uring = false;
+
+    // If this isn't NULL, packets are received and echoed via AF_XDP sockets instead of UDP sockets
+    XDPProgram* xdp = NULL;
+
+    // The size of each AF_XDP UMEM frame
+    int         xdp_frame_size = 4096;
+
+    // If this isn't NULL, packets are written into this RDMA target instead of being echoed
+    RdmaTarget* target = NULL;
+
+    // If this isn't NULL, packets that this classifier rejects are dropped
+    const RdmaFilter* filter = NULL;
+
+    // If this isn't 0, receive and transmit run in separate threads connected by a ring this deep
+    int         pipeline_depth = 0;
+
+    // If true, the pipeline's packet pool is backed by hugepages
+    bool        hugepages = false;
+
+    // If this isn't 0, the pipeline's transmit stage sends packets at least this long with MSG_ZEROCOPY
+    int         zerocopy_threshold = 0;
+
+    // If true, the kernel coalesces received datagrams with GRO, and echoes go out with GSO
+    bool        gro = false;
+
+    // If this isn't empty, packets are received on each of these "[ip:]port" addresses (instead of on
+    // server_port) by a single epoll event loop
+    std::vector<std::string> listen;
+
+    // If true, the kernel timestamps every packet we receive and send, and we keep latency histograms
+    bool        timestamps = false;
+
+    // If this isn't empty, every packet received is captured into a pcap file of this name (with
+    // ".<worker>" appended when several workers share a port), preallocated to capture_size bytes
+    std::string capture;
+    size_t      capture_size = PCAP_DEFAULT_SIZE;
+
+    // If this isn't 0, server sockets are non-blocking and busy-poll the NIC for this many microseconds
+    // per receive, and the workers spin instead of sleeping
+    int         busy_poll_us = 0;
+
+    // If this isn't 0, the workers run under SCHED_FIFO at this priority
+    int         fifo_priority = 0;
+
+    // If true, each sender's packets are checked for loss, duplication and reordering
+    bool        track_streams = false;
+
+    // If this isn't NULL, every payload is checked against the data_generator pattern
+    const PayloadVerifier* verifier = NULL;
+
+    // If this isn't empty, payloads are streamed into this file at (target address - sink_base) instead
+    // of being echoed, coalesced in sink_buffers staging buffers of sink_extent bytes
+    std::string sink;
+    uint64_t    sink_base = 0;
+    size_t      sink_extent = SINK_DEFAULT_EXTENT;
+    int         sink_buffers = SINK_DEFAULT_BUFFERS;
+
+    // If this isn't empty, packets are received only from this network interface, and echoes leave
+    // through it, from its IP address
+    std::string iface;
+
+    // If this isn't 0, each worker's echoes are paced to this many Gbit/s, with at most burst_size bytes
+    // leaving back-to-back.  With txtime, the kernel spaces them out by SO_TXTIME departure times
+    double      rate_gbps = 0;
+    uint64_t    burst_size = PACER_DEFAULT_BURST;
+    bool        txtime = false;
+
+    // If this isn't 0, senders that ask for flow control are sent credits for a window of this many
+    // packets as their packets are dealt with
+    int         credit_window = 0;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// pipeline_stats_t - Counters for the ring between the receive and transmit stages of a pipeline
+//==========================================================================================================
+struct pipeline_stats_t
+{
+    // Written by the transmit stage: the ring depth seen each time it looks for packets
+    alignas(64) std::atomic<uint64_t> depth_now{0};
+    std::atomic<uint64_t>   depth_max{0};
+    std::atomic<uint64_t>   depth_sum{0};
+    std::atomic<uint64_t>   depth_samples{0};
+
+    // Written by the transmit stage: packets sent zero-copy, and the ones the kernel copied anyway
+    std::atomic<uint64_t>   zerocopy_sent{0};
+    std::atomic<uint64_t>   zerocopy_copied{0};
+
+    // Written by the receive stage: packets dropped because the ring was full
+    alignas(64) std::atomic<uint64_t> ring_full{0};
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// latency_stats_t - Where the time goes, measured with kernel (and, if available, NIC) timestamps.  All
+//                   values are in nanoseconds
+//==========================================================================================================
+struct latency_stats_t
+{
+    // Written by the receive stage: NIC hardware timestamp to kernel software timestamp.  This is only
+    // meaningful when the NIC's PTP hardware clock is synchronised with the system clock (by phc2sys, say).
+    // Pairs of stamps more than WIRE_PLAUSIBLE_NS apart can't be, and are counted in wire_skipped instead
+    LatencyHistogram    wire;
+    std::atomic<uint64_t> wire_skipped{0};
+
+    // Written by the receive stage: kernel software timestamp to the application seeing the packet
+    LatencyHistogram    socket;
+
+    // Written by the transmit stage: the application sending a packet to the kernel handing it to the NIC
+    LatencyHistogram    send;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// Loopback - A worker that owns its own server socket, sender socket and receive buffers
+//==========================================================================================================
+class Loopback
+{
+public:
+
+    // Creates the sockets and buffers.  A cpu of -1 means "don't pin this worker to a CPU"
+    bool    create(const loop_config_t& config, int index, int cpu, bool reuse_port);
+
+    // Starts the worker thread
+    void    start();
+
+    // Waits for the worker thread to end
+    void    join();
+
+    // Returns true if our AF_XDP socket is running in zero-copy mode
+    bool    is_zerocopy() {return m_xdp.is_zerocopy();}
+
+    // Returns the pacer that holds our echoes to the configured rate
+    const Pacer& get_pacer() {return m_sender.get_pacer();}
+
+    // Packet counters, updated only by this worker's thread
+    packet_stats_t  stats;
+
+    // RDMA target counters, updated only by this worker's thread
+    target_stats_t  target_stats;
+
+    // Classifier verdict counters, updated only by this worker's thread
+    filter_stats_t  filter_stats;
+
+    // Pipeline queue-depth counters
+    pipeline_stats_t pipeline_stats;
+
+    // Per-stage latency histograms, filled in when config.timestamps is true
+    latency_stats_t latency_stats;
+
+    // The file that received packets are captured into, when config.capture isn't empty
+    PcapWriter      capture;
+
+    // Loss and reordering counters, updated only by this worker's receiving thread
+    stream_stats_t  stream_stats;
+
+    // Payload verification counters, updated only by this worker's receiving thread
+    verify_stats_t  verify_stats;
+
+    // The file that payloads are streamed into, when config.sink isn't empty
+    DiskSink        sink;
+
+    // Flow-control counters, updated only by this worker's receiving thread
+    credit_stats_t  credit_stats;
+
+    // Displays the pipeline counters of one or more workers
+    static void show_pipeline_summary(pipeline_stats_t** stats, int count);
+
+    // Displays the per-stage latencies of one or more workers
+    static void show_latency_summary(latency_stats_t** stats, int count);
+
+    // Displays how much CPU time each worker has used, next to the latency it achieved
+    static void show_cpu_summary(Loopback** worker, int count);
+
+protected:
+
+    // This is the body of the worker thread
+    void    run();
+
+    // Receives and echoes packets one at a time
+    void    loop_single();
+
+    // Receives packets in batches and echoes each batch.  RX and TX are UDPSock, UringSock or XDPSock
+    template <class RX, class TX> void loop_batch(RX& rx, TX& tx);
+
+    // Starts the transmit stage of a pipeline, then runs the receive stage
+    void    run_pipeline();
+
+    // The two stages of a pipeline
+    void    rx_stage();
+    void    tx_stage();
+
+    // Hands buffers that the kernel has finished sending zero-copy back to the receive stage
+    void    reclaim_zerocopy();
+
+    // Creates a server socket for every address in config.listen and registers it with m_reactor
+    bool    create_reactor(bool reuse_port);
+
+    // Receives on every address in config.listen from one epoll event loop
+    void    loop_reactor();
+
+    // Validates, counts, and echoes (or sinks) a batch of packets that has just been received
+    template <class RX, class TX> void handle_batch(RX& rx, TX& tx, int packet_count);
+
+    // Runs a batch through the classifier, releases the rejects, and returns the number that passed
+    template <class RX> int filter_batch(RX& rx, udp_packet_t* packet, int count);
+
+    // Records how long each packet in a batch took to get from the wire to the kernel and to us
+    void    record_rx_latency(const udp_packet_t* packet, int count);
+
+    // Copies every datagram in a batch into the capture file
+    void    capture_batch(const udp_packet_t* packet, int count);
+
+    // Runs each packet in a batch through the stream tracker
+    void    track_batch(const udp_packet_t* packet, int count);
+
+    // Checks the payload of each packet in a batch against the data_generator pattern
+    void    verify_batch(const udp_packet_t* packet, int count);
+
+    // Writes each packet in a batch into the RDMA target and/or the disk sink
+    void    sink_batch(const udp_packet_t* packet, int count);
+
+    // Notes that each packet in a batch has been dealt with, and sends credits to senders owed them
+    void    grant_credits(const udp_packet_t* packet, int count);
+
+    // Counts the datagrams in a GRO batch and optionally splits them into m_split
+    int     split_batch(int packet_count, bool split);
+
+    // A copy of the configuration we were created with
+    loop_config_t   m_config;
+
+    // The CPU this worker is pinned to, or -1
+    int             m_cpu;
+
+    // Follows the stream of packets from each sender
+    StreamTracker   m_tracker;
+
+    // Sends credits to the senders that ask for flow control
+    CreditGranter   m_granter;
+
+    // Our sockets
+    UDPSock         m_server, m_sender;
+
+    // In reactor mode, one server socket per listen address, and the event loop that serves them
+    std::vector<std::unique_ptr<UDPSock>> m_listen;
+    EventLoop       m_reactor;
+
+    // Our AF_XDP socket, used when config.xdp isn't NULL
+    XDPSock         m_xdp;
+
+    // Our io_uring engine, used when config.uring is true
+    UringSock       m_uring;
+
+    // One receive buffer for every packet in a batch
+    std::vector<char> m_buffer;
+
+    // Packet descriptors that point into m_buffer
+    std::vector<udp_packet_t> m_packet;
+
+    // Packets from a batch that the classifier rejected
+    std::vector<udp_packet_t> m_rejected;
+
+    // With GRO, one descriptor per datagram in the batch
+    std::vector<udp_packet_t> m_split;
+
+    // For a pipeline: the packet buffers, the ring of filled buffers headed for the transmit stage,
+    // and the ring of empty buffers headed back to the receive stage
+    PacketPool      m_pool;
+    SPSCRing<pool_packet_t> m_ready;
+    SPSCRing<uint32_t>      m_free;
+
+    // For a pipeline: the buffers the receive stage is holding, and the packets the transmit stage is
+    // working on
+    std::vector<uint32_t>      m_rx_handle;
+    std::vector<pool_packet_t> m_tx_item;
+
+    // For a pipeline with zero-copy sends: buffers that the kernel may still be reading from.  Each one
+    // can be reused once the sender's zerocopy_completed() reaches its "length" field
+    SPSCRing<pool_packet_t>    m_zc_pending;
+
+    // The worker thread, and the transmit stage thread of a pipeline
+    std::thread     m_thread, m_tx_thread;
+
+    // When start() was called, on the monotonic clock
+    int64_t         m_start_ns;
+};
+//==========================================================================================================
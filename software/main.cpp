@@ -1,18 +1,111 @@
 #include <unistd.h>
+#include <getopt.h>
 #include <cstdio>
 #include <cstdlib>
-#include "udpsock.h"
+#include <csignal>
+#include <sys/mman.h>
+#include <cstring>
+#include "loopback.h"
+#include "stats.h"
+#include "cmdline.h"
+#include "metrics.h"
+#include "packet_ring.h"
 #include <string>
+#include <vector>
+#include <memory>
 
 using namespace std;
 
-UDPSock server;
-UDPSock sender;
+// Settings shared by all of the loopback workers
+loop_config_t config;
 
-const char* dest_ip = "10.1.1.255";
-int server_port = 32002;
+// One network port to serve: the interface and UDP port that packets arrive on, and where echoes go
+struct port_tuple_t
+{
+    string  iface;
+    int     server_port;
+    string  dest_ip;
+    int     dest_port;
+};
+
+// If this isn't empty, each of these ports is served by its own workers, instead of every worker
+// serving config.server_port on every interface
+vector<port_tuple_t> port_list;
+
+// If this isn't empty, RDMA packets are received on this interface via AF_XDP
+string xdp_iface;
+
+// The XDP program that steers RDMA packets to our AF_XDP sockets
+XDPProgram xdp_program;
+
+// If this is non-zero, we act as an RDMA target with a region this many bytes long
+size_t target_size = 0;
+
+// The RDMA address of the start of the target region
+uint64_t target_base = 0;
+
+// If this isn't empty, the target region is a mapping of this file
+string target_file;
+
+
+// The memory region that RDMA packets are written into when we're a target
+RdmaTarget target;
+
+// When true, packets are validated by the RDMA classifier before they're used
+bool validate = false;
+
+// The target address window that the classifier enforces.  A size of 0 means "any address"
+uint64_t window_base = 0;
+size_t   window_size = 0;
+
+// The RDMA header classifier
+RdmaFilter filter;
+
+// When true, payloads are checked against the data_generator pattern that starts with pattern_initial
+// at RDMA address pattern_base
+bool     verify = false;
+uint32_t pattern_initial = 0;
+uint64_t pattern_base = 0;
+
+// The payload checker
+PayloadVerifier verifier;
+
+// The number of loopback worker threads (per port, when there's a port list)
+int thread_count = 1;
+
+// The CPUs to pin the worker threads to.  Empty means "don't pin them"
+vector<int> cpu_list;
 
-char buffer[64 * 1024];
+// Milliseconds between throughput reports
+int report_interval_ms = 1000;
+
+// When true, nothing is displayed until the program is stopped
+bool quiet = false;
+
+// If this isn't empty, counters are published in the shared-memory segment /dev/shm/<metrics_name>
+string metrics_name;
+
+// The shared-memory metrics segment
+MetricsSegment metrics;
+
+// The worker threads, and the thread that reports their counters
+vector<unique_ptr<Loopback>> worker;
+StatsReporter reporter;
+
+// The metrics labels that identify each worker
+vector<string> worker_label;
+
+// If this isn't empty, whole RDMA frames arriving on this interface are decoded and checked by a raw
+// TPACKET_V3 ring, alongside the workers.  The first monitor_dump of them are displayed
+string monitor_iface;
+int    monitor_dump = 0;
+
+// The raw receive ring that monitors monitor_iface
+PacketRing monitor;
+
+void parse_command_line(int argc, char** argv);
+void register_metrics();
+void on_signal(int);
 
 //============================================================================
 // This program serves as a "loopback" for RDMA packets.   The (optional) IP
@@ -24,39 +117,910 @@ char buffer[64 * 1024];
 //============================================================================
 int main(int argc, char** argv)
 {
-    int count = 0;
+    vector<packet_stats_t*> stats;
 
-    // If there's an IP address on the command line, use it.
-    if (argc > 1) dest_ip = argv[1];
+    // Fetch the options and IP address/port from the command line
+    parse_command_line(argc, argv);
 
-    // If there's a UDP port on the command line, use it
-    if (argc > 2) server_port = atoi(argv[2]);
+    // If we're using AF_XDP, attach our XDP program to the interface
+    if (!xdp_iface.empty())
+    {
+        if (!xdp_program.attach(xdp_iface, config.server_port))
+        {
+            printf("Can't attach XDP program to %s\n", xdp_iface.c_str());
+            exit(1);
+        }
+        config.xdp = &xdp_program;
+    }
+
+    // If we're acting as an RDMA target, map the target region
+    if (target_size)
+    {
+        if (!target.create(target_size, target_base, target_file, config.hugepages))
+        {
+            printf("Can't map a %zu byte RDMA target region\n", target_size);
+            exit(1);
+        }
+        config.target = &target;
+    }
 
-    // Create the UDP server socket
-    if (!server.create_server(server_port))
+    // If we're validating packets, compile the classifier rules
+    if (validate)
     {
-        printf("Can't create server\n");
-        exit(1);        
+        filter_rules_t rules = {{(uint16_t)config.server_port, (uint16_t)config.dest_port},
+                                window_base, window_size};
+        filter.compile(rules);
+        config.filter = &filter;
     }
 
-    // Create the UDP sender socket in broadcast mode
-    if (!sender.create_broadcaster(11111, dest_ip))
+    // When busy-polling, every worker gets a CPU of its own, and we don't want to take page faults
+    if (config.busy_poll_us)
     {
-        printf("Can't create sender\n");
-        exit(1);        
+        if (cpu_list.empty())
+        {
+            int workers = thread_count * (port_list.empty() ? 1 : port_list.size());
+            for (int i=0; i<workers; ++i) cpu_list.push_back(i % sysconf(_SC_NPROCESSORS_ONLN));
+        }
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        {
+            printf("Can't lock memory (needs CAP_IPC_LOCK), continuing without it\n");
+        }
     }
-    
-    while (true)
+
+    // If we're verifying payloads, tell the verifier what pattern to expect
+    if (verify)
+    {
+        verifier.configure(pattern_initial, pattern_base);
+        config.verifier = &verifier;
+    }
+
+    // Without a port list, every worker serves the server port on every interface
+    if (port_list.empty()) port_list.push_back({"", config.server_port, config.dest_ip, config.dest_port});
+
+    // Create the workers.  Each port gets its own, and if it has more than one, they share the port
+    for (auto& port : port_list)
+    {
+        loop_config_t port_config = config;
+        port_config.iface         = port.iface;
+        port_config.server_port   = port.server_port;
+        port_config.dest_ip       = port.dest_ip;
+        port_config.dest_port     = port.dest_port;
+
+        // Each port has its own capture files
+        if (!port.iface.empty() && !config.capture.empty()) port_config.capture += "." + port.iface;
+
+        vector<packet_stats_t*> port_stats;
+        for (int j=0; j<thread_count; ++j)
+        {
+            int i   = worker.size();
+            int cpu = cpu_list.empty() ? -1 : cpu_list[i % cpu_list.size()];
+            worker.push_back(make_unique<Loopback>());
+            if (!worker[i]->create(port_config, i, cpu, thread_count > 1))
+            {
+                if (port.iface.empty())
+                    printf("Can't create sockets for worker %d\n", i);
+                else
+                    printf("Can't create sockets for worker %d on %s\n", i, port.iface.c_str());
+                exit(1);
+            }
+            stats.push_back(&worker[i]->stats);
+            port_stats.push_back(&worker[i]->stats);
+
+            // Metrics identify the worker, and the port it serves
+            string label = "worker=\"" + to_string(i) + "\"";
+            if (!port.iface.empty())
+            {
+                label += ",port=\"" + port.iface + ":" + to_string(port.server_port) + "\"";
+            }
+            worker_label.push_back(label);
+        }
+
+        // Throughput is reported for each port, as well as in total
+        if (!port.iface.empty())
+        {
+            reporter.add_group(port.iface + ":" + to_string(port.server_port), port_stats);
+        }
+    }
+
+    // If we're monitoring an interface, open a raw ring that sees the RDMA ports of every worker
+    if (!monitor_iface.empty())
     {
-        // Wait for a packet to arrive
-        int packet_len = server.receive(buffer, sizeof(buffer));        
+        vector<int> ports;
+        for (auto& port : port_list) ports.push_back(port.server_port);
+        if (!monitor.create(monitor_iface, ports))
+        {
+            printf("Can't open a packet ring on %s (needs CAP_NET_RAW)\n", monitor_iface.c_str());
+            exit(1);
+        }
+        reporter.add_summary([]() {monitor.show_summary();});
+    }
 
-        // Tell the user how many packets we've received
-        printf("%d %d\n", packet_len, ++count);
-        
-        // Send the packet back to whomever sent it
-        sender.send(buffer, packet_len);
+    // When we're a target, the summary includes the target counters of every worker
+    if (config.target)
+    {
+        reporter.add_summary([]()
+        {
+            vector<target_stats_t*> target_stats;
+            for (auto& p_worker : worker) target_stats.push_back(&p_worker->target_stats);
+            target.show_summary(target_stats.data(), target_stats.size());
+        });
     }
 
+    // When we're validating, the summary includes the classifier's verdicts
+    if (config.filter)
+    {
+        reporter.add_summary([]()
+        {
+            vector<filter_stats_t*> filter_stats;
+            for (auto& p_worker : worker) filter_stats.push_back(&p_worker->filter_stats);
+            RdmaFilter::show_summary(filter_stats.data(), filter_stats.size());
+        });
+    }
+
+    // In pipeline mode, the summary includes how deep the queues got
+    if (config.pipeline_depth)
+    {
+        reporter.add_summary([]()
+        {
+            vector<pipeline_stats_t*> pipeline_stats;
+            for (auto& p_worker : worker) pipeline_stats.push_back(&p_worker->pipeline_stats);
+            Loopback::show_pipeline_summary(pipeline_stats.data(), pipeline_stats.size());
+        });
+    }
+
+    // With timestamps, the summary includes the latency of each stage
+    if (config.timestamps)
+    {
+        reporter.add_summary([]()
+        {
+            vector<latency_stats_t*> latency_stats;
+            for (auto& p_worker : worker) latency_stats.push_back(&p_worker->latency_stats);
+            Loopback::show_latency_summary(latency_stats.data(), latency_stats.size());
+        });
+    }
+
+    // When we're tracking streams, the summary includes what was lost and reordered
+    if (config.track_streams)
+    {
+        reporter.add_summary([]()
+        {
+            vector<stream_stats_t*> stream_stats;
+            for (auto& p_worker : worker) stream_stats.push_back(&p_worker->stream_stats);
+            StreamTracker::show_summary(stream_stats.data(), stream_stats.size());
+        });
+    }
+
+    // When we're verifying payloads, the summary includes how many were bad
+    if (config.verifier)
+    {
+        reporter.add_summary([]()
+        {
+            vector<verify_stats_t*> verify_stats;
+            for (auto& p_worker : worker) verify_stats.push_back(&p_worker->verify_stats);
+            verifier.show_summary(verify_stats.data(), verify_stats.size());
+        });
+    }
+
+    // When we're streaming to disk, the summary says how fast the disk kept up
+    if (!config.sink.empty())
+    {
+        reporter.add_summary([]()
+        {
+            vector<DiskSink*> sinks;
+            for (auto& p_worker : worker) sinks.push_back(&p_worker->sink);
+            DiskSink::show_summary(sinks.data(), sinks.size());
+        });
+    }
+
+    // When we're pacing, the summary says what rate the echoes achieved and how steadily
+    if (config.rate_gbps > 0)
+    {
+        reporter.add_summary([]()
+        {
+            vector<const Pacer*> pacers;
+            for (auto& p_worker : worker) pacers.push_back(&p_worker->get_pacer());
+            Pacer::show_summary(pacers.data(), pacers.size(), config.txtime);
+        });
+    }
+
+    // When we're granting credits, the summary says how many went out, and to whom
+    if (config.credit_window)
+    {
+        reporter.add_summary([]()
+        {
+            vector<credit_stats_t*> credits;
+            for (auto& p_worker : worker) credits.push_back(&p_worker->credit_stats);
+            CreditGranter::show_summary(credits.data(), credits.size(), config.credit_window);
+        });
+    }
+
+    // When we're capturing, the summary says how much went into each file
+    if (!config.capture.empty())
+    {
+        reporter.add_summary([]()
+        {
+            vector<PcapWriter*> writers;
+            for (auto& p_worker : worker) writers.push_back(&p_worker->capture);
+            PcapWriter::show_summary(writers.data(), writers.size());
+        });
+    }
+
+    // With timestamps (which busy-polling turns on), the summary shows the CPU each worker used next to
+    // the latency it achieved, so the busy-poll profile can be compared with the normal blocking one
+    if (config.timestamps)
+    {
+        reporter.add_summary([]()
+        {
+            vector<Loopback*> workers;
+            for (auto& p_worker : worker) workers.push_back(p_worker.get());
+            Loopback::show_cpu_summary(workers.data(), workers.size());
+        });
+    }
+
+    // If we're publishing metrics, create the segment.  The final values are published at the end, once
+    // the publisher thread has stopped, so that exiting can't interrupt it part way through an update
+    if (!metrics_name.empty())
+    {
+        register_metrics();
+        if (!metrics.start(metrics_name, 100))
+        {
+            printf("Can't create metrics segment /dev/shm/%s\n", metrics_name.c_str());
+            exit(1);
+        }
+        reporter.add_summary([]()
+        {
+            metrics.stop();
+            metrics.publish();
+        });
+    }
+
+    // Tell the user which flavor of AF_XDP we ended up with
+    if (config.xdp && !quiet)
+    {
+        printf("AF_XDP on %s: %s mode, %s\n", xdp_iface.c_str(),
+               xdp_program.is_generic() ? "generic" : "native",
+               worker[0]->is_zerocopy() ? "zero-copy" : "copy");
+    }
+
+    // Display a summary when the user hits Ctrl-C
+    signal(SIGINT,  on_signal);
+    signal(SIGTERM, on_signal);
+
+    // Start the thread that reports throughput
+    reporter.start(quiet ? 0 : report_interval_ms, stats);
+
+    // Start the monitor, then the workers
+    if (!monitor_iface.empty()) monitor.start(monitor_dump, quiet ? 0 : RING_MAX_REPORTS);
+    for (auto& p_worker : worker) p_worker->start();
+
+    // The workers run until the program is stopped
+    for (auto& p_worker : worker) p_worker->join();
 }
-//============================================================================
\ No newline at end of file
+//============================================================================
+
+
+
+//============================================================================
+// show_help() - Displays usage information and exits
+//============================================================================
+void show_help()
+{
+    printf("usage: rdma_loop [options] [broadcast_ip] [server_port]\n");
+    printf("  -b, --batch <count>   Receive and echo up to <count> packets per system call\n");
+    printf("  -t, --threads <count> Number of worker threads sharing the server port (or each --port)\n");
+    printf("  -c, --cpus <list>     Comma separated list of CPUs to pin the workers to\n");
+    printf("  -u, --uring           Receive and echo via io_uring instead of recvmmsg/sendmmsg\n");
+    printf("  -x, --xdp <iface>     Receive and echo via AF_XDP on <iface>, one queue per thread\n");
+    printf("  -F, --xdp-frame <n>   AF_XDP UMEM frame size (default 4096, larger needs hugepages)\n");
+    printf("  -T, --target <size>   Write packets into an RDMA target region of <size> bytes (K/M/G)\n");
+    printf("  -f, --target-file <f> Map the target region from file <f> instead of anonymous memory\n");
+    printf("  -B, --target-base <a> RDMA address of the start of the target region or sink file\n");
+    printf("  -P, --pipeline <n>    Receive and echo in separate threads, with a queue of <n> buffers\n");
+    printf("  -Z, --zerocopy <n>    In a pipeline, send packets of <n> bytes or more with MSG_ZEROCOPY\n");
+    printf("  -H, --hugepages       Back the target region and the pipeline buffers with hugepages\n");
+    printf("  -G, --gro             Receive with UDP GRO and echo with UDP GSO\n");
+    printf("  -l, --listen <list>   Serve a comma separated list of [ip:]ports from one event loop\n");
+    printf("  -C, --capture <file>  Capture every packet received into a pcap file\n");
+    printf("  -L, --capture-size <n> Preallocate <n> bytes for the capture file (K/M/G, default 256M)\n");
+    printf("  -y, --busy-poll <us>  Low-latency profile: spin on non-blocking sockets that busy-poll\n");
+    printf("                        the NIC for <us> usec, with pinned workers and locked memory\n");
+    printf("  -R, --fifo <prio>     Run the workers under SCHED_FIFO at priority <prio>\n");
+    printf("  -S, --timestamps      Timestamp packets in the kernel and report per-stage latency.  The\n");
+    printf("                        wire stage needs the NIC clock synchronised to the system's (phc2sys)\n");
+    printf("  -s, --streams         Detect lost, duplicate and reordered packets from each sender\n");
+    printf("  -D, --verify <v>[,<a>] Check payloads against the data_generator pattern whose first\n");
+    printf("                        word is <v> at RDMA address <a> (rdma_send's pattern is 0,0)\n");
+    printf("  -K, --sink <file>     Stream payloads into <file> at their target address (less -B)\n");
+    printf("  -E, --sink-extent <n> Coalesce payloads into extents of up to <n> bytes (K/M/G, default 4M)\n");
+    printf("  -N, --sink-buffers <n> Number of extents staged in memory for the disk (default 2)\n");
+    printf("  -V, --validate        Drop packets whose RDMA header is invalid\n");
+    printf("  -W, --window <a>,<n>  Only accept packets targeting addresses <a> thru <a>+<n>-1\n");
+    printf("  -r, --rate <g>[,<n>]  Pace each worker's echoes to <g> Gbit/s, in bursts of at most <n>\n");
+    printf("                        bytes (K/M/G, default 256K)\n");
+    printf("  -X, --txtime          Have an ETF qdisc space the paced echoes out by SO_TXTIME times\n");
+    printf("  -k, --credits <n>     Grant flow-controlled senders credits for a window of <n> packets\n");
+    printf("  -m, --monitor <iface> Decode and checksum whole RDMA frames arriving on <iface>\n");
+    printf("  -n, --dump <n>        Display the first <n> monitored frames, header field by field\n");
+    printf("  -M, --metrics <name>  Publish counters in shared memory /dev/shm/<name> for rdma_stat\n");
+    printf("  -p, --port <list>     Serve a comma separated list of <iface>:<port>:<dest_ip>[:<dest_port>],\n");
+    printf("                        each with its own sockets and threads, echoing out the same interface\n");
+    printf("  -i, --interval <sec>  Seconds between throughput reports (default 1)\n");
+    printf("  -q, --quiet           No output until the program is stopped\n");
+    printf("  -h, --help            Display this help\n");
+    exit(1);
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_window() - Parses an address window of the form <base>,<size>
+//============================================================================
+bool parse_window(const char* text)
+{
+    char* p;
+    window_base = strtoull(text, &p, 0);
+    if (p == text || *p != ',') return false;
+    return parse_size(p + 1, &window_size) && window_size != 0;
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_rate() - Parses a pacing rate of the form <gbps>[,<burst_size>]
+//============================================================================
+bool parse_rate(const char* text)
+{
+    char* p;
+    config.rate_gbps = strtod(text, &p);
+    if (p == text || config.rate_gbps <= 0) return false;
+    if (*p == 0) return true;
+    if (*p != ',') return false;
+    size_t burst;
+    if (!parse_size(p + 1, &burst) || burst == 0) return false;
+    config.burst_size = burst;
+    return true;
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_pattern() - Parses a data_generator pattern of the form
+//                   <initial_value>[,<base_address>]
+//============================================================================
+bool parse_pattern(const char* text)
+{
+    char* p;
+    pattern_initial = strtoul(text, &p, 0);
+    if (p == text) return false;
+    if (*p == 0) return true;
+    if (*p != ',') return false;
+    pattern_base = strtoull(p + 1, &p, 0);
+    return *p == 0;
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_listen_list() - Parses a comma separated list of [ip:]port addresses
+//============================================================================
+void parse_listen_list(const char* text)
+{
+    string list = text;
+    size_t start = 0;
+
+    config.listen.clear();
+    while (start <= list.size())
+    {
+        size_t comma = list.find(',', start);
+        if (comma == string::npos) comma = list.size();
+        if (comma == start) show_help();
+        config.listen.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_port_list() - Parses a comma separated list of ports to serve, each
+//                     of the form <iface>:<port>:<dest_ip>[:<dest_port>]
+//============================================================================
+bool parse_port_list(const char* text)
+{
+    string list = text;
+    size_t start = 0;
+
+    while (start <= list.size())
+    {
+        size_t comma = list.find(',', start);
+        if (comma == string::npos) comma = list.size();
+
+        // Split the tuple into its fields
+        vector<string> field;
+        string tuple = list.substr(start, comma - start);
+        size_t field_start = 0;
+        while (field_start <= tuple.size())
+        {
+            size_t colon = tuple.find(':', field_start);
+            if (colon == string::npos) colon = tuple.size();
+            field.push_back(tuple.substr(field_start, colon - field_start));
+            field_start = colon + 1;
+        }
+        if (field.size() < 3 || field.size() > 4 || field[0].empty() || field[2].empty()) return false;
+
+        // The destination port is optional
+        port_tuple_t port = {field[0], atoi(field[1].c_str()), field[2], config.dest_port};
+        if (field.size() == 4) port.dest_port = atoi(field[3].c_str());
+        if (port.server_port < 1 || port.server_port > 65535) return false;
+        if (port.dest_port   < 1 || port.dest_port   > 65535) return false;
+
+        port_list.push_back(port);
+        start = comma + 1;
+    }
+
+    return true;
+}
+//============================================================================
+
+
+
+//============================================================================
+// register_metrics() - Registers the counters of every worker with the
+//                      shared-memory metrics segment.  Names and labels
+//                      follow Prometheus conventions
+//============================================================================
+void register_metrics()
+{
+    const char* verdict_metric[] = {"rdma_loop_filter_short_total", "rdma_loop_filter_bad_magic_total",
+                                    "rdma_loop_filter_bad_port_total", "rdma_loop_filter_bad_length_total",
+                                    "rdma_loop_filter_out_of_window_total"};
+
+    for (size_t i=0; i<worker.size(); ++i)
+    {
+        Loopback& w = *worker[i];
+        const string& label = worker_label[i];
+
+        metrics.add_counter("rdma_loop_packets_total",           label, &w.stats.packets);
+        metrics.add_counter("rdma_loop_bytes_total",             label, &w.stats.bytes);
+        metrics.add_counter("rdma_loop_short_packets_total",     label, &w.stats.short_packets);
+        metrics.add_counter("rdma_loop_oversized_packets_total", label, &w.stats.oversized_packets);
+
+        if (config.filter)
+        {
+            metrics.add_counter("rdma_loop_filter_pass_total", label, &w.filter_stats.verdict[FILTER_PASS]);
+            for (int v=FILTER_SHORT; v<FILTER_VERDICTS; ++v)
+            {
+                metrics.add_counter(verdict_metric[v - FILTER_SHORT], label, &w.filter_stats.verdict[v]);
+            }
+        }
+
+        if (config.target)
+        {
+            metrics.add_counter("rdma_loop_target_bad_magic_total",     label, &w.target_stats.bad_magic);
+            metrics.add_counter("rdma_loop_target_short_total",         label, &w.target_stats.short_packets);
+            metrics.add_counter("rdma_loop_target_out_of_bounds_total", label, &w.target_stats.out_of_bounds);
+        }
+
+        if (config.pipeline_depth)
+        {
+            metrics.add_counter("rdma_loop_pipeline_depth",           label, &w.pipeline_stats.depth_now,
+                                METRIC_GAUGE);
+            metrics.add_counter("rdma_loop_pipeline_depth_max",       label, &w.pipeline_stats.depth_max,
+                                METRIC_GAUGE);
+            metrics.add_counter("rdma_loop_pipeline_ring_full_total", label, &w.pipeline_stats.ring_full);
+            metrics.add_counter("rdma_loop_zerocopy_sent_total",      label, &w.pipeline_stats.zerocopy_sent);
+            metrics.add_counter("rdma_loop_zerocopy_copied_total",    label, &w.pipeline_stats.zerocopy_copied);
+        }
+
+        if (config.track_streams)
+        {
+            metrics.add_counter("rdma_loop_stream_packets_total",    label, &w.stream_stats.packets);
+            metrics.add_counter("rdma_loop_stream_gaps_total",       label, &w.stream_stats.gaps);
+            metrics.add_counter("rdma_loop_stream_reordered_total",  label, &w.stream_stats.reordered);
+            metrics.add_counter("rdma_loop_stream_duplicates_total", label, &w.stream_stats.duplicates);
+            metrics.add_counter("rdma_loop_stream_reorder_depth_max", label, &w.stream_stats.max_reorder_depth,
+                                METRIC_GAUGE);
+        }
+
+        if (config.verifier)
+        {
+            metrics.add_counter("rdma_loop_verify_packets_total", label, &w.verify_stats.packets);
+            metrics.add_counter("rdma_loop_verify_bytes_total",   label, &w.verify_stats.bytes);
+            metrics.add_counter("rdma_loop_verify_bad_total",     label, &w.verify_stats.bad_packets);
+        }
+
+        if (!config.sink.empty())
+        {
+            metrics.add_counter("rdma_loop_sink_staged_bytes_total",  label, &w.sink.stats.staged_bytes);
+            metrics.add_counter("rdma_loop_sink_written_bytes_total", label, &w.sink.stats.written_bytes);
+            metrics.add_counter("rdma_loop_sink_extents_total",       label, &w.sink.stats.extents);
+            metrics.add_counter("rdma_loop_sink_dropped_total",       label, &w.sink.stats.dropped);
+            metrics.add_counter("rdma_loop_sink_write_errors_total",  label, &w.sink.stats.write_errors);
+            metrics.add_counter("rdma_loop_sink_staging_in_use",      label, &w.sink.stats.occupancy_now,
+                                METRIC_GAUGE);
+        }
+
+        if (config.rate_gbps > 0)
+        {
+            const pacer_stats_t& pacing = w.get_pacer().stats;
+            metrics.add_counter("rdma_loop_pacing_bytes_total",  label, &pacing.bytes);
+            metrics.add_counter("rdma_loop_pacing_waits_total",  label, &pacing.waits);
+            metrics.add_counter("rdma_loop_pacing_missed_total", label, &pacing.missed);
+            metrics.add_histogram("rdma_loop_pacing_jitter_ns",  label, &pacing.jitter);
+        }
+
+        if (config.credit_window)
+        {
+            metrics.add_counter("rdma_loop_credit_packets_total", label, &w.credit_stats.packets);
+            metrics.add_counter("rdma_loop_credits_sent_total",   label, &w.credit_stats.credits);
+            metrics.add_counter("rdma_loop_credit_senders",       label, &w.credit_stats.senders, METRIC_GAUGE);
+        }
+
+        if (config.timestamps)
+        {
+            metrics.add_histogram("rdma_loop_wire_to_socket_ns", label, &w.latency_stats.wire);
+            metrics.add_histogram("rdma_loop_socket_to_app_ns",  label, &w.latency_stats.socket);
+            metrics.add_histogram("rdma_loop_app_to_sent_ns",    label, &w.latency_stats.send);
+        }
+    }
+
+    // The monitor is one per process, and is labelled with the interface it watches
+    if (!monitor_iface.empty())
+    {
+        string label = "iface=\"" + monitor_iface + "\"";
+        metrics.add_counter("rdma_loop_monitor_frames_total",       label, &monitor.stats.frames);
+        metrics.add_counter("rdma_loop_monitor_bytes_total",        label, &monitor.stats.bytes);
+        metrics.add_counter("rdma_loop_monitor_drops_total",        label, &monitor.stats.kernel_drops);
+        metrics.add_counter("rdma_loop_monitor_not_rdma_total",     label, &monitor.stats.not_rdma);
+        metrics.add_counter("rdma_loop_monitor_bad_ip_csum_total",  label, &monitor.stats.bad_ip_csum);
+        metrics.add_counter("rdma_loop_monitor_bad_udp_csum_total", label, &monitor.stats.bad_udp_csum);
+    }
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_command_line() - Parses the command line options
+//============================================================================
+void parse_command_line(int argc, char** argv)
+{
+    static const option long_options[] =
+    {
+        {"batch",       required_argument, NULL, 'b'},
+        {"threads",     required_argument, NULL, 't'},
+        {"cpus",        required_argument, NULL, 'c'},
+        {"uring",       no_argument,       NULL, 'u'},
+        {"xdp",         required_argument, NULL, 'x'},
+        {"xdp-frame",   required_argument, NULL, 'F'},
+        {"target",      required_argument, NULL, 'T'},
+        {"target-file", required_argument, NULL, 'f'},
+        {"target-base", required_argument, NULL, 'B'},
+        {"pipeline",    required_argument, NULL, 'P'},
+        {"zerocopy",    required_argument, NULL, 'Z'},
+        {"hugepages",   no_argument,       NULL, 'H'},
+        {"gro",         no_argument,       NULL, 'G'},
+        {"listen",      required_argument, NULL, 'l'},
+        {"capture",     required_argument, NULL, 'C'},
+        {"capture-size",required_argument, NULL, 'L'},
+        {"busy-poll",   required_argument, NULL, 'y'},
+        {"fifo",        required_argument, NULL, 'R'},
+        {"timestamps",  no_argument,       NULL, 'S'},
+        {"streams",     no_argument,       NULL, 's'},
+        {"verify",      required_argument, NULL, 'D'},
+        {"sink",        required_argument, NULL, 'K'},
+        {"sink-extent", required_argument, NULL, 'E'},
+        {"sink-buffers",required_argument, NULL, 'N'},
+        {"validate",    no_argument,       NULL, 'V'},
+        {"window",      required_argument, NULL, 'W'},
+        {"rate",        required_argument, NULL, 'r'},
+        {"txtime",      no_argument,       NULL, 'X'},
+        {"credits",     required_argument, NULL, 'k'},
+        {"monitor",     required_argument, NULL, 'm'},
+        {"dump",        required_argument, NULL, 'n'},
+        {"metrics",     required_argument, NULL, 'M'},
+        {"port",        required_argument, NULL, 'p'},
+        {"interval",    required_argument, NULL, 'i'},
+        {"quiet",       no_argument,       NULL, 'q'},
+        {"help",        no_argument,       NULL, 'h'},
+        {NULL,          0,                 NULL,  0 }
+    };
+
+    // If the user gives us a CPU list but no thread count, it's one thread per CPU
+    bool have_thread_count = false;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "b:t:c:ux:F:T:f:B:P:Z:HGl:C:L:y:R:SsD:K:E:N:VW:r:Xk:m:n:M:p:i:qh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'b':
+                config.batch_size = atoi(optarg);
+                break;
+            case 't':
+                thread_count = atoi(optarg);
+                have_thread_count = true;
+                break;
+            case 'c':
+                if (!parse_int_list(optarg, &cpu_list)) show_help();
+                break;
+            case 'u':
+                config.uring = true;
+                break;
+            case 'x':
+                xdp_iface = optarg;
+                break;
+            case 'F':
+                config.xdp_frame_size = atoi(optarg);
+                break;
+            case 'T':
+                if (!parse_size(optarg, &target_size)) show_help();
+                break;
+            case 'f':
+                target_file = optarg;
+                break;
+            case 'B':
+                target_base = strtoull(optarg, NULL, 0);
+                break;
+            case 'P':
+                config.pipeline_depth = atoi(optarg);
+                break;
+            case 'Z':
+                config.zerocopy_threshold = atoi(optarg);
+                break;
+            case 'H':
+                config.hugepages = true;
+                break;
+            case 'G':
+                config.gro = true;
+                break;
+            case 'l':
+                parse_listen_list(optarg);
+                break;
+            case 'C':
+                config.capture = optarg;
+                break;
+            case 'L':
+                if (!parse_size(optarg, &config.capture_size)) show_help();
+                break;
+            case 'y':
+                config.busy_poll_us = atoi(optarg);
+                break;
+            case 'R':
+                config.fifo_priority = atoi(optarg);
+                break;
+            case 'S':
+                config.timestamps = true;
+                break;
+            case 's':
+                config.track_streams = true;
+                break;
+            case 'D':
+                if (!parse_pattern(optarg)) show_help();
+                verify = true;
+                break;
+            case 'K':
+                config.sink = optarg;
+                break;
+            case 'E':
+                if (!parse_size(optarg, &config.sink_extent)) show_help();
+                break;
+            case 'N':
+                config.sink_buffers = atoi(optarg);
+                break;
+            case 'V':
+                validate = true;
+                break;
+            case 'W':
+                if (!parse_window(optarg)) show_help();
+                validate = true;
+                break;
+            case 'r':
+                if (!parse_rate(optarg)) show_help();
+                break;
+            case 'X':
+                config.txtime = true;
+                break;
+            case 'm':
+                monitor_iface = optarg;
+                break;
+            case 'n':
+                monitor_dump = atoi(optarg);
+                break;
+            case 'k':
+                config.credit_window = atoi(optarg);
+                if (config.credit_window < 1 || config.credit_window > RDMA_FC_WINDOW) show_help();
+                break;
+            case 'M':
+                metrics_name = optarg;
+                break;
+            case 'p':
+                if (!parse_port_list(optarg)) show_help();
+                break;
+            case 'i':
+                report_interval_ms = (int)(atof(optarg) * 1000);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                show_help();
+        }
+    }
+
+    // One worker per CPU unless told otherwise
+    if (!have_thread_count && !cpu_list.empty()) thread_count = cpu_list.size();
+
+    // Batch size has to be sane
+    if (config.batch_size < 1 || config.batch_size > 1024)
+    {
+        printf("Batch size must be between 1 and 1024\n");
+        exit(1);
+    }
+
+    // AF_XDP frames must be a power of two, and big enough for a packet
+    int frame_size = config.xdp_frame_size;
+    if (frame_size < 2048 || (frame_size & (frame_size - 1)))
+    {
+        printf("AF_XDP frame size must be a power of 2, at least 2048\n");
+        exit(1);
+    }
+
+    // The pipeline needs at least enough buffers for two batches, and works only with UDP sockets
+    if (config.pipeline_depth)
+    {
+        if (config.pipeline_depth < 2 * config.batch_size)
+        {
+            printf("Pipeline depth must be at least twice the batch size\n");
+            exit(1);
+        }
+        if (config.uring || !xdp_iface.empty() || !config.listen.empty())
+        {
+            printf("Pipeline mode can't be combined with io_uring, AF_XDP or --listen\n");
+            exit(1);
+        }
+    }
+
+    // Zero-copy sends need somewhere to park buffers until the kernel is done with them
+    if (config.zerocopy_threshold && !config.pipeline_depth)
+    {
+        printf("--zerocopy requires --pipeline\n");
+        exit(1);
+    }
+
+    // GRO and GSO are features of UDP sockets, and the pipeline doesn't split coalesced datagrams
+    if (config.gro && (config.uring || !xdp_iface.empty() || config.pipeline_depth))
+    {
+        printf("--gro can't be combined with io_uring, AF_XDP or --pipeline\n");
+        exit(1);
+    }
+
+    // The event loop serves UDP sockets only
+    if (!config.listen.empty() && (config.uring || !xdp_iface.empty()))
+    {
+        printf("--listen can't be combined with io_uring or AF_XDP\n");
+        exit(1);
+    }
+
+    // Timestamps come from the kernel's socket layer, which io_uring's buffers and AF_XDP bypass
+    if (config.timestamps && (config.uring || !xdp_iface.empty()))
+    {
+        printf("--timestamps can't be combined with io_uring or AF_XDP\n");
+        exit(1);
+    }
+
+    // Busy-polling is a feature of UDP sockets.  The latency it achieves is measured with timestamps
+    if (config.busy_poll_us)
+    {
+        if (config.uring || !xdp_iface.empty())
+        {
+            printf("--busy-poll can't be combined with io_uring or AF_XDP\n");
+            exit(1);
+        }
+        config.timestamps = true;
+    }
+
+    // The disk sink needs room to stage at least one whole payload, and a buffer for the disk to drain
+    if (!config.sink.empty())
+    {
+        if (config.sink_extent < RDMA_MAX_PAYLOAD || config.sink_extent > (1ULL << 31) || config.sink_buffers < 2)
+        {
+            printf("Sink extents must be between 8K and 2G, with at least 2 buffers\n");
+            exit(1);
+        }
+        config.sink_base = target_base;
+    }
+
+    // Each port's sockets are tied to its interface, which AF_XDP and the event loop have their own ways
+    // of choosing.  The ports replace the broadcast address and server port on the command line
+    if (!port_list.empty())
+    {
+        if (!xdp_iface.empty() || !config.listen.empty())
+        {
+            printf("--port can't be combined with AF_XDP or --listen\n");
+            exit(1);
+        }
+        if (optind < argc)
+        {
+            printf("With --port, there's no broadcast_ip or server_port on the command line\n");
+            exit(1);
+        }
+    }
+
+    // Pacing lives in the UDP socket send path, which io_uring and AF_XDP bypass
+    if (config.rate_gbps > 0 && (config.uring || !xdp_iface.empty()))
+    {
+        printf("--rate can't be combined with io_uring or AF_XDP\n");
+        exit(1);
+    }
+    if (config.txtime && config.rate_gbps <= 0)
+    {
+        printf("--txtime requires --rate\n");
+        exit(1);
+    }
+
+    // Credits go back on the socket each batch arrives on, which only the plain receive loop has
+    if (config.credit_window && (config.uring || !xdp_iface.empty() || !config.listen.empty()
+                                 || config.pipeline_depth))
+    {
+        printf("--credits can't be combined with io_uring, AF_XDP, --listen or --pipeline\n");
+        exit(1);
+    }
+
+    // The XDP program takes RDMA packets before AF_PACKET gets to see them
+    if (!monitor_iface.empty() && !xdp_iface.empty())
+    {
+        printf("--monitor can't be combined with AF_XDP\n");
+        exit(1);
+    }
+    if (monitor_dump && monitor_iface.empty())
+    {
+        printf("--dump requires --monitor\n");
+        exit(1);
+    }
+
+    // SCHED_FIFO priorities run from 1 to 99, and 0 leaves the workers under the normal scheduler
+    if (config.fifo_priority < 0 || config.fifo_priority > 99)
+    {
+        printf("SCHED_FIFO priority must be 0 (off) or 1 to 99\n");
+        exit(1);
+    }
+
+    // The thread count has to be sane
+    if (thread_count < 1)
+    {
+        printf("Thread count must be at least 1\n");
+        exit(1);
+    }
+
+    // A report interval of zero would mean "report continuously"
+    if (report_interval_ms < 1)
+    {
+        printf("Report interval must be positive\n");
+        exit(1);
+    }
+
+    // If there's an IP address on the command line, use it.
+    if (optind < argc) config.dest_ip = argv[optind++];
+
+    // If there's a UDP port on the command line, use it
+    if (optind < argc) config.server_port = atoi(argv[optind++]);
+}
+//============================================================================
+
+
+
+//============================================================================
+// on_signal() - Called on Ctrl-C.  The reporter displays a summary and
+//               ends the program
+//============================================================================
+void on_signal(int)
+{
+    reporter.request_stop();
+}
+//============================================================================
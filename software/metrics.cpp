@@ -0,0 +1,349 @@
+//==========================================================================================================
+// metrics.cpp - Implements a shared-memory segment that publishes counters and histograms
+//==========================================================================================================
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "metrics.h"
+using namespace std;
+
+
+//==========================================================================================================
+// realtime_ns() - Returns CLOCK_REALTIME in nanoseconds
+//==========================================================================================================
+static uint64_t realtime_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// copy_name() - Copies a string into a fixed-size, nul-terminated field, truncating it if need be
+//==========================================================================================================
+static void copy_name(char* field, size_t size, const string& text)
+{
+    strncpy(field, text.c_str(), size - 1);
+    field[size - 1] = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_counter() - Registers a counter or gauge to be published
+//
+// Passed:  name   = the metric name, e.g. "rdma_loop_packets_total"
+//          labels = Prometheus-style labels, e.g. "worker=\"0\"", or empty
+//          source = the counter.  It's only ever read
+//          type   = METRIC_COUNTER or METRIC_GAUGE
+//==========================================================================================================
+void MetricsSegment::add_counter(string name, string labels, const atomic<uint64_t>* source, metric_type_t type)
+{
+    m_counter.push_back({name, labels, source, type});
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_histogram() - Registers a histogram to be published
+//==========================================================================================================
+void MetricsSegment::add_histogram(string name, string labels, const LatencyHistogram* source)
+{
+    m_histogram.push_back({name, labels, source});
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// start() - Creates the segment, fills in everything that never changes, and starts the publisher
+//
+// Passed:  name        = the name of the segment.  It's created as /dev/shm/<name>
+//          interval_ms = milliseconds between updates
+//
+// Returns: true on success
+//==========================================================================================================
+bool MetricsSegment::start(string name, int interval_ms)
+{
+    // Work out how big the segment needs to be
+    m_size = sizeof(metrics_header_t) + m_counter.size() * sizeof(metric_entry_t)
+           + m_histogram.size() * sizeof(histogram_entry_t);
+
+    // Create it, replacing any segment left behind by an earlier run
+    int fd = shm_open(("/" + name).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    if (ftruncate(fd, m_size) < 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Map it.  The mapping stays valid after the descriptor is closed
+    void* map = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    // Find the entries
+    m_header = (metrics_header_t*)map;
+    m_metric = (metric_entry_t*)(m_header + 1);
+    m_hist   = (histogram_entry_t*)(m_metric + m_counter.size());
+
+    // Fill in the names.  The segment starts out zeroed, so every value and the sequence start at 0
+    for (size_t i=0; i<m_counter.size(); ++i)
+    {
+        copy_name(m_metric[i].name,   METRICS_NAME_LEN,  m_counter[i].name);
+        copy_name(m_metric[i].labels, METRICS_LABEL_LEN, m_counter[i].labels);
+        m_metric[i].type = m_counter[i].type;
+    }
+    for (size_t i=0; i<m_histogram.size(); ++i)
+    {
+        copy_name(m_hist[i].name,   METRICS_NAME_LEN,  m_histogram[i].name);
+        copy_name(m_hist[i].labels, METRICS_LABEL_LEN, m_histogram[i].labels);
+    }
+
+    // Fill in the header.  The magic number goes last, so a reader never sees a half-built segment
+    m_header->version         = METRICS_VERSION;
+    m_header->metric_count    = m_counter.size();
+    m_header->histogram_count = m_histogram.size();
+    m_header->pid             = getpid();
+    m_header->start_ns        = realtime_ns();
+    atomic_thread_fence(memory_order_release);
+    memcpy(m_header->magic, METRICS_MAGIC, sizeof METRICS_MAGIC);
+
+    // Publish the initial values, and start the thread that keeps them up to date
+    publish();
+    m_interval_ms = interval_ms;
+    m_thread = thread(&MetricsSegment::run, this);
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// publish() - Copies the current value of every metric into the segment under the seqlock
+//==========================================================================================================
+void MetricsSegment::publish()
+{
+    if (m_header == NULL) return;
+    lock_guard<mutex> lock(m_publish_mutex);
+
+    // An odd sequence number tells readers that the values are changing
+    uint64_t sequence = m_header->sequence.load(memory_order_relaxed);
+    m_header->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (size_t i=0; i<m_counter.size(); ++i)
+    {
+        m_metric[i].value.store(m_counter[i].source->load(memory_order_relaxed), memory_order_relaxed);
+    }
+
+    for (size_t i=0; i<m_histogram.size(); ++i)
+    {
+        const LatencyHistogram& source = *m_histogram[i].source;
+        for (int b=0; b<HIST_BUCKETS; ++b)
+        {
+            m_hist[i].bucket[b].store(source.bucket_count(b), memory_order_relaxed);
+        }
+        m_hist[i].max.store(source.max(), memory_order_relaxed);
+    }
+
+    m_header->publish_ns.store(realtime_ns(), memory_order_relaxed);
+    m_header->publish_count.store(m_header->publish_count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+
+    // An even sequence number tells readers that the values are consistent again
+    m_header->sequence.store(sequence + 2, memory_order_release);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// stop() - Stops the publisher thread.  Once this returns, nothing else will be publishing, so a final
+//          publish() can't be cut short by the program exiting while the thread is in the middle of one
+//==========================================================================================================
+void MetricsSegment::stop()
+{
+    m_stopped = true;
+    if (m_thread.joinable()) m_thread.join();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run() - Publishes the metrics every m_interval_ms milliseconds until told to stop
+//==========================================================================================================
+void MetricsSegment::run()
+{
+    while (true)
+    {
+        usleep(m_interval_ms * 1000);
+        if (m_stopped) break;
+        publish();
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// open() - Maps a metrics segment read-only and checks that we understand its layout
+//
+// Passed:  name  = the name of the segment, as passed to MetricsSegment::start()
+//          error = where to say what went wrong
+//
+// Returns: true on success
+//==========================================================================================================
+bool MetricsReader::open(string name, string* error)
+{
+    // Open the segment and find out how big it is
+    struct stat sb;
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0 || fstat(fd, &sb) < 0)
+    {
+        *error = "can't open /dev/shm/" + name;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    // It has to at least hold a header
+    if (sb.st_size < (off_t)sizeof(metrics_header_t))
+    {
+        *error = "/dev/shm/" + name + " is too short to be a metrics segment";
+        ::close(fd);
+        return false;
+    }
+
+    // Map it
+    void* map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        *error = "can't map /dev/shm/" + name;
+        return false;
+    }
+    m_header = (const metrics_header_t*)map;
+    m_size   = sb.st_size;
+
+    // Make sure it's a metrics segment with a layout we understand
+    if (memcmp(m_header->magic, METRICS_MAGIC, sizeof METRICS_MAGIC) != 0)
+    {
+        *error = "/dev/shm/" + name + " isn't a metrics segment";
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (m_header->version != METRICS_VERSION)
+    {
+        *error = "/dev/shm/" + name + " has layout version " + to_string(m_header->version) +
+                 ", expected " + to_string(METRICS_VERSION);
+        return false;
+    }
+
+    // And that it's as big as the header says
+    size_t expected = sizeof(metrics_header_t) + m_header->metric_count * sizeof(metric_entry_t)
+                    + m_header->histogram_count * sizeof(histogram_entry_t);
+    if (m_size < expected)
+    {
+        *error = "/dev/shm/" + name + " is truncated";
+        return false;
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Unmaps the segment
+//==========================================================================================================
+void MetricsReader::close()
+{
+    if (m_header) munmap((void*)m_header, m_size);
+    m_header = NULL;
+    m_size   = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// snapshot() - Takes a consistent copy of every metric in the segment
+//
+// Passed:  result = where to store the copy
+//
+// Returns: true if the copy is consistent.  false if the sequence number stayed odd because the
+//          publisher died in the middle of an update, in which case we copy the values as they are
+//==========================================================================================================
+bool MetricsReader::snapshot(metrics_snapshot_t* result)
+{
+    const metric_entry_t*    metric = (const metric_entry_t*)(m_header + 1);
+    const histogram_entry_t* hist   = (const histogram_entry_t*)(metric + m_header->metric_count);
+
+    // The names never change, so they don't need the seqlock
+    result->pid      = m_header->pid;
+    result->start_ns = m_header->start_ns;
+    result->metric.resize(m_header->metric_count);
+    result->histogram.resize(m_header->histogram_count);
+    for (uint32_t i=0; i<m_header->metric_count; ++i)
+    {
+        result->metric[i].name   = metric[i].name;
+        result->metric[i].labels = metric[i].labels;
+        result->metric[i].type   = metric[i].type;
+    }
+    for (uint32_t i=0; i<m_header->histogram_count; ++i)
+    {
+        result->histogram[i].name   = hist[i].name;
+        result->histogram[i].labels = hist[i].labels;
+        result->histogram[i].bucket.resize(HIST_BUCKETS);
+    }
+
+    // Copy the values until we get a copy that the publisher didn't change while we were copying it
+    for (int retry = 0; ; ++retry)
+    {
+        uint64_t before = m_header->sequence.load(memory_order_acquire);
+
+        // An update takes microseconds.  If one never finishes, or the publisher is gone, it died
+        // part way through and the sequence number will stay odd for good
+        bool busy  = before & 1;
+        bool stuck = busy && (retry >= METRICS_MAX_RETRIES || (kill(m_header->pid, 0) < 0 && errno == ESRCH));
+        if (busy && !stuck)
+        {
+            sched_yield();
+            continue;
+        }
+
+        for (uint32_t i=0; i<m_header->metric_count; ++i)
+        {
+            result->metric[i].value = metric[i].value.load(memory_order_relaxed);
+        }
+        for (uint32_t i=0; i<m_header->histogram_count; ++i)
+        {
+            for (int b=0; b<HIST_BUCKETS; ++b)
+            {
+                result->histogram[i].bucket[b] = hist[i].bucket[b].load(memory_order_relaxed);
+            }
+            result->histogram[i].max = hist[i].max.load(memory_order_relaxed);
+        }
+        result->publish_ns    = m_header->publish_ns.load(memory_order_relaxed);
+        result->publish_count = m_header->publish_count.load(memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (stuck) return false;
+        if (m_header->sequence.load(memory_order_relaxed) == before) return true;
+    }
+}
+//==========================================================================================================
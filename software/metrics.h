@@ -0,0 +1,191 @@
+//==========================================================================================================
+// metrics.h - Defines a shared-memory segment that publishes counters and histograms to other processes
+//
+// The segment lives in /dev/shm.  A publisher thread periodically copies the program's counters into it
+// under a seqlock: it makes the sequence number odd, writes the values, then makes it even again.  A
+// reader copies the values and retries if the sequence number was odd or changed while it was copying.
+// The threads that update the counters are never involved, so monitoring adds nothing to the datapath,
+// and readers never make a system call or take a lock.  The segment is left behind when the program
+// ends so that the last values can still be read afterwards.
+//
+// Layout: a metrics_header_t, then metric_count metric_entry_t, then histogram_count histogram_entry_t.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+
+// Identifies a metrics segment, and the version of its layout
+const char     METRICS_MAGIC[8] = {'R', 'D', 'M', 'A', 'S', 'T', 'A', 'T'};
+const uint32_t METRICS_VERSION  = 1;
+
+// How many times a reader waits for an update in progress to finish before deciding that the publisher
+// died in the middle of it
+const int METRICS_MAX_RETRIES = 10000;
+
+// The longest metric name and label string, including the terminating nul
+const int METRICS_NAME_LEN  = 64;
+const int METRICS_LABEL_LEN = 96;
+
+// The kinds of metric
+enum metric_type_t : uint32_t {METRIC_COUNTER, METRIC_GAUGE};
+
+//==========================================================================================================
+// metrics_header_t - The start of a metrics segment
+//==========================================================================================================
+struct metrics_header_t
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    metric_count;
+    uint32_t    histogram_count;
+    int32_t     pid;
+
+    // When the publishing program started, in CLOCK_REALTIME nanoseconds
+    uint64_t    start_ns;
+
+    // Odd while the publisher is writing.  Everything below here is protected by it
+    alignas(64) std::atomic<uint64_t> sequence;
+
+    // When the values were last published, in CLOCK_REALTIME nanoseconds, and how many times
+    std::atomic<uint64_t> publish_ns;
+    std::atomic<uint64_t> publish_count;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// metric_entry_t - One counter or gauge.  "labels" is in Prometheus form, e.g. worker="0"
+//==========================================================================================================
+struct metric_entry_t
+{
+    char        name[METRICS_NAME_LEN];
+    char        labels[METRICS_LABEL_LEN];
+    metric_type_t type;
+    std::atomic<uint64_t> value;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// histogram_entry_t - One LatencyHistogram
+//==========================================================================================================
+struct histogram_entry_t
+{
+    char        name[METRICS_NAME_LEN];
+    char        labels[METRICS_LABEL_LEN];
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> bucket[HIST_BUCKETS];
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// MetricsSegment - The publishing side of a metrics segment
+//==========================================================================================================
+class MetricsSegment
+{
+public:
+
+    // Constructor, marks the segment as closed
+    MetricsSegment() {m_header = NULL; m_size = 0; m_interval_ms = 0;}
+
+    // Destructor - stops the publisher thread
+    ~MetricsSegment() {stop();}
+
+    // Registers a counter (or gauge) to be published.  Call these before start()
+    void    add_counter(std::string name, std::string labels, const std::atomic<uint64_t>* source,
+                        metric_type_t type = METRIC_COUNTER);
+
+    // Registers a histogram to be published.  Call this before start()
+    void    add_histogram(std::string name, std::string labels, const LatencyHistogram* source);
+
+    // Creates /dev/shm/<name> and starts the thread that publishes to it every interval_ms
+    bool    start(std::string name, int interval_ms);
+
+    // Copies the current value of every metric into the segment
+    void    publish();
+
+    // Stops the publisher thread and waits for it to finish.  The segment stays mapped, so publish()
+    // can still be called afterwards
+    void    stop();
+
+protected:
+
+    // This is the body of the publisher thread
+    void    run();
+
+    // The counters and histograms we publish
+    struct counter_t   {std::string name, labels; const std::atomic<uint64_t>* source; metric_type_t type;};
+    struct histogram_t {std::string name, labels; const LatencyHistogram* source;};
+    std::vector<counter_t>   m_counter;
+    std::vector<histogram_t> m_histogram;
+
+    // The mapped segment, and where its entries are
+    metrics_header_t*   m_header;
+    metric_entry_t*     m_metric;
+    histogram_entry_t*  m_hist;
+    size_t              m_size;
+
+    // Only one thread at a time may publish
+    std::mutex          m_publish_mutex;
+
+    // The publisher thread, how often it publishes, and the flag that tells it to stop
+    std::thread         m_thread;
+    int                 m_interval_ms;
+    std::atomic<bool>   m_stopped{false};
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// metrics_snapshot_t - A consistent copy of everything in a metrics segment
+//==========================================================================================================
+struct metrics_snapshot_t
+{
+    int32_t     pid;
+    uint64_t    start_ns;
+    uint64_t    publish_ns;
+    uint64_t    publish_count;
+
+    struct metric_t    {std::string name, labels; metric_type_t type; uint64_t value;};
+    struct histogram_t {std::string name, labels; uint64_t max; std::vector<uint64_t> bucket;};
+    std::vector<metric_t>    metric;
+    std::vector<histogram_t> histogram;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// MetricsReader - The reading side of a metrics segment
+//==========================================================================================================
+class MetricsReader
+{
+public:
+
+    // Constructor, marks the segment as closed
+    MetricsReader() {m_header = NULL; m_size = 0;}
+
+    // Destructor - unmaps the segment
+    ~MetricsReader() {close();}
+
+    // Maps /dev/shm/<name> read-only and checks its header.  On failure, "error" says why
+    bool    open(std::string name, std::string* error);
+
+    // Unmaps the segment
+    void    close();
+
+    // Takes a consistent copy of every metric in the segment.  Returns false if the publisher died in the
+    // middle of an update, in which case the copy may be inconsistent
+    bool    snapshot(metrics_snapshot_t* result);
+
+protected:
+
+    const metrics_header_t* m_header;
+    size_t                  m_size;
+};
+//==========================================================================================================
@@ -5,8 +5,14 @@
 #include <string.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
+#include <linux/if_packet.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
 #include <string>
 #include "netutil.h"
+#include "udpsock.h"
 using namespace std;
 
 
@@ -151,72 +157,32 @@ std::string NetUtil::ip_to_string(sockaddr_storage& ss)
 //==========================================================================================================
 int NetUtil::wait_for_data(int timeout_ms, int fd1, int fd2, int fd3, int fd4)
 {
-    int    i, fd;
-    fd_set rfds;
-    timeval timeout;
-
     // Put them into an array
     int fd_list[] = {fd1, fd2, fd3, fd4};
 
     // Find out how many items are in the array
     const int ARRAY_COUNT = sizeof(fd_list) / sizeof(fd_list[0]);
 
-    // We don't know what the highest file descriptor is yet
-    int highest_fd = -1;
-
-    // Clear our file descriptor set
-    FD_ZERO(&rfds);
-
-    // Loop through each file descriptor that was provided by the caller...
-    for (i=0; i<ARRAY_COUNT; ++i)
+    // Build a pollfd for each descriptor.  poll() ignores entries with a negative descriptor, and unlike
+    // select(), it works with descriptors of any value
+    pollfd pfd[ARRAY_COUNT];
+    for (int i=0; i<ARRAY_COUNT; ++i)
     {
-        // Fetch this file descriptor
-        fd = fd_list[i];
-
-        // Skip any invalid file descriptor
-        if (fd < 0) continue;   
-
-        // Include this file descriptor in our fd_set
-        FD_SET(fd, &rfds);
-
-        // Keep track of the highest file descriptor we have
-        if (fd > highest_fd) highest_fd = fd;
-    }
-
-    // Assume for the moment that we are going to wait forever
-    timeval* p_timeout = NULL;
-
-    // If the caller wants us to wait for a finite amount of time...
-    if (timeout_ms != -1)
-    {
-        // Convert milliseconds to microseconds
-        int usecs = timeout_ms * 1000;
-
-        // Determine the timeout in seconds and microseconds
-        timeout.tv_sec  = usecs / 1000000;
-        timeout.tv_usec = usecs % 1000000;
-
-        // Point to the timeout structure we just initialized
-        p_timeout = &timeout;
+        pfd[i].fd      = fd_list[i];
+        pfd[i].events  = POLLIN;
+        pfd[i].revents = 0;
     }
 
     // Wait for one of the descriptors to become available for reading
-    if (select(highest_fd+1, &rfds, NULL, NULL, p_timeout) < 1) return 0;
+    if (poll(pfd, ARRAY_COUNT, timeout_ms) < 1) return 0;
 
     // This is going to be a bitmap of which descriptors are readable
     int result = 0;
 
-    // Loop through each possible descriptor...
-    for (i=0; i<ARRAY_COUNT; ++i)
+    // If a descriptor is readable, set the appropriate bit in the result
+    for (int i=0; i<ARRAY_COUNT; ++i)
     {
-        // Fetch this file descriptor
-        fd = fd_list[i];
-
-        // Skip any invalid file descriptor
-        if (fd < 0) continue;   
-
-        // If this descriptor is readable, set the appropriate bit in the result
-        if (FD_ISSET(fd, &rfds)) result |= (1 << i);
+        if (pfd[i].revents & POLLIN) result |= (1 << i);
     }
 
     // Hand the caller a bitmap of which of his descriptors are readable
@@ -324,6 +290,53 @@ bool NetUtil::get_local_ip(string iface, ipv6_t* dest)
 //==========================================================================================================
 
 
+
+//==========================================================================================================
+// get_local_mac() - Fetches the MAC address of a local network interface
+//
+// Passed:  iface  = Name of the interface ("eth0", "eth1", etc)
+//          mac    = Pointer to the 6-byte buffer where the MAC address should end up
+//
+// Returns: True if a MAC address was found, else false
+//==========================================================================================================
+bool NetUtil::get_local_mac(string iface, unsigned char* mac)
+{
+    struct ifaddrs *ifaddr, *ifa;
+
+    // We haven't found a MAC address yet
+    bool is_found = false;
+
+    // Fetch the list of network interfaces
+    if (getifaddrs(&ifaddr) < 0) return false;
+
+    // Walk through the linked list of interface information entries
+    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next)
+    {
+        // If this entry is for a different interface, skip it
+        if (ifa->ifa_name != iface) continue;
+
+        // The link-layer address is in the AF_PACKET entry
+        if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_PACKET) continue;
+
+        // Copy the MAC address into the caller's buffer
+        sockaddr_ll* ll = (sockaddr_ll*)ifa->ifa_addr;
+        if (ll->sll_halen != 6) continue;
+        memcpy(mac, ll->sll_addr, 6);
+
+        // And break out of the loop
+        is_found = true;
+        break;
+    }
+
+    // Free the linked-list that was allocated by getifaddrs()
+    freeifaddrs(ifaddr);
+
+    // Tell the caller whether or not this worked
+    return is_found;
+}
+//==========================================================================================================
+
+
 //==========================================================================================================
 // text() - Returns the ASCII version of an IPv4 address
 //==========================================================================================================
@@ -426,3 +439,194 @@ void addrinfo_t::from_ai(addrinfo& ai)
     protocol = ai.ai_protocol;
 }
 //==========================================================================================================
+
+
+
+//==========================================================================================================
+// create() - Creates the epoll instance
+//
+// Passed:  max_events = the maximum number of events fetched by a single epoll_wait()
+//
+// Returns: true on success
+//==========================================================================================================
+bool EventLoop::create(int max_events)
+{
+    // If we're already open, close everything
+    close();
+
+    // Create the epoll instance
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0) return false;
+
+    // Make room for the events that epoll_wait() hands us
+    m_event.resize(max_events);
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Closes the epoll instance and any timers we created
+//==========================================================================================================
+void EventLoop::close()
+{
+    for (auto& p_source : m_source)
+    {
+        if (p_source->is_timer) ::close(p_source->fd);
+    }
+    m_source.clear();
+
+    if (m_epoll_fd >= 0) ::close(m_epoll_fd);
+    m_epoll_fd = -1;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_fd() - Arranges for a handler to be called whenever new data arrives on a file descriptor
+//
+// Passed:  fd      = the file descriptor to watch
+//          handler = the function to call.  It must read until the descriptor would block
+//
+// Returns: true on success
+//==========================================================================================================
+bool EventLoop::add_fd(int fd, function<void()> handler)
+{
+    // Keep track of the handler for this descriptor
+    m_source.push_back(unique_ptr<source_t>(new source_t{fd, false, handler}));
+
+    // Watch the descriptor in edge-triggered mode.  The event carries a pointer to our source_t
+    epoll_event event = {};
+    event.events   = EPOLLIN | EPOLLET;
+    event.data.ptr = m_source.back().get();
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0) return true;
+
+    // If we get here, epoll wouldn't take the descriptor
+    m_source.pop_back();
+    return false;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_socket() - Arranges for a handler to be called whenever new packets arrive on a UDP socket
+//
+// Passed:  sock    = the socket to watch.  It is put into non-blocking mode
+//          handler = the function to call.  It must receive until the socket has no more packets
+//
+// Returns: true on success
+//==========================================================================================================
+bool EventLoop::add_socket(UDPSock& sock, function<void(UDPSock&)> handler)
+{
+    // An edge-triggered handler has to be able to read until there's nothing left
+    if (!sock.set_blocking(false)) return false;
+
+    // And watch the socket
+    UDPSock* p_sock = &sock;
+    return add_fd(sock.get_sd(), [p_sock, handler]() {handler(*p_sock);});
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_timer() - Arranges for a handler to be called periodically
+//
+// Passed:  interval_ms = the number of milliseconds between calls
+//          handler     = the function to call
+//
+// Returns: true on success
+//==========================================================================================================
+bool EventLoop::add_timer(int interval_ms, function<void()> handler)
+{
+    // Create a timer descriptor
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) return false;
+
+    // Make it fire every interval_ms, starting one interval from now
+    itimerspec spec;
+    spec.it_interval.tv_sec  = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    spec.it_value            = spec.it_interval;
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0 || !add_fd(fd, handler))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Mark this source as a timer, so that we read its expiration count and close it when we're done
+    m_source.back()->is_timer = true;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// remove_fd() - Stops watching a file descriptor
+//==========================================================================================================
+void EventLoop::remove_fd(int fd)
+{
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+    for (auto it = m_source.begin(); it != m_source.end(); ++it)
+    {
+        if ((*it)->fd != fd) continue;
+        if ((*it)->is_timer) ::close(fd);
+        m_source.erase(it);
+        return;
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run_once() - Waits for events, then calls the handler of every source that is ready
+//
+// Passed:  timeout_ms = the maximum time to wait for an event.  -1 = Wait forever
+//
+// Returns: the number of events that were handled
+//==========================================================================================================
+int EventLoop::run_once(int timeout_ms)
+{
+    // Wait for something to happen
+    int count = epoll_wait(m_epoll_fd, m_event.data(), m_event.size(), timeout_ms);
+    if (count < 0) return 0;
+
+    // Call the handler of each source that's ready
+    for (int i=0; i<count; ++i)
+    {
+        source_t* p_source = (source_t*)m_event[i].data.ptr;
+
+        // A timer has to be read to re-arm it for the next edge
+        if (p_source->is_timer)
+        {
+            uint64_t expirations;
+            if (read(p_source->fd, &expirations, sizeof expirations) < 0) continue;
+        }
+
+        p_source->handler();
+    }
+
+    // Tell the caller how many events we handled
+    return count;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run() - Dispatches events until stop() is called
+//==========================================================================================================
+void EventLoop::run()
+{
+    m_stop = false;
+    while (!m_stop) run_once();
+}
+//==========================================================================================================
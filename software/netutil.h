@@ -3,8 +3,14 @@
 //==========================================================================================================
 #pragma once
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <string>
 #include <netdb.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class UDPSock;
 
 struct ipv4_t
 {
@@ -68,6 +74,9 @@ struct NetUtil
     static bool get_local_ip(std::string iface, ipv4_t* dest);
     static bool get_local_ip(std::string iface, ipv6_t* dest);
 
+    // Fetches the 6-byte MAC address of a local network interface
+    static bool get_local_mac(std::string iface, unsigned char* mac);
+
     // Returns addrinfo about the local machine
     static addrinfo_t get_local_addrinfo(int type, int port, std::string bind_to, int family);
 
@@ -86,3 +95,71 @@ struct NetUtil
 };
 
 
+//==========================================================================================================
+// EventLoop - An edge-triggered epoll reactor.   Descriptors, UDP sockets and timers are registered with
+//             a handler, and run() calls the handler of each one that becomes ready.   The cost per event
+//             is constant no matter how many descriptors are registered.
+//
+// Because the loop is edge-triggered, a handler is only called when new data arrives, and it must read
+// until the descriptor would block.   Sockets registered with add_socket() are put in non-blocking mode.
+//==========================================================================================================
+class EventLoop
+{
+public:
+
+    // Constructor, marks the loop as closed
+    EventLoop() {m_epoll_fd = -1; m_stop = false;}
+
+    // Destructor - closes the epoll instance and any timers
+    ~EventLoop() {close();}
+
+    // Creates the epoll instance.  max_events is the most events fetched per epoll_wait()
+    bool    create(int max_events = 64);
+
+    // Closes the epoll instance and any timers
+    void    close();
+
+    // Calls "handler" whenever new data arrives on a file descriptor
+    bool    add_fd(int fd, std::function<void()> handler);
+
+    // Puts a UDP socket in non-blocking mode and calls "handler" whenever new packets arrive on it
+    bool    add_socket(UDPSock& sock, std::function<void(UDPSock&)> handler);
+
+    // Calls "handler" every "interval_ms" milliseconds
+    bool    add_timer(int interval_ms, std::function<void()> handler);
+
+    // Stops watching a file descriptor.  This must not be called from inside a handler
+    void    remove_fd(int fd);
+
+    // Waits up to timeout_ms for events and dispatches them.  Returns the number of events handled
+    int     run_once(int timeout_ms = -1);
+
+    // Dispatches events until stop() is called
+    void    run();
+
+    // Makes run() return after it finishes dispatching the current events
+    void    stop() {m_stop = true;}
+
+protected:
+
+    // A registered descriptor.  epoll hands us a pointer to one of these with each event
+    struct source_t
+    {
+        int                     fd;
+        bool                    is_timer;
+        std::function<void()>   handler;
+    };
+
+    // The epoll instance
+    int     m_epoll_fd;
+
+    // Everything that's registered
+    std::vector<std::unique_ptr<source_t>> m_source;
+
+    // The buffer that epoll_wait() fills in
+    std::vector<struct epoll_event> m_event;
+
+    // Becomes true when run() should return
+    bool    m_stop;
+};
+//==========================================================================================================
@@ -0,0 +1,167 @@
+//==========================================================================================================
+// pacer.cpp - Implements a helper that spaces transmissions out to hold a target bit rate
+//==========================================================================================================
+#include <time.h>
+#include <sched.h>
+#include <stdio.h>
+#include "pacer.h"
+
+
+//==========================================================================================================
+// now_ns() - Returns the current value of the monotonic clock in nanoseconds
+//==========================================================================================================
+int64_t Pacer::now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// wait() - Waits until the bucket holds enough tokens to send "bytes" more bytes
+//==========================================================================================================
+void Pacer::wait(uint64_t bytes)
+{
+    // If there's no rate limit, there's never anything to wait for
+    if (m_ns_per_byte == 0) return;
+
+    // A full bucket lets these bytes go a whole burst ahead of their place in the schedule
+    release(schedule(bytes) - burst_ns());
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// schedule() - Books bytes into the schedule
+//
+// Passed:  bytes = the number of bytes about to be sent
+//
+// Returns: the time (on the monotonic clock) at which they are due to start leaving, if everything
+//          leaves at exactly the configured rate
+//==========================================================================================================
+int64_t Pacer::schedule(uint64_t bytes)
+{
+    // This is the time at which everything up to the start of these bytes should have been sent
+    int64_t due_ns = m_start_ns + (int64_t)(m_bytes * m_ns_per_byte);
+
+    // If we've fallen behind, the bucket has been full for a while.  Tokens beyond its depth are lost,
+    // so the schedule restarts from now instead of letting us catch up
+    if (m_burst)
+    {
+        int64_t now = now_ns();
+        if (due_ns < now)
+        {
+            m_start_ns = due_ns = now;
+            m_bytes    = 0;
+        }
+    }
+
+    m_bytes += bytes;
+    bump(stats.bytes, bytes);
+    return due_ns;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// release() - Waits until a burst is due, and keeps track of how punctually it went
+//
+// Passed:  due_ns = the earliest time the burst may go, on the monotonic clock
+//==========================================================================================================
+void Pacer::release(int64_t due_ns)
+{
+    int64_t called_ns = now_ns();
+
+    // Wait if we're early
+    if (due_ns > called_ns)
+    {
+        wait_until(due_ns);
+        bump(stats.waits);
+    }
+
+    // Jitter is how far past the later of the due time and the time we were called the release was.
+    // If the caller is late on its own account, that shows up in the achieved rate instead
+    int64_t released_ns = now_ns();
+    int64_t target_ns   = (due_ns > called_ns) ? due_ns : called_ns;
+    stats.jitter.record(released_ns - target_ns);
+
+    if (stats.bursts.load(std::memory_order_relaxed) == 0)
+    {
+        stats.first_ns.store(released_ns, std::memory_order_relaxed);
+    }
+    stats.last_ns.store(released_ns, std::memory_order_relaxed);
+    bump(stats.bursts);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// wait_until() - Waits until the monotonic clock reaches the specified time
+//==========================================================================================================
+void Pacer::wait_until(int64_t due_ns)
+{
+    // If we're not early, there's nothing to wait for
+    int64_t early_ns = due_ns - now_ns();
+    if (early_ns <= 0) return;
+
+    // Sleep away most of long waits, and spin through short ones
+    if (early_ns > 100000)
+    {
+        int64_t sleep_ns = early_ns - 50000;
+        timespec ts = {(time_t)(sleep_ns / 1000000000), (long)(sleep_ns % 1000000000)};
+        nanosleep(&ts, NULL);
+    }
+    while (now_ns() < due_ns) sched_yield();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays the rate that one or more pacers achieved, and how punctual they were
+//
+// Passed:  pacer  = the pacers, which share a rate and burst size
+//          count  = how many there are
+//          txtime = true if departure times were handed to the kernel with SO_TXTIME
+//==========================================================================================================
+void Pacer::show_summary(const Pacer** pacer, int count, bool txtime)
+{
+    LatencyHistogram jitter;
+    uint64_t bytes = 0, bursts = 0, waits = 0, missed = 0;
+    double   gbps = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        const pacer_stats_t& s = pacer[i]->stats;
+        uint64_t pacer_bytes = s.bytes.load(std::memory_order_relaxed);
+        uint64_t first_ns    = s.first_ns.load(std::memory_order_relaxed);
+        uint64_t last_ns     = s.last_ns.load(std::memory_order_relaxed);
+        bytes  += pacer_bytes;
+        bursts += s.bursts.load(std::memory_order_relaxed);
+        waits  += s.waits.load(std::memory_order_relaxed);
+        missed += s.missed.load(std::memory_order_relaxed);
+        jitter.merge(s.jitter);
+
+        // The pacers run side by side, so their rates add up
+        if (last_ns > first_ns) gbps += pacer_bytes * 8.0 / (last_ns - first_ns);
+    }
+
+    printf("pacing    : %.3f Gbit/s target, burst %llu bytes%s, %d socket%s\n", pacer[0]->rate(),
+           (unsigned long long)pacer[0]->burst(), txtime ? ", SO_TXTIME" : "", count, count == 1 ? "" : "s");
+    printf("achieved  : %.3f Gbit/s, %llu bytes in %llu bursts, %llu waited for tokens\n", gbps,
+           (unsigned long long)bytes, (unsigned long long)bursts, (unsigned long long)waits);
+    if (jitter.count())
+    {
+        printf("jitter    : usec p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", jitter.percentile(50) / 1e3,
+               jitter.percentile(99) / 1e3, jitter.percentile(99.9) / 1e3, jitter.max() / 1e3);
+    }
+    if (txtime) printf("missed    : %llu packets dropped for missing their departure time\n",
+                       (unsigned long long)missed);
+}
+//==========================================================================================================
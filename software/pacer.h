@@ -0,0 +1,98 @@
+//==========================================================================================================
+// pacer.h - Defines a helper that spaces transmissions out to hold a target bit rate
+//
+// The pacer is a token bucket: tokens (bytes) accumulate at the configured rate, up to the depth of the
+// bucket, and a transmission has to wait until there are enough tokens to cover it.  The depth is the
+// largest burst that may leave back-to-back, so a sender that falls behind catches up by at most one
+// burst rather than by everything it owes.  This matters to the FPGA, whose receive FIFOs overrun if
+// the host bursts at line rate for too long.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "histogram.h"
+
+// A reasonable bucket depth for pacing traffic at the FPGA
+const uint64_t PACER_DEFAULT_BURST = 256 << 10;
+
+//==========================================================================================================
+// pacer_stats_t - Counters for a Pacer, written by the thread that sends and readable by any other
+//==========================================================================================================
+struct alignas(64) pacer_stats_t
+{
+    std::atomic<uint64_t>   bytes{0};           // Bytes scheduled
+    std::atomic<uint64_t>   bursts{0};          // Bursts released
+    std::atomic<uint64_t>   waits{0};           // Bursts that had to wait for tokens
+    std::atomic<uint64_t>   first_ns{0};        // When the first burst was released
+    std::atomic<uint64_t>   last_ns{0};         // When the most recent burst was released
+    std::atomic<uint64_t>   missed{0};          // SO_TXTIME packets dropped for missing their departure time
+
+    // How much later than its due time each burst was released, in nanoseconds
+    LatencyHistogram        jitter;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// Pacer - A token bucket that delays the caller whenever it gets ahead of the configured rate
+//==========================================================================================================
+class Pacer
+{
+public:
+
+    // Constructor, no rate limit
+    Pacer() {m_ns_per_byte = 0; m_burst = 0; m_start_ns = 0; m_bytes = 0;}
+
+    // Sets the rate limit in Gbit/s.  0 means "as fast as possible"
+    void    set_rate(double gbps) {m_ns_per_byte = (gbps > 0) ? 8 / gbps : 0;}
+
+    // Sets the depth of the bucket in bytes.  0 means "no limit": a sender that falls behind may burst
+    // until it has caught up with the schedule
+    void    set_burst(uint64_t bytes) {m_burst = bytes;}
+
+    // Returns the rate limit in Gbit/s, and the depth of the bucket in bytes
+    double  rate() const  {return m_ns_per_byte ? 8 / m_ns_per_byte : 0;}
+    uint64_t burst() const {return m_burst;}
+
+    // Returns true if there is a rate limit
+    bool    is_paced() {return m_ns_per_byte != 0;}
+
+    // Starts the schedule fresh
+    void    start() {m_start_ns = now_ns(); m_bytes = 0;}
+
+    // Waits until the schedule allows "bytes" more bytes to be sent
+    void    wait(uint64_t bytes);
+
+    // Books "bytes" more bytes into the schedule without waiting, and returns the time at which they are
+    // due to start leaving at exactly the configured rate
+    int64_t schedule(uint64_t bytes);
+
+    // Waits until "due_ns" (if that's in the future) and records how late the release was
+    void    release(int64_t due_ns);
+
+    // Returns how long the bucket takes to fill, in nanoseconds
+    int64_t burst_ns() const {return (int64_t)(m_burst * m_ns_per_byte);}
+
+    // Counters
+    pacer_stats_t stats;
+
+    // Displays the counters of one or more pacers that share a rate and burst
+    static void show_summary(const Pacer** pacer, int count, bool txtime = false);
+
+    // Returns the current value of the monotonic clock in nanoseconds
+    static int64_t now_ns();
+
+    // Waits until the monotonic clock reaches "due_ns"
+    static void wait_until(int64_t due_ns);
+
+protected:
+
+    // Nanoseconds per byte at the configured rate, and the depth of the bucket in bytes
+    double      m_ns_per_byte;
+    uint64_t    m_burst;
+
+    // When the schedule started, and how many bytes have been scheduled since then
+    int64_t     m_start_ns;
+    uint64_t    m_bytes;
+};
+//==========================================================================================================
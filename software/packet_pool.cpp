@@ -0,0 +1,63 @@
+//==========================================================================================================
+// packet_pool.cpp - Implements a preallocated pool of fixed-size packet buffers
+//==========================================================================================================
+#include <sys/mman.h>
+#include "packet_pool.h"
+
+// Buffers are rounded up to a multiple of this
+static const size_t CACHE_LINE = 64;
+
+// The size of a hugepage.  Hugepage mappings must be a multiple of this
+static const size_t HUGEPAGE_SIZE = 2 * 1024 * 1024;
+
+
+//==========================================================================================================
+// create() - Allocates and pre-faults the buffers
+//
+// Passed:  count       = the number of buffers
+//          buffer_size = the minimum size of each buffer
+//          hugepages   = true to back the pool with hugepages
+//
+// Returns: true on success
+//==========================================================================================================
+bool PacketPool::create(uint32_t count, size_t buffer_size, bool hugepages)
+{
+    // If the pool is already allocated, free it
+    close();
+
+    // Every buffer starts on a cache-line boundary
+    buffer_size = (buffer_size + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+
+    // Hugepage mappings have to be a whole number of hugepages
+    size_t map_len = count * buffer_size;
+    if (hugepages) map_len = (map_len + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+
+    // Map the memory and fault every page in now, rather than on the first packet
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+    if (hugepages) flags |= MAP_HUGETLB;
+    void* memory = mmap(NULL, map_len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (memory == MAP_FAILED) return false;
+
+    // Save the geometry of the pool
+    m_memory      = (uint8_t*)memory;
+    m_map_len     = map_len;
+    m_count       = count;
+    m_buffer_size = buffer_size;
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Frees the pool
+//==========================================================================================================
+void PacketPool::close()
+{
+    if (m_memory) munmap(m_memory, m_map_len);
+    m_memory = NULL;
+    m_count  = 0;
+}
+//==========================================================================================================
@@ -0,0 +1,54 @@
+//==========================================================================================================
+// packet_pool.h - Defines a preallocated pool of fixed-size packet buffers
+//
+// Buffers are identified by a small integer handle rather than a pointer, so that they can be passed
+// between threads through an SPSCRing cheaply.  Every buffer starts on a cache-line boundary.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// A handle to a buffer in a PacketPool, plus the length of the packet in it
+struct pool_packet_t
+{
+    uint32_t    handle;
+    uint32_t    length;
+};
+
+//==========================================================================================================
+// PacketPool - A fixed number of equal-sized buffers carved out of one mapping
+//==========================================================================================================
+class PacketPool
+{
+public:
+
+    // Constructor, marks the pool as unallocated
+    PacketPool() {m_memory = NULL; m_map_len = 0; m_count = 0; m_buffer_size = 0;}
+
+    // Destructor - frees the pool
+    ~PacketPool() {close();}
+
+    // Allocates "count" buffers of at least "buffer_size" bytes each, optionally in hugepages
+    bool    create(uint32_t count, size_t buffer_size, bool hugepages = false);
+
+    // Frees the pool
+    void    close();
+
+    // Returns a pointer to the buffer with the specified handle
+    void*   data(uint32_t handle) {return m_memory + handle * m_buffer_size;}
+
+    // Returns the number of buffers, and the size of each one
+    uint32_t count()       {return m_count;}
+    size_t   buffer_size() {return m_buffer_size;}
+
+protected:
+
+    // The mapping that holds every buffer
+    uint8_t*    m_memory;
+    size_t      m_map_len;
+
+    // The number of buffers, and the size of each (a multiple of the cache-line size)
+    uint32_t    m_count;
+    size_t      m_buffer_size;
+};
+//==========================================================================================================
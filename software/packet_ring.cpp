@@ -0,0 +1,622 @@
+//==========================================================================================================
+// packet_ring.cpp - Implements a raw TPACKET_V3 receive ring that shows RDMA packets exactly as they came
+//                   off the wire
+//==========================================================================================================
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <immintrin.h>
+#include "packet_ring.h"
+using namespace std;
+
+// The frame size the kernel wants to be told about.  TPACKET_V3 packs frames into a block back to back,
+// whatever their size, so this only has to divide the block size
+static const int RING_FRAME_SIZE = 2048;
+
+// What the BPF filter returns for a frame it accepts: keep all of it
+static const int FILTER_SNAP_LEN = 0x40000;
+
+
+//==========================================================================================================
+// sum_scalar() - Adds up a buffer as 16-bit words in one's complement, 32 bits at a time
+//
+// Passed:  data   = the buffer.  It doesn't have to be aligned
+//          length = its length in bytes.  An odd final byte is padded with a zero
+//
+// Returns: the sum, which still has to be folded to 16 bits.  Words are taken in the byte order they
+//          have in memory, which the one's complement sum doesn't care about: a checksum that works out
+//          in one byte order works out in the other
+//==========================================================================================================
+static uint64_t sum_scalar(const uint8_t* data, size_t length)
+{
+    uint64_t sum = 0;
+    size_t   i   = 0;
+
+    for (; i + 4 <= length; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, data + i, sizeof word);
+        sum += word;
+    }
+
+    if (i + 2 <= length)
+    {
+        uint16_t word;
+        memcpy(&word, data + i, sizeof word);
+        sum += word;
+        i += 2;
+    }
+
+    if (i < length)
+    {
+        uint8_t  pad[2] = {data[i], 0};
+        uint16_t word;
+        memcpy(&word, pad, sizeof word);
+        sum += word;
+    }
+
+    return sum;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// sum_avx2() - Adds up a buffer as 16-bit words in one's complement, 32 bytes at a time.  Each pass adds
+//              two words to every 32-bit lane, so the lanes can't overflow on buffers under 1 MB
+//==========================================================================================================
+__attribute__((target("avx2")))
+static uint64_t sum_avx2(const uint8_t* data, size_t length)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum32 = zero;
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i words = _mm256_loadu_si256((const __m256i*)(data + i));
+        sum32 = _mm256_add_epi32(sum32, _mm256_unpacklo_epi16(words, zero));
+        sum32 = _mm256_add_epi32(sum32, _mm256_unpackhi_epi16(words, zero));
+    }
+
+    // Widen the lanes to 64 bits and add them together
+    __m256i sum64 = _mm256_add_epi64(_mm256_unpacklo_epi32(sum32, zero), _mm256_unpackhi_epi32(sum32, zero));
+    __m128i sum   = _mm_add_epi64(_mm256_castsi256_si128(sum64), _mm256_extracti128_si256(sum64, 1));
+
+    // Finish off the last few bytes
+    return _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1) + sum_scalar(data + i, length - i);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// fold() - Folds a one's complement sum down to 16 bits.  A buffer whose checksum is right folds to 0xFFFF
+//==========================================================================================================
+static uint16_t fold(uint64_t sum)
+{
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return sum;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// Constructor - Marks the ring as closed
+//==========================================================================================================
+PacketRing::PacketRing()
+{
+    m_sd          = -1;
+    m_ring        = NULL;
+    m_ring_len    = 0;
+    m_block       = -1;
+    m_next_block  = 0;
+    m_frame       = NULL;
+    m_frames_left = 0;
+    m_kernel      = sum_scalar;
+    m_kernel_name = "scalar";
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// build_filter() - Builds the classic BPF program that only lets IPv4 UDP packets for the RDMA ports in.
+//                  It's the program "tcpdump -dd ip and udp dst port <port>" would generate
+//
+// Passed:  ports = the UDP destination ports to accept
+//==========================================================================================================
+vector<sock_filter> PacketRing::build_filter(const vector<int>& ports)
+{
+    vector<sock_filter> prog;
+
+    // Indices of the instructions that jump to the "drop" label when their test fails or succeeds, and
+    // of the ones that jump to the "accept" label when their test succeeds
+    vector<int> drop_if_false, drop_if_true, accept_if_true;
+
+    // IPv4
+    prog.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12));
+    drop_if_false.push_back(prog.size());
+    prog.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IP, 0, 0));
+
+    // Protocol is UDP
+    prog.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, ETHER_HDR_LEN + 9));
+    drop_if_false.push_back(prog.size());
+    prog.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 0));
+
+    // Not a fragment after the first.  Those don't have a UDP header
+    prog.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, ETHER_HDR_LEN + 6));
+    drop_if_true.push_back(prog.size());
+    prog.push_back(BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, IP_OFFMASK, 0, 0));
+
+    // X = the length of the IP header, then load the UDP destination port
+    prog.push_back(BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, ETHER_HDR_LEN));
+    prog.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_IND, ETHER_HDR_LEN + 2));
+
+    // Addressed to one of the RDMA ports
+    for (int port : ports)
+    {
+        accept_if_true.push_back(prog.size());
+        prog.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)port, 0, 0));
+    }
+
+    // drop: return 0
+    int drop = prog.size();
+    prog.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+
+    // accept: return the whole frame
+    int accept = prog.size();
+    prog.push_back(BPF_STMT(BPF_RET | BPF_K, FILTER_SNAP_LEN));
+
+    // Point the jumps at their labels.  Jumps are relative to the next instruction
+    for (int i : drop_if_false)  prog[i].jf = drop - (i + 1);
+    for (int i : drop_if_true)   prog[i].jt = drop - (i + 1);
+    for (int i : accept_if_true) prog[i].jt = accept - (i + 1);
+
+    // Hand the finished program to the caller
+    return prog;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// create() - Opens an AF_PACKET socket on an interface, filters it and maps its receive ring
+//
+// Passed:  iface = the name of the network interface ("eth0", "enp1s0f0", etc)
+//          ports = the UDP destination ports to let into the ring.  There may be up to 200 of them
+//          isa   = "scalar" or "avx2" to force a checksum kernel, or NULL for the fastest one
+//
+// Returns: true on success.  AF_PACKET sockets require CAP_NET_RAW
+//==========================================================================================================
+bool PacketRing::create(string iface, const vector<int>& ports, const char* isa)
+{
+    // If we're already open, close
+    close();
+
+    // Pick the checksum kernel.  If we haven't been told which one to use, use the widest one the CPU has
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (isa == NULL) isa = has_avx2 ? "avx2" : "scalar";
+
+    if (strcmp(isa, "avx2") == 0 && has_avx2)
+        m_kernel = sum_avx2;
+    else if (strcmp(isa, "scalar") == 0)
+        m_kernel = sum_scalar;
+    else
+        return false;
+    m_kernel_name = isa;
+
+    // Find the index of the interface
+    int ifindex = if_nametoindex(iface.c_str());
+    if (ifindex == 0 || ports.empty() || ports.size() > 200) return false;
+
+    // A packet socket with protocol 0 receives nothing until it's bound, so the filter is in place
+    // before the first packet can reach the ring
+    m_sd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (m_sd < 0) return false;
+
+    // Attach the filter
+    vector<sock_filter> filter = build_filter(ports);
+    sock_fprog program = {(unsigned short)filter.size(), filter.data()};
+    if (setsockopt(m_sd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof program) < 0) return false;
+
+    // We're watching what arrives, not what we send.  Kernels before 4.20 show us both
+    int one = 1;
+    setsockopt(m_sd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof one);
+
+    // Ask for a TPACKET_V3 ring of variable-length frames in fixed-size blocks
+    int version = TPACKET_V3;
+    if (setsockopt(m_sd, SOL_PACKET, PACKET_VERSION, &version, sizeof version) < 0) return false;
+
+    tpacket_req3 req;
+    memset(&req, 0, sizeof req);
+    req.tp_block_size     = RING_BLOCK_SIZE;
+    req.tp_block_nr       = RING_BLOCK_COUNT;
+    req.tp_frame_size     = RING_FRAME_SIZE;
+    req.tp_frame_nr       = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_COUNT;
+    req.tp_retire_blk_tov = RING_RETIRE_MS;
+    if (setsockopt(m_sd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) < 0) return false;
+
+    // Map the ring into our address space
+    size_t ring_len = (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT;
+    void*  p = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_sd, 0);
+    if (p == MAP_FAILED) return false;
+    m_ring     = (uint8_t*)p;
+    m_ring_len = ring_len;
+
+    // And start receiving from the interface
+    sockaddr_ll addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sll_family   = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_IP);
+    addr.sll_ifindex  = ifindex;
+    if (bind(m_sd, (sockaddr*)&addr, sizeof addr) < 0) return false;
+
+    m_iface      = iface;
+    m_block      = -1;
+    m_next_block = 0;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Stops the monitor thread, unmaps the ring and closes the socket
+//==========================================================================================================
+void PacketRing::close()
+{
+    stop();
+
+    if (m_ring) munmap(m_ring, m_ring_len);
+    if (m_sd >= 0) ::close(m_sd);
+    m_ring        = NULL;
+    m_ring_len    = 0;
+    m_sd          = -1;
+    m_block       = -1;
+    m_frames_left = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// receive_block() - Waits for the kernel to hand us the next block of the ring
+//
+// Passed:  timeout_ms = how long to wait, in milliseconds.  -1 means "forever"
+//
+// Returns: the number of frames in the block, 0 if none arrived in time, or -1 on an error
+//==========================================================================================================
+int PacketRing::receive_block(int timeout_ms)
+{
+    // If the caller didn't hand back the block it was reading, do it for them
+    if (m_block >= 0) release_block();
+
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        // The kernel hands out blocks in order, so the next one is the only one worth looking at
+        tpacket_block_desc* block = (tpacket_block_desc*)(m_ring + (size_t)m_next_block * RING_BLOCK_SIZE);
+        if (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)
+        {
+            m_block       = m_next_block;
+            m_next_block  = (m_next_block + 1) % RING_BLOCK_COUNT;
+            m_frame       = (uint8_t*)block + block->hdr.bh1.offset_to_first_pkt;
+            m_frames_left = block->hdr.bh1.num_pkts;
+            bump(stats.blocks);
+            return m_frames_left;
+        }
+
+        // Otherwise, wait for the kernel to retire it
+        if (attempt == 0)
+        {
+            pollfd pfd = {m_sd, POLLIN | POLLERR, 0};
+            int rc = poll(&pfd, 1, timeout_ms);
+            if (rc < 0) return (errno == EINTR) ? 0 : -1;
+            if (rc == 0) return 0;
+        }
+    }
+
+    // poll() said a block was ready, but it isn't yet
+    return 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// next_frame() - Decodes the next frame of the current block, where it lies in the ring.  Frames that are
+//                too short for their headers are counted and skipped
+//
+// Passed:  frame = where to store the decoded frame
+//
+// Returns: false when the block has no more frames
+//==========================================================================================================
+bool PacketRing::next_frame(rdma_frame_t& frame)
+{
+    while (m_frames_left)
+    {
+        // Step past this frame, whatever we make of it
+        const tpacket3_hdr* hdr = (const tpacket3_hdr*)m_frame;
+        m_frame += hdr->tp_next_offset;
+        --m_frames_left;
+
+        const uint8_t* data = (const uint8_t*)hdr + hdr->tp_mac;
+        frame.wire_length   = hdr->tp_len;
+        frame.captured      = hdr->tp_snaplen;
+        frame.vlan          = (hdr->tp_status & TP_STATUS_VLAN_VALID) ? hdr->hv1.tp_vlan_tci : 0;
+        frame.time_ns       = (uint64_t)hdr->tp_sec * 1000000000 + hdr->tp_nsec;
+        if (frame.captured < frame.wire_length) bump(stats.truncated);
+
+        // The Ethernet header, then an IPv4 header (which may have options)
+        frame.eth = (const ether_header*)data;
+        frame.ip  = (const iphdr*)(data + ETHER_HDR_LEN);
+        int ip_len = (frame.captured >= ETHER_HDR_LEN + (int)sizeof(iphdr)) ? frame.ip->ihl * 4 : 0;
+        if (ip_len < (int)sizeof(iphdr) || frame.ip->version != 4
+        ||  frame.captured < ETHER_HDR_LEN + ip_len + (int)sizeof(udphdr))
+        {
+            bump(stats.malformed);
+            continue;
+        }
+
+        // The UDP header, and as much of the UDP payload as the UDP length and the capture both allow
+        frame.udp = (const udphdr*)(data + ETHER_HDR_LEN + ip_len);
+        int udp_offset = ETHER_HDR_LEN + ip_len + sizeof(udphdr);
+        int udp_length = ntohs(frame.udp->len) - (int)sizeof(udphdr);
+        if (udp_length < 0)
+        {
+            bump(stats.malformed);
+            continue;
+        }
+        if (udp_length > frame.captured - udp_offset) udp_length = frame.captured - udp_offset;
+
+        // The RDMA header, if there is one, and the payload behind it
+        frame.rdma           = (const rdma_header_t*)(data + udp_offset);
+        frame.payload        = data + udp_offset;
+        frame.payload_length = udp_length;
+        if (udp_length >= RDMA_HDR_LEN && frame.rdma->magic() == RDMA_MAGIC)
+        {
+            frame.payload        += RDMA_HDR_LEN;
+            frame.payload_length -= RDMA_HDR_LEN;
+        }
+        else
+        {
+            frame.rdma = NULL;
+            bump(stats.not_rdma);
+        }
+
+        // Check the checksums
+        verify(frame, hdr->tp_status);
+
+        bump(stats.frames);
+        bump(stats.bytes, frame.wire_length);
+        return true;
+    }
+
+    return false;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// verify() - Checks the IPv4 header checksum and the UDP checksum of a decoded frame
+//
+// Passed:  frame  = the frame.  Its "ip_check" and "udp_check" fields are filled in
+//          status = the tp_status the kernel gave the frame
+//==========================================================================================================
+void PacketRing::verify(rdma_frame_t& frame, uint32_t status)
+{
+    // The IPv4 header checksum covers the IPv4 header alone
+    frame.ip_check = (fold(m_kernel((const uint8_t*)frame.ip, frame.ip->ihl * 4)) == 0xFFFF) ? CSUM_GOOD
+                                                                                            : CSUM_BAD;
+
+    // The UDP checksum covers a pseudo-header (the IP addresses, protocol and UDP length), the UDP header
+    // and the UDP payload.  It can't be checked if the NIC hasn't computed it yet, or we don't have the
+    // whole datagram
+    const uint8_t* udp     = (const uint8_t*)frame.udp;
+    int            udp_len = ntohs(frame.udp->len);
+    if (status & TP_STATUS_CSUMNOTREADY)
+        frame.udp_check = CSUM_OFFLOADED;
+    else if (frame.udp->check == 0)
+        frame.udp_check = CSUM_NONE;
+    else if (udp + udp_len > (const uint8_t*)frame.eth + frame.captured)
+        frame.udp_check = CSUM_UNCHECKED;
+    else
+    {
+        uint64_t sum = m_kernel((const uint8_t*)&frame.ip->saddr, 8) + htons(IPPROTO_UDP) + frame.udp->len;
+        sum += m_kernel(udp, udp_len);
+        frame.udp_check = (fold(sum) == 0xFFFF) ? CSUM_GOOD : CSUM_BAD;
+    }
+
+    // Count the verdicts
+    if (frame.ip_check == CSUM_BAD) bump(stats.bad_ip_csum);
+    switch (frame.udp_check)
+    {
+        case CSUM_BAD:       bump(stats.bad_udp_csum); break;
+        case CSUM_NONE:      bump(stats.no_udp_csum);  break;
+        case CSUM_OFFLOADED: bump(stats.offloaded);    break;
+        default:             break;
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// release_block() - Hands the block we've been reading back to the kernel
+//==========================================================================================================
+void PacketRing::release_block()
+{
+    if (m_block < 0) return;
+    tpacket_block_desc* block = (tpacket_block_desc*)(m_ring + (size_t)m_block * RING_BLOCK_SIZE);
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    m_block       = -1;
+    m_frames_left = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// read_kernel_stats() - Adds the kernel's counters to ours.  Reading them resets them
+//==========================================================================================================
+void PacketRing::read_kernel_stats()
+{
+    tpacket_stats_v3 kernel;
+    socklen_t        length = sizeof kernel;
+    if (getsockopt(m_sd, SOL_PACKET, PACKET_STATISTICS, &kernel, &length) < 0) return;
+    bump(stats.kernel_drops, kernel.tp_drops);
+    bump(stats.freezes, kernel.tp_freeze_q_cnt);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// start() - Starts the monitor thread
+//
+// Passed:  dump_count  = the number of frames to display field by field when they arrive
+//          max_reports = the most frames with bad checksums or RDMA headers to display
+//==========================================================================================================
+void PacketRing::start(int dump_count, int max_reports)
+{
+    m_stopped = false;
+    m_thread  = thread(&PacketRing::run, this, dump_count, max_reports);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// stop() - Tells the monitor thread to stop, and waits for it to
+//==========================================================================================================
+void PacketRing::stop()
+{
+    m_stopped = true;
+    if (m_thread.joinable()) m_thread.join();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run() - The monitor thread: reads every block the kernel hands us, verifying and counting its frames
+//==========================================================================================================
+void PacketRing::run(int dump_count, int max_reports)
+{
+    rdma_frame_t frame;
+    int          reports = 0;
+
+    // Whoever we're watching comes first.  If we can't keep up, the kernel drops frames from the ring,
+    // which it counts, rather than from their sockets
+    setpriority(PRIO_PROCESS, gettid(), 10);
+
+    // Check every so often whether we've been told to stop
+    while (!m_stopped)
+    {
+        if (receive_block(RING_RETIRE_MS * 10) < 0) break;
+
+        while (next_frame(frame))
+        {
+            bool bad = frame.ip_check == CSUM_BAD || frame.udp_check == CSUM_BAD || frame.rdma == NULL;
+            if (dump_count > 0)
+            {
+                --dump_count;
+                show_frame(frame);
+            }
+            else if (bad && reports < max_reports)
+            {
+                ++reports;
+                printf("Monitor on %s found a bad frame:\n", m_iface.c_str());
+                show_frame(frame);
+            }
+        }
+
+        release_block();
+        read_kernel_stats();
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_frame() - Displays every field of the Ethernet, IPv4, UDP and RDMA headers of a frame
+//==========================================================================================================
+void PacketRing::show_frame(const rdma_frame_t& frame)
+{
+    static const char* verdict[] = {"good", "BAD", "none", "offloaded", "unchecked"};
+    const uint8_t* dst = frame.eth->ether_dhost;
+    const uint8_t* src = frame.eth->ether_shost;
+    const iphdr&   ip  = *frame.ip;
+    const udphdr&  udp = *frame.udp;
+    char src_ip[INET_ADDRSTRLEN], dest_ip[INET_ADDRSTRLEN];
+
+    inet_ntop(AF_INET, &ip.saddr, src_ip,  sizeof src_ip);
+    inet_ntop(AF_INET, &ip.daddr, dest_ip, sizeof dest_ip);
+    uint16_t frag = ntohs(ip.frag_off);
+
+    printf("frame     : %d bytes on the wire, %d in the ring, at %llu.%09llu\n",
+           frame.wire_length, frame.captured, (unsigned long long)(frame.time_ns / 1000000000),
+           (unsigned long long)(frame.time_ns % 1000000000));
+    printf("ethernet  : %02x:%02x:%02x:%02x:%02x:%02x -> %02x:%02x:%02x:%02x:%02x:%02x, type 0x%04x",
+           src[0], src[1], src[2], src[3], src[4], src[5], dst[0], dst[1], dst[2], dst[3], dst[4], dst[5],
+           ntohs(frame.eth->ether_type));
+    if (frame.vlan) printf(", vlan %d, priority %d", frame.vlan & 0xFFF, frame.vlan >> 13);
+    printf("\n");
+    printf("ipv4      : %s -> %s, header %d bytes, tos 0x%02x, length %d, id 0x%04x, flags %s%s, offset %d,\n"
+           "            ttl %d, protocol %d, checksum 0x%04x (%s)\n",
+           src_ip, dest_ip, ip.ihl * 4, ip.tos, ntohs(ip.tot_len), ntohs(ip.id), (frag & IP_DF) ? "DF" : "",
+           (frag & IP_MF) ? "MF" : "", (frag & IP_OFFMASK) * 8, ip.ttl, ip.protocol, ntohs(ip.check),
+           verdict[frame.ip_check]);
+    printf("udp       : port %d -> %d, length %d, checksum 0x%04x (%s)\n", ntohs(udp.source), ntohs(udp.dest),
+           ntohs(udp.len), ntohs(udp.check), verdict[frame.udp_check]);
+
+    if (frame.rdma == NULL)
+    {
+        printf("rdma      : not an RDMA packet, %d bytes of UDP payload\n", frame.payload_length);
+        return;
+    }
+
+    const rdma_header_t& rdma = *frame.rdma;
+    printf("rdma      : magic 0x%04x, target 0x%012llx, payload %d bytes\n", rdma.magic(),
+           (unsigned long long)rdma.target_addr(), frame.payload_length);
+    printf("            reserved: sequence %u, timestamp 0x%012llx, flow 0x%04x\n", rdma.sequence(),
+           (unsigned long long)rdma.timestamp(), rdma.flow());
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Stops the monitor thread and displays what it saw
+//==========================================================================================================
+void PacketRing::show_summary()
+{
+    stop();
+    read_kernel_stats();
+
+    auto count = [](const atomic<uint64_t>& counter)
+    {
+        return (unsigned long long)counter.load(memory_order_relaxed);
+    };
+
+    printf("monitor   : %llu frames, %llu bytes on %s, %s checksums\n", count(stats.frames),
+           count(stats.bytes), m_iface.c_str(), m_kernel_name);
+    printf("            kernel dropped %llu (ring full %llu times), %llu truncated, %llu malformed, "
+           "%llu not RDMA\n", count(stats.kernel_drops), count(stats.freezes), count(stats.truncated),
+           count(stats.malformed), count(stats.not_rdma));
+    printf("            bad checksums: %llu IP, %llu UDP.  %llu without a UDP checksum, %llu offloaded\n",
+           count(stats.bad_ip_csum), count(stats.bad_udp_csum), count(stats.no_udp_csum),
+           count(stats.offloaded));
+}
+//==========================================================================================================
@@ -0,0 +1,181 @@
+//==========================================================================================================
+// packet_ring.h - Defines a raw receive ring that shows RDMA packets exactly as they came off the wire
+//
+// UDPSock hands us UDP payloads, so the 42 bytes in front of the RDMA header (the Ethernet, IPv4 and UDP
+// headers that rdma_recv.v and rdma_pkt_filter.v parse) are invisible to it.  A PacketRing is an AF_PACKET
+// socket with a TPACKET_V3 ring: the kernel copies a clone of each frame into a ring of blocks that is
+// mapped into our address space, and retires a block to us when it's full or when RING_RETIRE_MS has
+// passed.  We walk the frames in the block where they lie, decode the whole 64-byte header (Ethernet,
+// IPv4, UDP and RDMA), verify the IP and UDP checksums, then hand the block back.  No frame is copied,
+// and there's one poll() per block rather than one system call per frame.
+//
+// A classic BPF filter attached to the socket lets only IPv4 UDP packets for the RDMA ports into the
+// ring.  The UDP sockets get their own copies of the packets as usual, so a PacketRing can watch an
+// interface while rdma_loop is serving it.  It sees nothing in AF_XDP mode, where the XDP program takes
+// the packets before the kernel's network stack (and AF_PACKET) can.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <net/ethernet.h>
+#include <linux/filter.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include "rdma.h"
+#include "stats.h"
+
+// The geometry of the ring: blocks of this many bytes, this many blocks, and how long the kernel may
+// hold on to a partly filled block before handing it to us
+const int RING_BLOCK_SIZE  = 1 << 20;
+const int RING_BLOCK_COUNT = 32;
+const int RING_RETIRE_MS   = 10;
+
+// By default, the most frames with bad checksums or RDMA headers that a monitor thread displays
+const int RING_MAX_REPORTS = 10;
+
+// The outcome of checking one checksum
+enum checksum_t
+{
+    CSUM_GOOD,
+    CSUM_BAD,
+    CSUM_NONE,              // A UDP checksum of zero: the sender didn't compute one
+    CSUM_OFFLOADED,         // The frame is outbound (or looped back) and the NIC hasn't filled it in yet
+    CSUM_UNCHECKED          // The frame was truncated, so the checksum couldn't be checked
+};
+
+//==========================================================================================================
+// rdma_frame_t - One frame in the ring, decoded in place.  The header pointers point into the ring and
+//                are valid until release_block()
+//==========================================================================================================
+struct rdma_frame_t
+{
+    const ether_header*  eth;
+    const iphdr*         ip;
+    const udphdr*        udp;
+    const rdma_header_t* rdma;          // NULL if the UDP payload doesn't start with an RDMA header
+    const uint8_t*       payload;       // The RDMA payload (or the UDP payload, if "rdma" is NULL)
+    int                  payload_length;
+
+    // The length of the frame on the wire and in the ring, and the VLAN tag the NIC stripped (or 0)
+    int                  wire_length;
+    int                  captured;
+    uint16_t             vlan;
+
+    // When the frame arrived, in nanoseconds since the epoch
+    uint64_t             time_ns;
+
+    // The verdicts on the IPv4 header checksum and the UDP checksum
+    checksum_t           ip_check;
+    checksum_t           udp_check;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// ring_stats_t - Counters for a PacketRing, written by the thread that reads the ring
+//==========================================================================================================
+struct alignas(64) ring_stats_t
+{
+    std::atomic<uint64_t>   frames{0};          // Frames decoded
+    std::atomic<uint64_t>   bytes{0};           // Bytes in those frames, as they were on the wire
+    std::atomic<uint64_t>   blocks{0};          // Blocks the kernel handed us
+    std::atomic<uint64_t>   kernel_drops{0};    // Frames the kernel dropped because the ring was full
+    std::atomic<uint64_t>   freezes{0};         // Times the kernel found the ring full
+    std::atomic<uint64_t>   truncated{0};       // Frames that didn't fit in a block
+    std::atomic<uint64_t>   malformed{0};       // Too short for the headers they claim to have
+    std::atomic<uint64_t>   not_rdma{0};        // UDP payloads that don't start with an RDMA header
+    std::atomic<uint64_t>   bad_ip_csum{0};
+    std::atomic<uint64_t>   bad_udp_csum{0};
+    std::atomic<uint64_t>   no_udp_csum{0};     // Senders that left the UDP checksum zero
+    std::atomic<uint64_t>   offloaded{0};       // Checksums not filled in yet, so not checked
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// PacketRing - An AF_PACKET socket, its TPACKET_V3 ring, and optionally a thread that monitors it
+//==========================================================================================================
+class PacketRing
+{
+public:
+
+    // Constructor, marks the ring as closed
+    PacketRing();
+
+    // Destructor - stops the monitor thread, unmaps the ring and closes the socket
+    ~PacketRing() {close();}
+
+    // Opens a ring on an interface that receives IPv4 UDP packets addressed to any of "ports".  "isa" is
+    // "scalar" or "avx2" to force a checksum kernel, or NULL for the fastest one
+    bool    create(std::string iface, const std::vector<int>& ports, const char* isa = NULL);
+
+    // Stops the monitor thread, unmaps the ring and closes the socket
+    void    close();
+
+    // Waits up to "timeout_ms" for the kernel to hand us a block.  Returns the number of frames in it,
+    // 0 on a timeout, or -1 on an error
+    int     receive_block(int timeout_ms = -1);
+
+    // Decodes the next frame of the current block.  Returns false when there are no more
+    bool    next_frame(rdma_frame_t& frame);
+
+    // Hands the current block back to the kernel
+    void    release_block();
+
+    // Starts a thread that reads the ring, counting and verifying every frame.  The first "dump_count"
+    // frames are displayed field by field, as are the first "max_reports" that fail a check
+    void    start(int dump_count = 0, int max_reports = RING_MAX_REPORTS);
+
+    // Stops the monitor thread.  Safe to call from any thread
+    void    stop();
+
+    // Returns the name of the checksum kernel in use
+    const char* kernel_name() const {return m_kernel_name;}
+
+    // Counters
+    ring_stats_t stats;
+
+    // Displays every field of a decoded frame
+    static void show_frame(const rdma_frame_t& frame);
+
+    // Stops the monitor thread and displays what it saw
+    void    show_summary();
+
+protected:
+
+    // Builds the classic BPF program that keeps everything but RDMA traffic out of the ring
+    static std::vector<sock_filter> build_filter(const std::vector<int>& ports);
+
+    // Checks the IPv4 header checksum and the UDP checksum of a frame
+    void    verify(rdma_frame_t& frame, uint32_t status);
+
+    // Adds the kernel's drop counters to ours
+    void    read_kernel_stats();
+
+    // This is the body of the monitor thread
+    void    run(int dump_count, int max_reports);
+
+    // The interface we're watching, the AF_PACKET socket, and the ring it shares with the kernel
+    std::string m_iface;
+    int         m_sd;
+    uint8_t*    m_ring;
+    size_t      m_ring_len;
+
+    // The block we're reading (or -1), the next frame in it, and how many of its frames are left
+    int         m_block;
+    int         m_next_block;
+    uint8_t*    m_frame;
+    uint32_t    m_frames_left;
+
+    // The one's complement sum over a buffer that the checksums are computed with, and its name
+    uint64_t    (*m_kernel)(const uint8_t* data, size_t length);
+    const char* m_kernel_name;
+
+    // The monitor thread, and the flag that tells it to stop
+    std::thread         m_thread;
+    std::atomic<bool>   m_stopped{false};
+};
+//==========================================================================================================
@@ -0,0 +1,237 @@
+//==========================================================================================================
+// payload_verifier.cpp - Implements a checker that compares RDMA payloads against the data_generator
+//                        pattern
+//==========================================================================================================
+#include <stdio.h>
+#include <string.h>
+#include <immintrin.h>
+#include "payload_verifier.h"
+#include "rdma.h"
+using namespace std;
+
+
+//==========================================================================================================
+// mismatch_scalar() - Compares words against the pattern one at a time
+//
+// Passed:  data  = the words to check.  They don't have to be aligned
+//          count = the number of words to check
+//          first = the value the first word should have.  Each following word is one more
+//
+// Returns: the index of the first word that doesn't match, or "count" if they all do
+//==========================================================================================================
+static size_t mismatch_scalar(const uint8_t* data, size_t count, uint32_t first)
+{
+    for (size_t i=0; i<count; ++i)
+    {
+        uint32_t word;
+        memcpy(&word, data + i * 4, sizeof word);
+        if (word != first + (uint32_t)i) return i;
+    }
+    return count;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// mismatch_avx2() - Compares words against the pattern 8 at a time
+//==========================================================================================================
+__attribute__((target("avx2")))
+static size_t mismatch_avx2(const uint8_t* data, size_t count, uint32_t first)
+{
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i expected = _mm256_add_epi32(_mm256_set1_epi32(first), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i  actual = _mm256_loadu_si256((const __m256i*)(data + i * 4));
+        uint32_t match  = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(actual, expected)));
+        if (match != 0xFF) return i + __builtin_ctz(~match);
+        expected = _mm256_add_epi32(expected, step);
+    }
+
+    // Finish off the last few words
+    return i + mismatch_scalar(data + i * 4, count - i, first + i);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// mismatch_avx512() - Compares words against the pattern 16 at a time
+//==========================================================================================================
+__attribute__((target("avx512f")))
+static size_t mismatch_avx512(const uint8_t* data, size_t count, uint32_t first)
+{
+    const __m512i step = _mm512_set1_epi32(16);
+    __m512i expected = _mm512_add_epi32(_mm512_set1_epi32(first),
+                                        _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512i   actual   = _mm512_loadu_si512(data + i * 4);
+        __mmask16 mismatch = _mm512_cmpneq_epi32_mask(actual, expected);
+        if (mismatch) return i + __builtin_ctz(mismatch);
+        expected = _mm512_add_epi32(expected, step);
+    }
+
+    // Finish off the last few words
+    return i + mismatch_scalar(data + i * 4, count - i, first + i);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// configure() - Sets the pattern to check against, and picks the kernel that checks it
+//
+// Passed:  initial_value = the 32-bit word at RDMA address "base_addr" (REG_INITIAL_VALUE)
+//          base_addr     = the RDMA address where the pattern starts
+//          isa           = "scalar", "avx2" or "avx512" to force a kernel, or NULL for the fastest one
+//
+// Returns: false if the requested kernel isn't known, or this CPU can't run it
+//==========================================================================================================
+bool PayloadVerifier::configure(uint32_t initial_value, uint64_t base_addr, const char* isa)
+{
+    m_initial_value = initial_value;
+    m_base_addr     = base_addr;
+
+    bool has_avx512 = __builtin_cpu_supports("avx512f");
+    bool has_avx2   = __builtin_cpu_supports("avx2");
+
+    // If we haven't been told which kernel to use, use the widest one the CPU has
+    if (isa == NULL) isa = has_avx512 ? "avx512" : has_avx2 ? "avx2" : "scalar";
+
+    if (strcmp(isa, "avx512") == 0 && has_avx512)
+        m_kernel = mismatch_avx512;
+    else if (strcmp(isa, "avx2") == 0 && has_avx2)
+        m_kernel = mismatch_avx2;
+    else if (strcmp(isa, "scalar") == 0)
+        m_kernel = mismatch_scalar;
+    else
+        return false;
+
+    m_kernel_name = isa;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// check() - Compares a payload against the pattern
+//
+// Passed:  target_addr = the RDMA address of the first byte of the payload
+//          payload     = the payload
+//          length      = the length of the payload in bytes
+//
+// Returns: the offset of the first byte that doesn't match, or -1 if they all do
+//==========================================================================================================
+int64_t PayloadVerifier::check(uint64_t target_addr, const void* payload, size_t length) const
+{
+    const uint8_t* data   = (const uint8_t*)payload;
+    uint64_t       offset = target_addr - m_base_addr;
+
+    // Returns the byte of the pattern that belongs at a given offset from the start of the pattern
+    auto pattern_byte = [this](uint64_t offset) -> uint8_t
+    {
+        return (uint32_t)(m_initial_value + offset / 4) >> ((offset % 4) * 8);
+    };
+
+    // If the payload doesn't start on a word boundary, check the bytes up to the first one
+    size_t head = (4 - offset % 4) % 4;
+    if (head > length) head = length;
+    for (size_t i=0; i<head; ++i)
+    {
+        if (data[i] != pattern_byte(offset + i)) return i;
+    }
+
+    // Check the whole words with the vector kernel
+    size_t   words = (length - head) / 4;
+    uint32_t first = m_initial_value + (offset + head) / 4;
+    size_t   bad   = m_kernel(data + head, words, first);
+
+    // If a word didn't match, find the first byte within it that doesn't
+    size_t i = head + bad * 4;
+    size_t end = (bad < words) ? i + 4 : length;
+
+    // Either way, check the bytes from there up to the end of that word (or of the payload)
+    for (; i<end; ++i)
+    {
+        if (data[i] != pattern_byte(offset + i)) return i;
+    }
+
+    // Everything matched
+    return -1;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// verify() - Checks the payload of an RDMA packet against the pattern and counts the result
+//
+// Passed:  packet = the packet, starting with its RDMA header
+//          length = the length of the packet in bytes
+//          stats  = the counters to update
+//
+// Returns: true if the payload matched the pattern (or there was no payload)
+//==========================================================================================================
+bool PayloadVerifier::verify(const void* packet, int length, verify_stats_t& stats) const
+{
+    // A packet with no payload has nothing to check
+    if (length <= RDMA_HDR_LEN) return true;
+
+    const rdma_header_t* header = (const rdma_header_t*)packet;
+    uint64_t target_addr = header->target_addr();
+    int      payload_len = length - RDMA_HDR_LEN;
+
+    bump(stats.packets);
+    bump(stats.bytes, payload_len);
+
+    int64_t bad = check(target_addr, header + 1, payload_len);
+    if (bad < 0) return true;
+
+    // Remember where the first bad packet was
+    if (stats.bad_packets.load(memory_order_relaxed) == 0)
+    {
+        stats.first_bad_addr.store(target_addr, memory_order_relaxed);
+        stats.first_bad_offset.store(bad, memory_order_relaxed);
+    }
+    bump(stats.bad_packets);
+    return false;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays the counters of one or more workers
+//==========================================================================================================
+void PayloadVerifier::show_summary(verify_stats_t** stats, int count) const
+{
+    uint64_t packets = 0, bytes = 0, bad = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        packets += stats[i]->packets.load(memory_order_relaxed);
+        bytes   += stats[i]->bytes.load(memory_order_relaxed);
+        bad     += stats[i]->bad_packets.load(memory_order_relaxed);
+    }
+
+    printf("verify    : %llu payloads (%llu bytes) checked with %s, %llu bad\n", (unsigned long long)packets,
+           (unsigned long long)bytes, m_kernel_name, (unsigned long long)bad);
+
+    // Show where each worker first saw bad data
+    for (int i=0; i<count; ++i)
+    {
+        if (stats[i]->bad_packets.load(memory_order_relaxed) == 0) continue;
+        uint64_t addr   = stats[i]->first_bad_addr.load(memory_order_relaxed);
+        uint64_t offset = stats[i]->first_bad_offset.load(memory_order_relaxed);
+        printf("            worker %d: first bad byte at offset %llu of the payload for 0x%llx (address 0x%llx)\n",
+               i, (unsigned long long)offset, (unsigned long long)addr, (unsigned long long)(addr + offset));
+    }
+}
+//==========================================================================================================
@@ -0,0 +1,77 @@
+//==========================================================================================================
+// payload_verifier.h - Defines a checker that compares RDMA payloads against the data_generator pattern
+//
+// data_generator.v fills RAM with consecutive little-endian 32-bit words, starting with REG_INITIAL_VALUE
+// at the start of RAM, so the word at any address is known in advance:
+//
+//     word(address) = initial_value + (address - base_addr) / 4
+//
+// rdma_send fills its memory region the same way, with an initial value of 0.  Given the target address
+// in its RDMA header, every byte of a payload can therefore be checked.  The comparison runs 16 words at
+// a time with AVX-512 or 8 at a time with AVX2, whichever the CPU has, with a scalar fallback.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "stats.h"
+
+//==========================================================================================================
+// verify_stats_t - Counters for the payloads one worker has checked, written by that worker's thread
+//==========================================================================================================
+struct alignas(64) verify_stats_t
+{
+    std::atomic<uint64_t>   packets{0};
+    std::atomic<uint64_t>   bytes{0};
+    std::atomic<uint64_t>   bad_packets{0};
+
+    // Where the first bad packet was found: its target address, and the offset of the first bad byte
+    // within its payload
+    std::atomic<uint64_t>   first_bad_addr{0};
+    std::atomic<uint64_t>   first_bad_offset{0};
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// PayloadVerifier - Checks RDMA payloads against the pattern written by data_generator.v
+//==========================================================================================================
+class PayloadVerifier
+{
+public:
+
+    // Constructor, expects the pattern that rdma_send writes, and picks the fastest kernel for this CPU
+    PayloadVerifier() {configure(0, 0);}
+
+    // Sets the pattern: "initial_value" is the word at RDMA address "base_addr".  "isa" may force the
+    // "scalar", "avx2" or "avx512" kernel, otherwise the fastest one this CPU supports is used
+    bool    configure(uint32_t initial_value, uint64_t base_addr, const char* isa = NULL);
+
+    // Returns the offset of the first byte of a payload that doesn't match the pattern, or -1 if it
+    // all matches
+    int64_t check(uint64_t target_addr, const void* payload, size_t length) const;
+
+    // Checks the payload of an RDMA packet and counts the result.  Returns false if it didn't match
+    bool    verify(const void* packet, int length, verify_stats_t& stats) const;
+
+    // Returns the name of the kernel in use
+    const char* kernel_name() const {return m_kernel_name;}
+
+    // Displays the counters of one or more workers
+    void    show_summary(verify_stats_t** stats, int count) const;
+
+protected:
+
+    // A kernel compares "count" words against the pattern starting at "first", and returns the index
+    // of the first word that doesn't match, or "count" if they all do
+    typedef size_t (*kernel_t)(const uint8_t* data, size_t count, uint32_t first);
+
+    // The pattern
+    uint32_t    m_initial_value;
+    uint64_t    m_base_addr;
+
+    // The kernel we're using, and its name
+    kernel_t    m_kernel;
+    const char* m_kernel_name;
+};
+//==========================================================================================================
@@ -0,0 +1,410 @@
+//==========================================================================================================
+// pcap.cpp - Implements a writer and a reader for pcap capture files of RDMA traffic
+//==========================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include "pcap.h"
+using namespace std;
+
+// Magic numbers at the start of a capture file with microsecond and nanosecond timestamps
+static const uint32_t PCAP_MAGIC_US = 0xa1b2c3d4;
+static const uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+
+// The link-layer types we understand: Ethernet, and bare IP packets (two different codes)
+static const uint32_t LINKTYPE_ETHERNET = 1;
+static const uint32_t LINKTYPE_RAW      = 101;
+static const uint32_t LINKTYPE_IPV4     = 228;
+
+// The largest record we'll write
+static const uint32_t PCAP_SNAPLEN = 65535;
+
+//==========================================================================================================
+// pcap_file_header_t - The header at the start of a capture file
+//==========================================================================================================
+struct pcap_file_header_t
+{
+    uint32_t    magic;
+    uint16_t    version_major;
+    uint16_t    version_minor;
+    int32_t     thiszone;
+    uint32_t    sigfigs;
+    uint32_t    snaplen;
+    uint32_t    linktype;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// pcap_record_t - The header in front of each captured packet
+//==========================================================================================================
+struct pcap_record_t
+{
+    uint32_t    ts_sec;
+    uint32_t    ts_frac;
+    uint32_t    caplen;
+    uint32_t    len;
+};
+//==========================================================================================================
+
+
+// Every record we write has a synthesized IPv4 and UDP header in front of the payload
+static const int SYNTH_HDR_LEN = sizeof(iphdr) + sizeof(udphdr);
+
+
+
+//==========================================================================================================
+// create() - Creates, preallocates and maps a capture file
+//
+// Passed:  filename = the name of the file to create.  An existing file is overwritten
+//          size     = the size to preallocate.  Capturing stops when the file is full
+//          port     = the UDP destination port that the records will show
+//
+// Returns: true on success
+//==========================================================================================================
+bool PcapWriter::create(string filename, size_t size, int port)
+{
+    // There has to be room for the file header
+    if (size < sizeof(pcap_file_header_t)) return false;
+
+    // Create the file and reserve the disk space for it, so that writing into the mapping can't fail
+    m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) return false;
+    if (posix_fallocate(m_fd, 0, size) != 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    // Map the entire file up front, so that capturing never has to wait on a page fault
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_filename = filename;
+    m_map      = (uint8_t*)map;
+    m_size     = size;
+    m_port     = port;
+
+    // Write the file header
+    pcap_file_header_t header = {PCAP_MAGIC_NS, 2, 4, 0, 0, PCAP_SNAPLEN, LINKTYPE_IPV4};
+    memcpy(m_map, &header, sizeof header);
+    m_offset.store(sizeof header, memory_order_relaxed);
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// capture() - Appends a UDP payload to the capture file.  This never makes a system call
+//
+// Passed:  data    = the UDP payload
+//          length  = its length in bytes
+//          time_ns = when it arrived, in CLOCK_REALTIME nanoseconds
+//
+// Returns: true if the packet was captured, false if the file is full or capture has been stopped
+//==========================================================================================================
+bool PcapWriter::capture(const void* data, int length, uint64_t time_ns)
+{
+    uint64_t offset = m_offset.load(memory_order_relaxed);
+
+    // Announce that we're using the mapping, then check whether we've been told to stop
+    m_gate.enter();
+
+    // Make sure there's room for the record
+    if (length + SYNTH_HDR_LEN > PCAP_SNAPLEN) length = PCAP_SNAPLEN - SYNTH_HDR_LEN;
+    uint32_t frame_len = SYNTH_HDR_LEN + length;
+    if (offset + sizeof(pcap_record_t) + frame_len > m_size || m_gate.stopped())
+    {
+        m_gate.leave();
+        bump(m_dropped);
+        return false;
+    }
+
+    // The record header
+    pcap_record_t record;
+    record.ts_sec  = time_ns / 1000000000;
+    record.ts_frac = time_ns % 1000000000;
+    record.caplen  = frame_len;
+    record.len     = frame_len;
+    uint8_t* p = m_map + offset;
+    memcpy(p, &record, sizeof record);
+    p += sizeof record;
+
+    // A minimal IPv4 header
+    iphdr ip = {};
+    ip.version  = 4;
+    ip.ihl      = sizeof(iphdr) / 4;
+    ip.tot_len  = htons(frame_len);
+    ip.ttl      = 64;
+    ip.protocol = IPPROTO_UDP;
+    memcpy(p, &ip, sizeof ip);
+    p += sizeof ip;
+
+    // A UDP header with no checksum
+    udphdr udp = {};
+    udp.dest = htons(m_port);
+    udp.len  = htons(sizeof(udphdr) + length);
+    memcpy(p, &udp, sizeof udp);
+    p += sizeof udp;
+
+    // And the payload itself
+    memcpy(p, data, length);
+
+    // Only now does the record become part of the file
+    m_offset.store(offset + sizeof(pcap_record_t) + frame_len, memory_order_release);
+    m_gate.leave();
+    bump(m_packets);
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// finish() - Stops capturing and trims the file to the records that were completely written.  This can be
+//            called from any thread while the capturing thread is still running
+//==========================================================================================================
+void PcapWriter::finish()
+{
+    if (m_fd < 0 || m_map == NULL) return;
+
+    // Wait for the capturing thread to finish the record it may be in the middle of.  After that it will
+    // never touch the mapping again, and the file can be trimmed underneath it
+    if (!m_gate.stop()) return;
+
+    // Make sure what we've captured reaches the disk, then trim off the unused space
+    uint64_t length = m_offset.load(memory_order_acquire);
+    msync(m_map, length, MS_SYNC);
+    if (ftruncate(m_fd, length) < 0) perror("ftruncate");
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Trims the file to what was captured, unmaps it and closes it
+//==========================================================================================================
+void PcapWriter::close()
+{
+    if (m_fd < 0) return;
+    finish();
+    if (m_map) munmap(m_map, m_size);
+    ::close(m_fd);
+    m_fd  = -1;
+    m_map = NULL;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Finishes one or more capture files, and displays how much was captured into each
+//==========================================================================================================
+void PcapWriter::show_summary(PcapWriter** writer, int count)
+{
+    for (int i=0; i<count; ++i)
+    {
+        writer[i]->finish();
+        printf("capture   : %llu packets, %llu bytes to %s", (unsigned long long)writer[i]->packets(),
+               (unsigned long long)writer[i]->bytes(), writer[i]->filename().c_str());
+        if (writer[i]->dropped())
+        {
+            printf(", %llu dropped with the file full", (unsigned long long)writer[i]->dropped());
+        }
+        printf("\n");
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// open() - Maps a capture file and checks its header
+//
+// Passed:  filename = the name of the capture file
+//          error    = where to say what went wrong
+//
+// Returns: true on success
+//==========================================================================================================
+bool PcapReader::open(string filename, string* error)
+{
+    // Open the file and find out how big it is
+    struct stat sb;
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0 || fstat(fd, &sb) < 0)
+    {
+        *error = "can't open " + filename;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    // It has to at least hold a file header
+    if (sb.st_size < (off_t)sizeof(pcap_file_header_t))
+    {
+        *error = filename + " is too short to be a capture file";
+        ::close(fd);
+        return false;
+    }
+
+    // Map the whole thing.  The mapping stays valid after the descriptor is closed
+    void* map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        *error = "can't map " + filename;
+        return false;
+    }
+    m_map  = (const uint8_t*)map;
+    m_size = sb.st_size;
+
+    // Check the magic number, which also tells us the timestamp resolution
+    pcap_file_header_t header;
+    memcpy(&header, m_map, sizeof header);
+    if (header.magic == PCAP_MAGIC_NS)
+        m_ns_per_tick = 1;
+    else if (header.magic == PCAP_MAGIC_US)
+        m_ns_per_tick = 1000;
+    else
+    {
+        *error = filename + " isn't a pcap file in this machine's byte order (pcapng isn't supported)";
+        return false;
+    }
+
+    // We need to be able to find the IP header in each record
+    m_linktype = header.linktype;
+    if (m_linktype != LINKTYPE_ETHERNET && m_linktype != LINKTYPE_RAW && m_linktype != LINKTYPE_IPV4)
+    {
+        *error = filename + " has unsupported link type " + to_string(m_linktype);
+        return false;
+    }
+
+    // Start at the first record
+    rewind();
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Unmaps the file
+//==========================================================================================================
+void PcapReader::close()
+{
+    if (m_map) munmap((void*)m_map, m_size);
+    m_map  = NULL;
+    m_size = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// rewind() - Goes back to the first record in the file
+//==========================================================================================================
+void PcapReader::rewind()
+{
+    m_offset = sizeof(pcap_file_header_t);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// next() - Fetches the next IPv4 UDP payload in the file, skipping over anything else
+//
+// Passed:  packet = where to store the location, length and timestamp of the payload
+//
+// Returns: true if a packet was found, false at the end of the file (or at a truncated record)
+//==========================================================================================================
+bool PcapReader::next(pcap_packet_t* packet)
+{
+    while (m_offset + sizeof(pcap_record_t) <= m_size)
+    {
+        // Fetch the record header, and make sure the whole record is in the file
+        pcap_record_t record;
+        memcpy(&record, m_map + m_offset, sizeof record);
+        const uint8_t* frame = m_map + m_offset + sizeof record;
+        if (m_offset + sizeof record + record.caplen > m_size) return false;
+        m_offset += sizeof record + record.caplen;
+
+        // If this is a UDP packet, hand it to the caller
+        if (find_payload(frame, record.caplen, packet))
+        {
+            packet->time_ns = (uint64_t)record.ts_sec * 1000000000 + (uint64_t)record.ts_frac * m_ns_per_tick;
+            return true;
+        }
+
+        // Otherwise, skip it
+        ++m_skipped;
+    }
+
+    // We're at the end of the file
+    return false;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// find_payload() - Finds the UDP payload in a captured frame
+//
+// Passed:  frame  = the captured bytes
+//          length = the number of captured bytes
+//          packet = where to store the location and length of the payload
+//
+// Returns: true if the frame holds a complete IPv4 UDP packet
+//==========================================================================================================
+bool PcapReader::find_payload(const uint8_t* frame, int length, pcap_packet_t* packet)
+{
+    // Skip past the Ethernet header (and a VLAN tag, if there is one)
+    if (m_linktype == LINKTYPE_ETHERNET)
+    {
+        if (length < 14) return false;
+        uint16_t ethertype = (frame[12] << 8) | frame[13];
+        int header_len = 14;
+        if (ethertype == 0x8100 && length >= 18)
+        {
+            ethertype   = (frame[16] << 8) | frame[17];
+            header_len += 4;
+        }
+        if (ethertype != 0x0800) return false;
+        frame  += header_len;
+        length -= header_len;
+    }
+
+    // This has to be an IPv4 UDP packet that isn't a fragment
+    iphdr ip;
+    if (length < (int)sizeof ip) return false;
+    memcpy(&ip, frame, sizeof ip);
+    int ip_len = ip.ihl * 4;
+    if (ip.version != 4 || ip.protocol != IPPROTO_UDP || ip_len < (int)sizeof ip) return false;
+    if (ntohs(ip.frag_off) & 0x3FFF) return false;
+
+    // The UDP length tells us how big the payload is.  It all has to have been captured
+    udphdr udp;
+    if (length < ip_len + (int)sizeof udp) return false;
+    memcpy(&udp, frame + ip_len, sizeof udp);
+    int payload_len = ntohs(udp.len) - (int)sizeof udp;
+    if (payload_len < 0 || ip_len + (int)sizeof udp + payload_len > length) return false;
+
+    packet->data   = frame + ip_len + sizeof udp;
+    packet->length = payload_len;
+    return true;
+}
+//==========================================================================================================
@@ -0,0 +1,145 @@
+//==========================================================================================================
+// pcap.h - Defines a writer and a reader for pcap capture files of RDMA traffic
+//
+// PcapWriter streams received packets into a capture file that is preallocated and memory-mapped up front,
+// so capturing a packet is a memcpy into the page cache and never a system call.  The kernel writes the
+// pages back to disk in the background.  When the file is full, further packets are counted and dropped.
+// Each record holds a synthesized IPv4 and UDP header followed by the UDP payload, so that the capture can
+// be opened with tcpdump or Wireshark.
+//
+// PcapReader maps an existing capture file (ours, or one taken with tcpdump on an Ethernet interface) and
+// walks through the UDP payloads in it.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include "stats.h"
+#include "writer_gate.h"
+
+// The default size of a capture file
+const size_t PCAP_DEFAULT_SIZE = 256 << 20;
+
+//==========================================================================================================
+// pcap_packet_t - One UDP payload found in a capture file by PcapReader
+//==========================================================================================================
+struct pcap_packet_t
+{
+    const void* data;
+    int         length;
+    uint64_t    time_ns;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// PcapWriter - A preallocated, memory-mapped capture file that exactly one thread writes packets into
+//==========================================================================================================
+class PcapWriter
+{
+public:
+
+    // Constructor, marks the file as closed
+    PcapWriter() {m_fd = -1; m_map = NULL; m_size = 0; m_port = 0;}
+
+    // Destructor - trims the file to what was captured and closes it
+    ~PcapWriter() {close();}
+
+    // Creates a capture file of "size" bytes.  "port" is the UDP destination port that records will show
+    bool    create(std::string filename, size_t size, int port);
+
+    // Trims the file to what was captured and closes it.  Call this from the capturing thread
+    void    close();
+
+    // Stops capturing and trims the file to what was captured.  This can be called from another thread
+    // while the capturing thread is running (see WriterGate for how they hand over)
+    void    finish();
+
+    // Called by the capturing thread to record a UDP payload.  Returns false if the file is full
+    bool    capture(const void* data, int length, uint64_t time_ns);
+
+    // Returns the name of the file
+    std::string filename() const {return m_filename;}
+
+    // Finishes one or more capture files and displays what went into them
+    static void show_summary(PcapWriter** writer, int count);
+
+    // Returns the number of packets and bytes captured, and the number dropped with the file full
+    uint64_t packets() const {return m_packets.load(std::memory_order_relaxed);}
+    uint64_t bytes()   const {return m_offset.load(std::memory_order_relaxed);}
+    uint64_t dropped() const {return m_dropped.load(std::memory_order_relaxed);}
+
+protected:
+
+    // The file, and where it's mapped
+    std::string m_filename;
+    int         m_fd;
+    uint8_t*    m_map;
+    size_t      m_size;
+
+    // The UDP destination port written into each record
+    int         m_port;
+
+    // The end of the last complete record.  Written by the capturing thread only
+    std::atomic<uint64_t> m_offset{0};
+
+    // Counters, written by the capturing thread only
+    std::atomic<uint64_t> m_packets{0};
+    std::atomic<uint64_t> m_dropped{0};
+
+    // Lets finish() stop the capturing thread from writing into the mapping
+    WriterGate  m_gate;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// PcapReader - Walks through the UDP payloads in a memory-mapped capture file
+//==========================================================================================================
+class PcapReader
+{
+public:
+
+    // Constructor, marks the file as closed
+    PcapReader() {m_map = NULL; m_size = 0; m_offset = 0; m_linktype = 0; m_ns_per_tick = 0; m_skipped = 0;}
+
+    // Destructor - unmaps the file
+    ~PcapReader() {close();}
+
+    // Maps a capture file and checks its header.  On failure, "error" says why
+    bool    open(std::string filename, std::string* error);
+
+    // Unmaps the file
+    void    close();
+
+    // Fetches the next UDP payload in the file.  Returns false at the end of the file
+    bool    next(pcap_packet_t* packet);
+
+    // Goes back to the first packet in the file
+    void    rewind();
+
+    // Returns the number of records that weren't IPv4 UDP packets and were skipped
+    uint64_t skipped() const {return m_skipped;}
+
+protected:
+
+    // Finds the UDP payload in a captured frame.  Returns false if it isn't an IPv4 UDP packet
+    bool    find_payload(const uint8_t* frame, int length, pcap_packet_t* packet);
+
+    // The mapping of the file
+    const uint8_t* m_map;
+    size_t      m_size;
+
+    // The offset of the next record
+    size_t      m_offset;
+
+    // The link-layer type of every record
+    uint32_t    m_linktype;
+
+    // 1 for a nanosecond-resolution file, 1000 for a microsecond-resolution one
+    uint32_t    m_ns_per_tick;
+
+    // The number of records we've skipped
+    uint64_t    m_skipped;
+};
+//==========================================================================================================
@@ -0,0 +1,342 @@
+//==========================================================================================================
+// pcibar.cpp - Implements direct access to the FPGA's AXI registers through its PCIe BAR
+//==========================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcibar.h"
+using namespace std;
+
+// The flag in a sysfs "resource" line that marks a memory (rather than I/O port) BAR
+const unsigned long IORESOURCE_MEM = 0x200;
+
+
+//==========================================================================================================
+// read_hex_file() - Reads a sysfs attribute that holds a hex number, such as "vendor"
+//
+// Returns: the number, or -1 if the file can't be read
+//==========================================================================================================
+static long read_hex_file(const string& filename)
+{
+    long value = -1;
+    FILE* fp = fopen(filename.c_str(), "r");
+    if (fp == NULL) return -1;
+    if (fscanf(fp, "%li", &value) != 1) value = -1;
+    fclose(fp);
+    return value;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// find_device() - Finds the sysfs directory of the first 10EE:903F device
+//
+// Returns: the directory, or an empty string if there's no such device
+//==========================================================================================================
+static string find_device()
+{
+    const string root = "/sys/bus/pci/devices/";
+    string result;
+
+    DIR* dir = opendir(root.c_str());
+    if (dir == NULL) return result;
+
+    while (dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.') continue;
+        string device = root + entry->d_name;
+        if (read_hex_file(device + "/vendor") == FPGA_VENDOR_ID &&
+            read_hex_file(device + "/device") == FPGA_DEVICE_ID)
+        {
+            result = device;
+            break;
+        }
+    }
+
+    closedir(dir);
+    return result;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// open_device() - Maps the first memory BAR of the FPGA
+//
+// Passed:  error  = where to say what went wrong
+//          device = the sysfs directory of the device, or empty to find the first 10EE:903F device
+//
+// Returns: true on success
+//==========================================================================================================
+bool PciBar::open_device(string* error, string device)
+{
+    unsigned long long start, end, flags;
+
+    // Find the device if we haven't been told where it is
+    if (device.empty()) device = find_device();
+    if (device.empty())
+    {
+        *error = "no 10EE:903F device found in /sys/bus/pci/devices";
+        return false;
+    }
+
+    // Each line of "resource" describes one BAR.  We want the first memory BAR
+    FILE* fp = fopen((device + "/resource").c_str(), "r");
+    if (fp == NULL)
+    {
+        *error = "can't read " + device + "/resource";
+        return false;
+    }
+    int    bar  = -1;
+    size_t size = 0;
+    for (int i=0; i<6 && fscanf(fp, "%lli %lli %lli", &start, &end, &flags) == 3; ++i)
+    {
+        if (end > start && (flags & IORESOURCE_MEM))
+        {
+            bar  = i;
+            size = end - start + 1;
+            break;
+        }
+    }
+    fclose(fp);
+    if (bar < 0)
+    {
+        *error = device + " contains no memory-mappable resources";
+        return false;
+    }
+
+    // And map it.  This requires root
+    string filename = device + "/resource" + to_string(bar);
+    int fd = ::open(filename.c_str(), O_RDWR | O_SYNC);
+    if (fd < 0)
+    {
+        *error = "can't open " + filename + " (are you root?)";
+        return false;
+    }
+    return map(fd, size, error);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// open_file() - Maps an ordinary file in place of the BAR
+//
+// Passed:  filename = the file.  If it doesn't exist, it's created
+//          error    = where to say what went wrong
+//          size     = how big to make the file if it's shorter than this
+//
+// Returns: true on success
+//==========================================================================================================
+bool PciBar::open_file(string filename, string* error, size_t size)
+{
+    struct stat sb;
+
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &sb) < 0)
+    {
+        *error = "can't open " + filename;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    // Make sure it's big enough to hold every register we know about
+    if (sb.st_size < (off_t)size && ftruncate(fd, size) < 0)
+    {
+        *error = "can't extend " + filename;
+        ::close(fd);
+        return false;
+    }
+    if (sb.st_size > (off_t)size) size = sb.st_size;
+
+    return map(fd, size, error);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// map() - Maps an open file descriptor and closes it
+//==========================================================================================================
+bool PciBar::map(int fd, size_t size, string* error)
+{
+    close();
+
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        *error = "can't map the BAR";
+        return false;
+    }
+
+    m_base = (uint8_t*)p;
+    m_size = size;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Unmaps the BAR
+//==========================================================================================================
+void PciBar::close()
+{
+    if (m_base) munmap(m_base, m_size);
+    m_base = NULL;
+    m_size = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// read64() - Reads a 64-bit value from a pair of 32-bit registers, upper half at "offset"
+//==========================================================================================================
+uint64_t PciBar::read64(uint32_t offset) const
+{
+    uint64_t upper = read32(offset);
+    uint64_t lower = read32(offset + 4);
+    return (upper << 32) | lower;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// write64() - Writes a 64-bit value to a pair of 32-bit registers, upper half at "offset"
+//==========================================================================================================
+void PciBar::write64(uint32_t offset, uint64_t value)
+{
+    write32(offset,     value >> 32);
+    write32(offset + 4, value & 0xFFFFFFFF);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// write() - Writes a batch of registers in order, then waits until the FPGA has seen them all
+//
+// Passed:  list  = the offsets and values to write
+//          count = how many there are
+//
+// Returns: true on success, false if any of the offsets is invalid
+//==========================================================================================================
+bool PciBar::write(const reg_write_t* list, int count)
+{
+    for (int i=0; i<count; ++i) if (!is_valid(list[i].offset)) return false;
+    for (int i=0; i<count; ++i) write32(list[i].offset, list[i].value);
+    flush();
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// read() - Reads a batch of registers in order
+//
+// Passed:  offset = the offsets of the registers to read
+//          value  = where to store what they hold
+//          count  = how many there are
+//
+// Returns: true on success, false if any of the offsets is invalid
+//==========================================================================================================
+bool PciBar::read(const uint32_t* offset, uint32_t* value, int count) const
+{
+    for (int i=0; i<count; ++i) if (!is_valid(offset[i])) return false;
+    for (int i=0; i<count; ++i) value[i] = read32(offset[i]);
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// to_string() - Returns the revision of the bitstream as text, e.g. "1.0.0-rc0 (25-Oct-2023)"
+//==========================================================================================================
+string AxiRevision::to_string() const
+{
+    static const char* month_name[] = {"???", "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    char text[64];
+
+    uint32_t packed = date();
+    uint32_t month  = packed >> 24;
+    uint32_t day    = (packed >> 16) & 0xFF;
+    uint32_t year   = packed & 0xFFFF;
+    if (month > 12) month = 0;
+
+    snprintf(text, sizeof text, "%u.%u.%u-rc%u (%02u-%s-%u)", major(), minor(), build(), candidate(),
+             day, month_name[month], year);
+    return text;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// start_write() - Starts filling RAM with RDMA packets
+//
+// Passed:  packet_size   = the size of each packet, a power of 2 from 64 to 8192
+//          initial_value = the 32-bit word to write at RAM offset 0.  Each following word is one more
+//          delay         = clock cycles to wait between packets.  25000 is 100 usec
+//==========================================================================================================
+void DataGenerator::start_write(uint32_t packet_size, uint32_t initial_value, uint32_t delay)
+{
+    const reg_write_t batch[] =
+    {
+        {DATA_GEN_BASE + REG_INITIAL_VALUE, initial_value},
+        {DATA_GEN_BASE + REG_WRITE_DELAY,   delay},
+        {DATA_GEN_BASE + REG_START_WRITE,   packet_size}
+    };
+
+    m_bar.write(batch, 3);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// self_test() - Fills RAM with RDMA packets, reads it back, and checks it.  This is run_test() from
+//               utils/selftest.sh
+//
+// Passed:  packet_size   = the size of each packet, a power of 2 from 64 to 8192
+//          initial_value = the 32-bit word to write at RAM offset 0
+//          delay         = clock cycles to wait between packets
+//          timeout_ms    = how long to wait for each phase to finish
+//          poll_us       = microseconds between polls
+//
+// Returns: true if the read-back found what was written
+//==========================================================================================================
+bool DataGenerator::self_test(uint32_t packet_size, uint32_t initial_value, uint32_t delay,
+                              int timeout_ms, int poll_us)
+{
+    int polls = (int64_t)timeout_ms * 1000 / poll_us;
+
+    // Fill RAM and wait for it to finish
+    start_write(packet_size, initial_value, delay);
+    for (int i=0; !write_done(); ++i)
+    {
+        if (i == polls) return false;
+        usleep(poll_us);
+    }
+
+    // Read it back and wait for the check to finish
+    start_read_back();
+    uint32_t status;
+    for (int i=0; ((status = read_back_status()) & READ_BACK_IDLE) == 0; ++i)
+    {
+        if (i == polls) return false;
+        usleep(poll_us);
+    }
+
+    return (status & READ_BACK_OK) != 0;
+}
+//==========================================================================================================
@@ -0,0 +1,264 @@
+//==========================================================================================================
+// pcibar.h - Defines direct access to the FPGA's AXI registers through its PCIe BAR
+//
+// The BAR of the 10EE:903F device is mapped once, after which every register read or write is a single
+// load or store, rather than a fork/exec of "pcireg" and an mmap of the BAR per register.  The BAR can
+// also be stood in for by an ordinary file, so code that drives the registers can be tried out without
+// the board.
+//
+// The register blocks are at these offsets within the BAR (see design_1.bd):
+//
+//     0x00000  axi_revision       major/minor/build/release-candidate/date of the bitstream
+//     0x00500  axi_eth_status     QSFP channel-up, overrun and dropped-packet flags
+//     0x00600  data_generator     fills remote RAM with RDMA packets, and reads it back to check it
+//     0x10000  Ethernet core 0    Xilinx 100G Ethernet subsystem registers for QSFP port 0
+//     0x20000  Ethernet core 1    ... and for QSFP port 1
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// The PCI vendor and device ID of the FPGA
+const uint16_t FPGA_VENDOR_ID = 0x10EE;
+const uint16_t FPGA_DEVICE_ID = 0x903F;
+
+// Where each register block lives in the BAR
+const uint32_t REVISION_BASE   = 0x00000;
+const uint32_t ETH_STATUS_BASE = 0x00500;
+const uint32_t DATA_GEN_BASE   = 0x00600;
+const uint32_t ETH_CORE0_BASE  = 0x10000;
+const uint32_t ETH_CORE1_BASE  = 0x20000;
+
+// How big a file stands in for the BAR, enough to hold every register block above
+const size_t   PCIBAR_FILE_SIZE = 0x30000;
+
+//==========================================================================================================
+// reg_write_t - One register write in a batch
+//==========================================================================================================
+struct reg_write_t
+{
+    uint32_t    offset;
+    uint32_t    value;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// PciBar - A mapping of the FPGA's BAR, with 32 and 64-bit register accessors
+//==========================================================================================================
+class PciBar
+{
+public:
+
+    // Constructor, marks the BAR as unmapped
+    PciBar() {m_base = NULL; m_size = 0;}
+
+    // Destructor - unmaps the BAR
+    ~PciBar() {close();}
+
+    // Maps BAR 0 of the first 10EE:903F device, or of the device at a sysfs path such as
+    // /sys/bus/pci/devices/0000:01:00.0.  On failure, "error" says why
+    bool    open_device(std::string* error, std::string device = "");
+
+    // Maps a file in place of the BAR, creating it (zero-filled, "size" bytes) if it doesn't exist
+    bool    open_file(std::string filename, std::string* error, size_t size = PCIBAR_FILE_SIZE);
+
+    // Unmaps the BAR
+    void    close();
+
+    // Returns true if the BAR is mapped, and how many bytes of it are
+    bool    is_open() const {return m_base != NULL;}
+    size_t  size() const {return m_size;}
+
+    // Returns true if "offset" is a 4-byte aligned register that lies wholly inside the BAR
+    bool    is_valid(uint32_t offset) const {return offset % 4 == 0 && (size_t)offset + 4 <= m_size;}
+
+    // Reads or writes one 32-bit register.  An invalid offset reads as all ones, like a device that isn't
+    // responding, and a write to one is ignored
+    uint32_t read32(uint32_t offset) const
+    {
+        return is_valid(offset) ? *(volatile uint32_t*)(m_base + offset) : 0xFFFFFFFF;
+    }
+    void    write32(uint32_t offset, uint32_t value)
+    {
+        if (is_valid(offset)) *(volatile uint32_t*)(m_base + offset) = value;
+    }
+
+    // Reads or writes a 64-bit value held in a pair of 32-bit registers, upper half first (the order
+    // that scripts/esend uses).  AXI4-Lite is 32 bits wide, so the halves are separate transactions
+    uint64_t read64(uint32_t offset) const;
+    void    write64(uint32_t offset, uint64_t value);
+
+    // Writes a batch of registers in order, then waits until the FPGA has seen them all.  Returns false,
+    // having written nothing, if any offset is invalid
+    bool    write(const reg_write_t* list, int count);
+
+    // Reads a batch of registers in order.  Returns false, having read nothing, if any offset is invalid
+    bool    read(const uint32_t* offset, uint32_t* value, int count) const;
+
+    // Writes to a BAR are posted.  Reading a register waits until every earlier write has landed
+    void    flush() const {read32(REVISION_BASE);}
+
+protected:
+
+    // Maps "size" bytes of an open file descriptor
+    bool    map(int fd, size_t size, std::string* error);
+
+    // The mapped BAR
+    uint8_t*    m_base;
+    size_t      m_size;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// AxiRevision - The read-only registers that identify the bitstream
+//==========================================================================================================
+class AxiRevision
+{
+public:
+
+    explicit AxiRevision(PciBar& bar) : m_bar(bar) {}
+
+    uint32_t major()     const {return m_bar.read32(REVISION_BASE + 0x00);}
+    uint32_t minor()     const {return m_bar.read32(REVISION_BASE + 0x04);}
+    uint32_t build()     const {return m_bar.read32(REVISION_BASE + 0x08);}
+    uint32_t candidate() const {return m_bar.read32(REVISION_BASE + 0x0C);}
+
+    // The build date is packed as (month << 24) | (day << 16) | year
+    uint32_t date()      const {return m_bar.read32(REVISION_BASE + 0x10);}
+
+    // Returns e.g. "1.0.0-rc0 (25-Oct-2023)"
+    std::string to_string() const;
+
+protected:
+    PciBar& m_bar;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// EthStatus - The axi_eth_status block: one status word covering both QSFP channels
+//==========================================================================================================
+class EthStatus
+{
+public:
+
+    // Bit positions in the status word.  Channel 1's bits are channel 0's shifted left 16
+    enum {CHANNEL_UP = 0, OVERRUN = 1, PKT_DROPPED = 2};
+
+    explicit EthStatus(PciBar& bar) : m_bar(bar) {}
+
+    // Returns the whole status word
+    uint32_t status() const {return m_bar.read32(ETH_STATUS_BASE);}
+
+    // Returns one flag for a QSFP channel (0 or 1)
+    bool    flag(int channel, int bit) const {return (status() >> (channel * 16 + bit)) & 1;}
+    bool    channel_up(int channel) const {return flag(channel, CHANNEL_UP);}
+
+    // The overrun flags latch.  This clears them for every channel whose overrun has gone away
+    void    clear_overruns() {m_bar.write32(ETH_STATUS_BASE, (1 << OVERRUN) | (1 << (16 + OVERRUN)));}
+
+protected:
+    PciBar& m_bar;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// EthCore - The registers of one Xilinx 100G Ethernet core that utils/selftest.sh uses
+//==========================================================================================================
+class EthCore
+{
+public:
+
+    // Register offsets within the core
+    enum
+    {
+        RESET              = 0x0004,
+        CONFIG_TX          = 0x000C,
+        CONFIG_RX          = 0x0014,
+        LOOPBACK           = 0x0090,
+        STAT_RX            = 0x0204,
+        TICK               = 0x02B0,
+        STAT_RX_TOTAL_PKTS = 0x0608,
+        STAT_RX_BAD_FCS    = 0x06C0,
+        RSFEC_CONFIG_IC    = 0x1000,
+        RSFEC_CONFIG       = 0x107C
+    };
+
+    // STAT_RX reads this when the PCS is aligned
+    static const uint32_t PCS_ALIGNED = 3;
+
+    EthCore(PciBar& bar, int port) : m_bar(bar), m_base(port ? ETH_CORE1_BASE : ETH_CORE0_BASE) {}
+
+    uint32_t read(uint32_t reg) const         {return m_bar.read32(m_base + reg);}
+    void    write(uint32_t reg, uint32_t value) {m_bar.write32(m_base + reg, value);}
+
+    // Returns true if the PCS is aligned
+    bool    is_aligned() const {return read(STAT_RX) == PCS_ALIGNED;}
+
+    // Latches the statistics counters, so they can be read
+    void    tick() {write(TICK, 1);}
+
+    // Returns the latched statistics counters
+    uint32_t rx_packets() const {return read(STAT_RX_TOTAL_PKTS);}
+    uint32_t rx_bad_fcs() const {return read(STAT_RX_BAD_FCS);}
+
+protected:
+    PciBar&     m_bar;
+    uint32_t    m_base;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// DataGenerator - The data_generator block, which fills remote RAM with RDMA packets and checks it
+//==========================================================================================================
+class DataGenerator
+{
+public:
+
+    // Register offsets within the block
+    enum
+    {
+        REG_INITIAL_VALUE = 0x00,
+        REG_WRITE_DELAY   = 0x04,
+        REG_START_WRITE   = 0x08,
+        REG_READ_BACK     = 0x0C,
+        REG_NARROW_WRITE  = 0x10,
+        REG_PACKETS_RCVD  = 0x14
+    };
+
+    // The bits of REG_READ_BACK
+    enum {READ_BACK_IDLE = 1, READ_BACK_OK = 2};
+
+    explicit DataGenerator(PciBar& bar) : m_bar(bar) {}
+
+    // Starts filling RAM with RDMA packets of "packet_size" bytes (a power of 2 from 64 to 8192), the
+    // first word being "initial_value", with "delay" clock cycles between packets
+    void    start_write(uint32_t packet_size, uint32_t initial_value, uint32_t delay);
+
+    // Returns true when the RAM fill has finished
+    bool    write_done() const {return m_bar.read32(DATA_GEN_BASE + REG_START_WRITE) == 1;}
+
+    // Starts reading RAM back to check it
+    void    start_read_back() {m_bar.write32(DATA_GEN_BASE + REG_READ_BACK, 1);}
+
+    // Returns the REG_READ_BACK bits
+    uint32_t read_back_status() const {return m_bar.read32(DATA_GEN_BASE + REG_READ_BACK);}
+
+    // Runs a complete fill and read-back, polling every "poll_us" microseconds for up to "timeout_ms".
+    // Returns true if RAM held what was written
+    bool    self_test(uint32_t packet_size, uint32_t initial_value, uint32_t delay,
+                      int timeout_ms = 10000, int poll_us = 100);
+
+    // Returns the packets received since the count was last cleared, and clears it
+    uint32_t packets_received() const {return m_bar.read32(DATA_GEN_BASE + REG_PACKETS_RCVD);}
+    void    clear_packets_received() {m_bar.write32(DATA_GEN_BASE + REG_PACKETS_RCVD, 0);}
+
+protected:
+    PciBar& m_bar;
+};
+//==========================================================================================================
@@ -0,0 +1,97 @@
+//==========================================================================================================
+// rdma.h - Defines the layout of the RDMA packets generated and consumed by the FPGA
+//
+// An RDMA packet is an ordinary UDP packet whose first 22 bytes of UDP payload are an RDMA header:
+//
+//     2 bytes - magic number (0x0122), big-endian
+//     8 bytes - target address, big-endian
+//    12 bytes - reserved
+//
+// These must match rdma_xmit.v, rdma_recv.v and rdma_pkt_filter.v
+//
+// The FPGA always sends the reserved bytes as zero and ignores them on receive.  Host-side tools use them
+// to carry a sequence number (bytes 0-3), the low 48 bits of a nanosecond send timestamp (bytes 4-9),
+// and a flow-control word (bytes 10-11, see flow_control.h).  A flow-control word of zero means "no flow
+// control", which is what the FPGA and older tools send
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <endian.h>
+
+// The UDP port that RDMA packets are sent to
+const int RDMA_PORT = 32002;
+
+// The magic number in the first two bytes of every RDMA header
+const uint16_t RDMA_MAGIC = 0x0122;
+
+// The number of bytes in an RDMA header (this is the start of the UDP payload)
+const int RDMA_HDR_LEN = 22;
+
+// The largest payload the FPGA will place in a single RDMA packet
+const int RDMA_MAX_PAYLOAD = 8192;
+
+// The largest legal RDMA packet (measured as UDP payload)
+const int RDMA_MAX_PACKET = RDMA_HDR_LEN + RDMA_MAX_PAYLOAD;
+
+// Timestamps in the reserved bytes are this many bits wide
+const uint64_t RDMA_STAMP_MASK = (1ULL << 48) - 1;
+
+// The flow-control word: a data packet whose sender wants credits back, or a credit packet whose low
+// bits are the window granted
+const uint16_t RDMA_FC_DATA   = 0x8000;
+const uint16_t RDMA_FC_CREDIT = 0x4000;
+const uint16_t RDMA_FC_WINDOW = 0x3FFF;
+
+
+//==========================================================================================================
+// rdma_header_t - The RDMA header at the start of the UDP payload.  All fields are big-endian
+//==========================================================================================================
+struct __attribute__((packed)) rdma_header_t
+{
+    uint16_t    magic_be;
+    uint64_t    target_be;
+    uint8_t     reserved[12];
+
+    // Fetch the fields in host byte order
+    uint16_t    magic()       const {return be16toh(magic_be);}
+    uint64_t    target_addr() const {return be64toh(target_be);}
+
+    // Fills in a header for the specified target address
+    void        set(uint64_t target_addr)
+    {
+        magic_be  = htobe16(RDMA_MAGIC);
+        target_be = htobe64(target_addr);
+        for (int i=0; i<12; ++i) reserved[i] = 0;
+    }
+
+    // Fetch or store the sequence number carried in the reserved bytes
+    uint32_t    sequence() const
+    {
+        return ((uint32_t)reserved[0] << 24) | ((uint32_t)reserved[1] << 16) | (reserved[2] << 8) | reserved[3];
+    }
+    void        set_sequence(uint32_t seq)
+    {
+        for (int i=0; i<4; ++i) reserved[i] = seq >> (24 - i*8);
+    }
+
+    // Fetch or store the 48-bit timestamp carried in the reserved bytes
+    uint64_t    timestamp() const
+    {
+        uint64_t stamp = 0;
+        for (int i=4; i<10; ++i) stamp = (stamp << 8) | reserved[i];
+        return stamp;
+    }
+    void        set_timestamp(uint64_t stamp)
+    {
+        for (int i=4; i<10; ++i) reserved[i] = stamp >> ((9 - i) * 8);
+    }
+
+    // Fetch or store the flow-control word carried in the reserved bytes
+    uint16_t    flow() const {return (reserved[10] << 8) | reserved[11];}
+    void        set_flow(uint16_t word)
+    {
+        reserved[10] = word >> 8;
+        reserved[11] = word;
+    }
+};
+//==========================================================================================================
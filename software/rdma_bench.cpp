@@ -0,0 +1,382 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include "udpsock.h"
+#include "stats.h"
+#include "histogram.h"
+#include "pacer.h"
+#include <string>
+#include <vector>
+#include <thread>
+
+using namespace std;
+
+// The IP address and UDP port of the rdma_loop under test
+string dest_ip = "127.0.0.1";
+int    dest_port = RDMA_PORT;
+
+// The UDP port that rdma_loop echoes packets to
+int listen_port = 11111;
+
+// The size of each packet, measured as UDP payload (including the RDMA header)
+int packet_size = 1024;
+
+// The number of packets to send
+uint32_t packet_count = 1000000;
+
+// The transmit rate in Gbit/s.  0 means "as fast as possible"
+double rate_gbps = 1;
+
+// The number of packets handed to the kernel per system call, in each direction
+int batch_size = 1;
+
+// How long to wait for stragglers after the last packet has been sent
+int drain_ms = 1000;
+
+// Milliseconds between throughput reports
+int report_interval_ms = 1000;
+
+// When true, nothing is displayed until the program is stopped
+bool quiet = false;
+
+// Our sockets
+UDPSock sender, receiver;
+
+// Counters for the packets we send, and for the echoes we receive
+packet_stats_t tx_stats, rx_stats;
+
+// Counters for the echoes that tell us about loss and ordering.  These are written only by the receiver
+struct alignas(64) echo_stats_t
+{
+    std::atomic<uint64_t>   unique{0};
+    std::atomic<uint64_t>   duplicates{0};
+    std::atomic<uint64_t>   reordered{0};
+    std::atomic<uint64_t>   foreign{0};
+} echo;
+
+// Round-trip times in nanoseconds, written only by the receiver
+LatencyHistogram rtt;
+
+// One bit per sequence number, set when we receive the echo of that packet
+vector<uint64_t> seen;
+
+// How long it took to send every packet
+std::atomic<int64_t> send_ns{0};
+
+// The thread that reports our counters
+StatsReporter reporter;
+
+void parse_command_line(int argc, char** argv);
+void run_receiver();
+void show_results();
+void on_signal(int);
+
+//============================================================================
+// This program measures the round-trip latency and throughput of an
+// rdma_loop.   It sends RDMA packets that carry a sequence number and a
+// timestamp in their reserved header bytes, and matches up the echoes.
+//
+// To benchmark on a single machine, run rdma_loop with a destination of
+// 127.0.0.1 (or an address on the far side of a veth pair):
+//     rdma_loop [options] 127.0.0.1
+//     rdma_bench [options] 127.0.0.1
+//============================================================================
+int main(int argc, char** argv)
+{
+    // Fetch the options and IP address/port from the command line
+    parse_command_line(argc, argv);
+
+    // Create the socket that we send packets on
+    if (!sender.create_sender(dest_port, dest_ip))
+    {
+        printf("Can't create a socket to send to %s:%d\n", dest_ip.c_str(), dest_port);
+        exit(1);
+    }
+
+    // Create the socket that echoes arrive on
+    if (!receiver.create_server(listen_port))
+    {
+        printf("Can't listen on port %d\n", listen_port);
+        exit(1);
+    }
+
+    // One bit for every packet we're going to send
+    seen.resize(packet_count / 64 + 1);
+
+    // Display a summary when the user hits Ctrl-C
+    signal(SIGINT,  on_signal);
+    signal(SIGTERM, on_signal);
+
+    // Start the thread that reports the throughput of the echoes, and our results at the end
+    reporter.add_summary(show_results);
+    reporter.start(quiet ? 0 : report_interval_ms, {&rx_stats});
+
+    // Start receiving echoes
+    thread(run_receiver).detach();
+
+    // Preallocate one packet buffer per packet in a batch
+    vector<char> buffer((size_t)batch_size * packet_size);
+    vector<udp_packet_t> packet(batch_size);
+    for (int i=0; i<batch_size; ++i)
+    {
+        packet[i].data     = &buffer[(size_t)i * packet_size];
+        packet[i].capacity = packet_size;
+        packet[i].length   = packet_size;
+    }
+
+    // Send all of the packets, a batch at a time
+    Pacer pacer;
+    pacer.set_rate(rate_gbps);
+    pacer.start();
+    int64_t start_ns = Pacer::now_ns();
+    for (uint32_t seq = 0; seq < packet_count;)
+    {
+        int count = min((uint32_t)batch_size, packet_count - seq);
+
+        // Wait until it's time to send this batch
+        pacer.wait((uint64_t)count * packet_size);
+
+        // Stamp each packet with its sequence number and the time it's leaving
+        int64_t now = Pacer::now_ns();
+        for (int i=0; i<count; ++i)
+        {
+            rdma_header_t* header = (rdma_header_t*)packet[i].data;
+            header->set((uint64_t)(seq + i) * (packet_size - RDMA_HDR_LEN));
+            header->set_sequence(seq + i);
+            header->set_timestamp(now);
+        }
+
+        // And send them.  If the kernel runs out of buffers, try again.  Any other error ends the run
+        int sent = sender.send_batch(packet.data(), count);
+        if (sent < 0)
+        {
+            if (errno == ENOBUFS || errno == EAGAIN) continue;
+            perror("send");
+            break;
+        }
+        for (int i=0; i<sent; ++i) tx_stats.count(packet_size);
+        seq += sent;
+    }
+    send_ns = Pacer::now_ns() - start_ns;
+
+    // Give the last of the echoes time to arrive, then have the reporter display the results
+    usleep(drain_ms * 1000);
+    reporter.request_stop();
+    while (true) pause();
+}
+//============================================================================
+
+
+
+//============================================================================
+// run_receiver() - Receives echoes and records their round-trip time,
+//                  and whether they were lost, duplicated or reordered
+//============================================================================
+void run_receiver()
+{
+    const int BUFFER_SIZE = 64 * 1024;
+    vector<char> buffer((size_t)batch_size * BUFFER_SIZE);
+    vector<udp_packet_t> packet(batch_size);
+    int64_t  highest = -1;
+
+    // Build the packet descriptors that point into the buffer
+    for (int i=0; i<batch_size; ++i)
+    {
+        packet[i].data     = &buffer[(size_t)i * BUFFER_SIZE];
+        packet[i].capacity = BUFFER_SIZE;
+    }
+
+    while (true)
+    {
+        // Wait for one or more echoes to arrive
+        int count = receiver.receive_batch(packet.data(), batch_size);
+        if (count < 1) continue;
+        uint64_t now = Pacer::now_ns();
+
+        for (int i=0; i<count; ++i)
+        {
+            const rdma_header_t* header = (const rdma_header_t*)packet[i].data;
+            rx_stats.count(packet[i].length);
+
+            // Ignore anything that isn't one of our packets
+            uint32_t seq = header->sequence();
+            if (packet[i].length < RDMA_HDR_LEN || header->magic() != RDMA_MAGIC || seq >= packet_count)
+            {
+                bump(echo.foreign);
+                continue;
+            }
+
+            // Record the round-trip time.  The timestamp only holds the low 48 bits of the clock
+            rtt.record((now - header->timestamp()) & RDMA_STAMP_MASK);
+
+            // If we've seen this sequence number before, it's a duplicate
+            uint64_t& word = seen[seq / 64];
+            uint64_t  bit  = 1ULL << (seq % 64);
+            if (word & bit)
+            {
+                bump(echo.duplicates);
+                continue;
+            }
+            word |= bit;
+            bump(echo.unique);
+
+            // If a later packet has already arrived, this one was reordered
+            if (seq < highest)
+                bump(echo.reordered);
+            else
+                highest = seq;
+        }
+    }
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_results() - Displays loss, ordering and round-trip time statistics
+//============================================================================
+void show_results()
+{
+    stats_snapshot_t tx;
+    tx.clear();
+    tx_stats.add_to(tx);
+
+    uint64_t unique  = echo.unique;
+    uint64_t lost    = tx.packets - unique;
+    double   seconds = send_ns / 1e9;
+
+    printf("\n");
+    printf("sent      : %llu packets of %d bytes", (unsigned long long)tx.packets, packet_size);
+    if (seconds > 0) printf(" at %.3f Gbit/s", tx.bytes * 8 / seconds / 1e9);
+    printf("\n");
+    printf("echoed    : %llu\n", (unsigned long long)unique);
+    printf("lost      : %llu (%.4f%%)\n", (unsigned long long)lost,
+           tx.packets ? 100.0 * lost / tx.packets : 0.0);
+    printf("reordered : %llu\n", (unsigned long long)echo.reordered.load());
+    printf("duplicate : %llu\n", (unsigned long long)echo.duplicates.load());
+    printf("foreign   : %llu\n", (unsigned long long)echo.foreign.load());
+    printf("RTT usec  : p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           rtt.percentile(50) / 1e3, rtt.percentile(99) / 1e3, rtt.percentile(99.9) / 1e3, rtt.max() / 1e3);
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_help() - Displays usage information and exits
+//============================================================================
+void show_help()
+{
+    printf("usage: rdma_bench [options] [dest_ip] [dest_port]\n");
+    printf("  -s, --size <bytes>    UDP payload bytes per packet, including the RDMA header (default 1024)\n");
+    printf("  -n, --count <count>   Number of packets to send (default 1000000)\n");
+    printf("  -r, --rate <gbps>     Transmit rate in Gbit/s, 0 = as fast as possible (default 1)\n");
+    printf("  -b, --batch <count>   Send and receive up to <count> packets per system call\n");
+    printf("  -l, --listen <port>   UDP port that the echoes arrive on (default 11111)\n");
+    printf("  -w, --wait <ms>       Time to wait for echoes after the last send (default 1000)\n");
+    printf("  -i, --interval <sec>  Seconds between throughput reports (default 1)\n");
+    printf("  -q, --quiet           No output until the program is stopped\n");
+    printf("  -h, --help            Display this help\n");
+    exit(1);
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_command_line() - Parses the command line options
+//============================================================================
+void parse_command_line(int argc, char** argv)
+{
+    static const option long_options[] =
+    {
+        {"size",     required_argument, NULL, 's'},
+        {"count",    required_argument, NULL, 'n'},
+        {"rate",     required_argument, NULL, 'r'},
+        {"batch",    required_argument, NULL, 'b'},
+        {"listen",   required_argument, NULL, 'l'},
+        {"wait",     required_argument, NULL, 'w'},
+        {"interval", required_argument, NULL, 'i'},
+        {"quiet",    no_argument,       NULL, 'q'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL,       0,                 NULL,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "s:n:r:b:l:w:i:qh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                packet_size = atoi(optarg);
+                break;
+            case 'n':
+                packet_count = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                rate_gbps = atof(optarg);
+                break;
+            case 'b':
+                batch_size = atoi(optarg);
+                break;
+            case 'l':
+                listen_port = atoi(optarg);
+                break;
+            case 'w':
+                drain_ms = atoi(optarg);
+                break;
+            case 'i':
+                report_interval_ms = (int)(atof(optarg) * 1000);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                show_help();
+        }
+    }
+
+    // The packet has to hold an RDMA header and fit in a UDP datagram
+    if (packet_size < RDMA_HDR_LEN || packet_size > 65507)
+    {
+        printf("Packet size must be between %d and 65507\n", RDMA_HDR_LEN);
+        exit(1);
+    }
+
+    // Batch size has to be sane
+    if (batch_size < 1 || batch_size > 1024)
+    {
+        printf("Batch size must be between 1 and 1024\n");
+        exit(1);
+    }
+
+    // A report interval of zero would mean "report continuously"
+    if (report_interval_ms < 1)
+    {
+        printf("Report interval must be positive\n");
+        exit(1);
+    }
+
+    // If there's an IP address on the command line, use it.
+    if (optind < argc) dest_ip = argv[optind++];
+
+    // If there's a UDP port on the command line, use it
+    if (optind < argc) dest_port = atoi(argv[optind++]);
+}
+//============================================================================
+
+
+
+//============================================================================
+// on_signal() - Called on Ctrl-C.  The reporter displays a summary and
+//               ends the program
+//============================================================================
+void on_signal(int)
+{
+    reporter.request_stop();
+}
+//============================================================================
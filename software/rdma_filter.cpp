@@ -0,0 +1,60 @@
+//==========================================================================================================
+// rdma_filter.cpp - Implements a software classifier that validates RDMA headers
+//==========================================================================================================
+#include <stdio.h>
+#include "rdma_filter.h"
+using namespace std;
+
+
+//==========================================================================================================
+// compile() - Turns a set of rules into the constants that classify() compares against
+//==========================================================================================================
+void RdmaFilter::compile(const filter_rules_t& rules)
+{
+    m_magic_be   = htons(RDMA_MAGIC);
+    m_port_be[0] = htons(rules.port[0]);
+    m_port_be[1] = htons(rules.port[1]);
+
+    // A window size of zero means the window is the entire 64-bit address space
+    m_window_base = rules.window_size ? rules.window_base : 0;
+    m_window_last = rules.window_size ? rules.window_size - 1 : UINT64_MAX;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// verdict_name() - Returns the human-readable name of a verdict
+//==========================================================================================================
+const char* RdmaFilter::verdict_name(int verdict)
+{
+    switch (verdict)
+    {
+        case FILTER_PASS:          return "passed";
+        case FILTER_SHORT:         return "short";
+        case FILTER_BAD_MAGIC:     return "bad magic";
+        case FILTER_BAD_PORT:      return "bad port";
+        case FILTER_BAD_LENGTH:    return "bad length";
+        case FILTER_OUT_OF_WINDOW: return "out of window";
+    }
+    return "unknown";
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays the totals of the verdict counters from one or more workers
+//==========================================================================================================
+void RdmaFilter::show_summary(filter_stats_t** stats, int count)
+{
+    printf("RDMA filter:");
+    for (int v=0; v<FILTER_VERDICTS; ++v)
+    {
+        uint64_t total = 0;
+        for (int i=0; i<count; ++i) total += stats[i]->verdict[v].load(memory_order_relaxed);
+        printf("%s %s %llu", v ? "," : "", verdict_name(v), (unsigned long long)total);
+    }
+    printf("\n");
+}
+//==========================================================================================================
@@ -0,0 +1,119 @@
+//==========================================================================================================
+// rdma_filter.h - Defines a software classifier that validates RDMA headers the way rdma_pkt_filter.v does
+//
+// The rules are compiled once into constants that are already in network byte order, so classifying a
+// packet is a handful of fixed-offset, word-wide loads and compares with no byte-by-byte parsing.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <netinet/udp.h>
+#include "udpsock.h"
+#include "rdma.h"
+#include "stats.h"
+
+// The verdicts that classify() can return.  Everything but FILTER_PASS is a reason to drop the packet
+enum filter_verdict_t
+{
+    FILTER_PASS,
+    FILTER_SHORT,           // Too short to hold an RDMA header
+    FILTER_BAD_MAGIC,       // The first two bytes aren't the RDMA magic number
+    FILTER_BAD_PORT,        // The UDP destination port isn't one of the RDMA ports
+    FILTER_BAD_LENGTH,      // The UDP length doesn't match the packet, or the payload is too big
+    FILTER_OUT_OF_WINDOW,   // The payload doesn't fit in the target address window
+    FILTER_VERDICTS
+};
+
+//==========================================================================================================
+// filter_rules_t - What the classifier accepts
+//==========================================================================================================
+struct filter_rules_t
+{
+    // The two UDP destination ports that RDMA packets may arrive on
+    uint16_t    port[2];
+
+    // RDMA packets must target addresses in the range window_base thru window_base + window_size - 1.
+    // A window_size of 0 means "any address"
+    uint64_t    window_base;
+    uint64_t    window_size;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// filter_stats_t - One drop counter per verdict, written by exactly one thread
+//==========================================================================================================
+struct alignas(64) filter_stats_t
+{
+    std::atomic<uint64_t>   verdict[FILTER_VERDICTS] = {};
+
+    // Counts a packet with the specified verdict
+    void count(int which) {bump(verdict[which]);}
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// RdmaFilter - The compiled classifier
+//==========================================================================================================
+class RdmaFilter
+{
+public:
+
+    // Compiles a set of rules
+    void    compile(const filter_rules_t& rules);
+
+    // Classifies a packet.  "udp" points to its UDP header, or is NULL if the header isn't available
+    // (in which case the kernel has already checked the port and the length for us)
+    filter_verdict_t classify(const udp_packet_t& packet, const udphdr* udp) const
+    {
+        const uint8_t* data = (const uint8_t*)packet.data;
+        uint16_t magic_be;
+        uint64_t target_be;
+
+        // The packet has to be big enough to hold a header, and no bigger than an RDMA packet can be
+        if (packet.length < RDMA_HDR_LEN) return FILTER_SHORT;
+        if (packet.length > RDMA_MAX_PACKET) return FILTER_BAD_LENGTH;
+
+        // Compare the magic number without byte-swapping it
+        memcpy(&magic_be, data, sizeof magic_be);
+        if (magic_be != m_magic_be) return FILTER_BAD_MAGIC;
+
+        // If we have the UDP header, check the destination port and length.  Both are compared in
+        // network byte order: the port and length are adjacent, so the length test is one 16-bit compare
+        if (udp)
+        {
+            if (udp->dest != m_port_be[0] && udp->dest != m_port_be[1]) return FILTER_BAD_PORT;
+            if (udp->len != htons(packet.length + sizeof(udphdr))) return FILTER_BAD_LENGTH;
+        }
+
+        // A single unsigned compare tells us whether the target address is in the window, and a second
+        // whether the last byte of the payload is
+        memcpy(&target_be, data + 2, sizeof target_be);
+        uint64_t offset  = be64toh(target_be) - m_window_base;
+        uint64_t payload = packet.length - RDMA_HDR_LEN;
+        if (offset > m_window_last) return FILTER_OUT_OF_WINDOW;
+        if (payload && payload - 1 > m_window_last - offset) return FILTER_OUT_OF_WINDOW;
+
+        // If we get here, it's a valid RDMA packet
+        return FILTER_PASS;
+    }
+
+    // Returns the human-readable name of a verdict
+    static const char* verdict_name(int verdict);
+
+    // Displays the drop counters of one or more workers
+    static void show_summary(filter_stats_t** stats, int count);
+
+protected:
+
+    // The magic number and the two acceptable ports, in network byte order
+    uint16_t    m_magic_be;
+    uint16_t    m_port_be[2];
+
+    // The start of the address window, and the offset of its last byte
+    uint64_t    m_window_base;
+    uint64_t    m_window_last;
+};
+//==========================================================================================================
@@ -0,0 +1,254 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "pcibar.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// If this isn't empty, this file stands in for the BAR
+string bar_file;
+
+// If this isn't empty, the sysfs directory of the device to use
+string device;
+
+// How long the self-test waits for each phase to finish
+int timeout_ms = 10000;
+
+// The command and its arguments
+vector<string> command;
+
+// The FPGA's registers
+PciBar bar;
+
+void parse_command_line(int argc, char** argv);
+void show_help();
+uint32_t parse_number(const string& text);
+int  run_selftest();
+
+//============================================================================
+// This program reads and writes the FPGA's AXI registers through a single
+// mapping of its PCIe BAR.  Unlike "pcireg", any number of registers can be
+// read or written per invocation, so a whole sequence of writes (such as
+// the one scripts/esend performs) costs one process and one mmap.
+//
+// With --file, an ordinary file stands in for the BAR.
+//============================================================================
+int main(int argc, char** argv)
+{
+    string error;
+
+    // Fetch the options and the command from the command line
+    parse_command_line(argc, argv);
+
+    // Map the BAR (or the file that stands in for it)
+    bool ok = bar_file.empty() ? bar.open_device(&error, device) : bar.open_file(bar_file, &error);
+    if (!ok)
+    {
+        printf("%s\n", error.c_str());
+        exit(1);
+    }
+
+    string verb = command[0];
+    size_t args = command.size() - 1;
+
+    // revision: display the revision of the bitstream
+    if (verb == "revision" && args == 0)
+    {
+        printf("%s\n", AxiRevision(bar).to_string().c_str());
+        return 0;
+    }
+
+    // status: display the state of both QSFP channels
+    if (verb == "status" && args == 0)
+    {
+        EthStatus status(bar);
+        uint32_t  word = status.status();
+        for (int channel=0; channel<2; ++channel)
+        {
+            EthCore core(bar, channel);
+            printf("QSFP %d: channel %s, PCS %s%s%s\n", channel,
+                   status.channel_up(channel) ? "up" : "down",
+                   core.is_aligned() ? "aligned" : "not aligned",
+                   status.flag(channel, EthStatus::OVERRUN)     ? ", overrun"        : "",
+                   status.flag(channel, EthStatus::PKT_DROPPED) ? ", dropping packets" : "");
+        }
+        printf("status word 0x%08X\n", word);
+        return 0;
+    }
+
+    // read <offset> [count]: display one or more consecutive registers
+    if (verb == "read" && (args == 1 || args == 2))
+    {
+        uint64_t offset = parse_number(command[1]);
+        uint64_t count  = (args == 2) ? parse_number(command[2]) : 1;
+        if (count == 0 || offset + count * 4 > bar.size() || !bar.is_valid(offset))
+        {
+            printf("Registers must be 4-byte aligned and lie within the %zu-byte BAR\n", bar.size());
+            return 1;
+        }
+        vector<uint32_t> address(count), value(count);
+        for (size_t i=0; i<count; ++i) address[i] = offset + i * 4;
+        bar.read(address.data(), value.data(), count);
+        for (size_t i=0; i<count; ++i) printf("0x%05X: 0x%08X (%u)\n", address[i], value[i], value[i]);
+        return 0;
+    }
+
+    // write <offset> <value> [<offset> <value> ...]: write registers in order
+    if (verb == "write" && args >= 2 && args % 2 == 0)
+    {
+        vector<reg_write_t> batch;
+        for (size_t i=1; i<command.size(); i+=2)
+        {
+            batch.push_back({parse_number(command[i]), parse_number(command[i + 1])});
+        }
+        if (!bar.write(batch.data(), batch.size()))
+        {
+            printf("Registers must be 4-byte aligned and lie within the %zu-byte BAR\n", bar.size());
+            return 1;
+        }
+        return 0;
+    }
+
+    // selftest [size]: fill remote RAM and check it, like utils/selftest.sh
+    if (verb == "selftest" && args <= 1) return run_selftest();
+
+    show_help();
+}
+//============================================================================
+
+
+
+//============================================================================
+// run_selftest() - Runs the data_generator self-test at one packet size, or
+//                  at every one.  Returns the program's exit code
+//============================================================================
+int run_selftest()
+{
+    DataGenerator generator(bar);
+    EthCore       core(bar, 0);
+    vector<int>   sizes;
+
+    // Test the size on the command line, or every legal one
+    if (command.size() > 1)
+        sizes.push_back(parse_number(command[1]));
+    else
+        for (int size=64; size<=8192; size*=2) sizes.push_back(size);
+
+    // An unresponsive device reads as all ones
+    if (bar.read32(DATA_GEN_BASE) == 0xFFFFFFFF)
+    {
+        printf("You forgot to issue a hot_reset\n");
+        return 1;
+    }
+
+    // The test needs the Ethernet channel up.  utils/selftest.sh brings it up
+    if (bar_file.empty() && !core.is_aligned())
+    {
+        printf("QSFP 0 doesn't have PCS alignment; run utils/selftest.sh to enable Ethernet\n");
+        return 1;
+    }
+
+    for (int size : sizes)
+    {
+        printf("Testing with packet size %4d...  ", size);
+        fflush(stdout);
+        if (generator.self_test(size, rand(), 25000, timeout_ms))
+        {
+            printf("Passed\n");
+            continue;
+        }
+
+        // Say how many packets were damaged on the way
+        printf("FAILED\n");
+        core.tick();
+        printf("There were %u bad packets out of a total of %u\n", core.rx_bad_fcs(), core.rx_packets());
+        return 1;
+    }
+
+    return 0;
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_number() - Parses a register offset or value in decimal or 0x hex
+//============================================================================
+uint32_t parse_number(const string& text)
+{
+    char* p;
+    unsigned long long value = strtoull(text.c_str(), &p, 0);
+    if (p == text.c_str() || *p != 0 || value > 0xFFFFFFFF) show_help();
+    return value;
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_help() - Displays usage information and exits
+//============================================================================
+void show_help()
+{
+    printf("usage: rdma_fpga [options] <command>\n");
+    printf("commands:\n");
+    printf("  revision                      Display the revision of the bitstream\n");
+    printf("  status                        Display the state of both QSFP channels\n");
+    printf("  read <offset> [count]         Display <count> registers starting at <offset>\n");
+    printf("  write <offset> <value> [...]  Write one or more registers, in order\n");
+    printf("  selftest [size]               Fill remote RAM with packets of [size] bytes\n");
+    printf("                                (default: every size) and check it\n");
+    printf("options:\n");
+    printf("  -d, --device <dir>    Sysfs directory of the device (default: first 10EE:903F)\n");
+    printf("  -f, --file <file>     Use a file in place of the BAR, for testing without the board\n");
+    printf("  -t, --timeout <ms>    How long the self-test waits for each phase (default 10000)\n");
+    printf("  -h, --help            Display this help\n");
+    exit(1);
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_command_line() - Parses the command line options
+//============================================================================
+void parse_command_line(int argc, char** argv)
+{
+    static const option long_options[] =
+    {
+        {"device",  required_argument, NULL, 'd'},
+        {"file",    required_argument, NULL, 'f'},
+        {"timeout", required_argument, NULL, 't'},
+        {"help",    no_argument,       NULL, 'h'},
+        {NULL,      0,                 NULL,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "d:f:t:h", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'd':
+                device = optarg;
+                break;
+            case 'f':
+                bar_file = optarg;
+                break;
+            case 't':
+                timeout_ms = atoi(optarg);
+                if (timeout_ms < 1) show_help();
+                break;
+            default:
+                show_help();
+        }
+    }
+
+    // There has to be a command
+    if (optind >= argc) show_help();
+    while (optind < argc) command.push_back(argv[optind++]);
+}
+//============================================================================
@@ -0,0 +1,271 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include "udpsock.h"
+#include "pcap.h"
+#include "pacer.h"
+#include "stats.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The capture file to replay
+string capture_file;
+
+// The (possibly broadcast) IP address and UDP port to send the packets to
+string dest_ip = "10.1.1.255";
+int    dest_port = RDMA_PORT;
+
+// The number of packets handed to the kernel per system call
+int batch_size = 64;
+
+// The number of times to replay the capture.  0 means "forever"
+int repeat_count = 1;
+
+// Replay at this multiple of the original speed.  0 means "as fast as possible"
+double speed = 1;
+
+// Milliseconds between throughput reports
+int report_interval_ms = 1000;
+
+// When true, nothing is displayed until the program is stopped
+bool quiet = false;
+
+// The capture we're replaying, the socket we're sending on, and the counters of what we've sent
+PcapReader capture;
+UDPSock sender;
+packet_stats_t tx;
+
+// The thread that reports our counters
+StatsReporter reporter;
+
+void parse_command_line(int argc, char** argv);
+bool send_all(udp_packet_t* packet, int count);
+void on_signal(int);
+
+//============================================================================
+// This program replays the RDMA packets in a pcap file, either with their
+// original spacing or as fast as possible.  The file can be one written by
+// "rdma_loop --capture", or one taken with tcpdump on an Ethernet interface.
+// Only the UDP payload of each packet is sent; the addresses and ports in
+// the capture are ignored.
+//============================================================================
+int main(int argc, char** argv)
+{
+    string error;
+
+    // Fetch the options, file name and IP address/port from the command line
+    parse_command_line(argc, argv);
+
+    // Map the capture file
+    if (!capture.open(capture_file, &error))
+    {
+        printf("%s\n", error.c_str());
+        exit(1);
+    }
+
+    // Create the socket we send on
+    if (!sender.create_broadcaster(dest_port, dest_ip))
+    {
+        printf("Can't create a socket to send to %s:%d\n", dest_ip.c_str(), dest_port);
+        exit(1);
+    }
+
+    // Display a summary when the user hits Ctrl-C
+    signal(SIGINT,  on_signal);
+    signal(SIGTERM, on_signal);
+
+    // Start the thread that reports throughput
+    reporter.start(quiet ? 0 : report_interval_ms, {&tx});
+
+    vector<udp_packet_t> batch(batch_size);
+    pcap_packet_t        packet;
+
+    // Replay the capture as many times as we've been asked to
+    for (int i=0; repeat_count == 0 || i < repeat_count; ++i)
+    {
+        capture.rewind();
+        if (!capture.next(&packet))
+        {
+            printf("%s has no UDP packets in it\n", capture_file.c_str());
+            break;
+        }
+
+        // Each packet is due at the same offset from our start as it was from the start of the capture
+        uint64_t first_ns = packet.time_ns;
+        int64_t  start_ns = Pacer::now_ns();
+        bool     more     = true;
+        auto     due_ns   = [&](uint64_t time_ns)
+        {
+            return start_ns + (int64_t)((int64_t)(time_ns - first_ns) / speed);
+        };
+
+        while (more)
+        {
+            // Unless we're going as fast as possible, wait until this packet is due
+            if (speed) Pacer::wait_until(due_ns(packet.time_ns));
+
+            // Gather this packet and every following one that's also due by now into a batch
+            int count = 0;
+            int64_t now_ns = Pacer::now_ns();
+            do
+            {
+                batch[count].data         = (void*)packet.data;
+                batch[count].length       = packet.length;
+                batch[count].segment_size = 0;
+                ++count;
+                more = capture.next(&packet);
+            }
+            while (more && count < batch_size &&
+                  (speed == 0 || due_ns(packet.time_ns) <= now_ns));
+
+            // And send the batch
+            if (!send_all(batch.data(), count))
+            {
+                perror("send");
+                reporter.request_stop();
+                while (true) pause();
+            }
+        }
+    }
+
+    // The reporter displays the summary and ends the program
+    reporter.request_stop();
+    while (true) pause();
+}
+//============================================================================
+
+
+
+//============================================================================
+// send_all() - Sends a batch of packets, waiting out any transient
+//              shortage of socket buffer space
+//============================================================================
+bool send_all(udp_packet_t* packet, int count)
+{
+    int sent = 0;
+
+    while (sent < count)
+    {
+        int rc = sender.send_batch(packet + sent, count - sent);
+        if (rc < 0)
+        {
+            if (errno == ENOBUFS || errno == EAGAIN) continue;
+            return false;
+        }
+        for (int i=0; i<rc; ++i) tx.count(packet[sent + i].length);
+        sent += rc;
+    }
+
+    return true;
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_help() - Displays usage information and exits
+//============================================================================
+void show_help()
+{
+    printf("usage: rdma_replay [options] <file> [dest_ip] [dest_port]\n");
+    printf("  -s, --speed <x>       Replay at <x> times the original speed (default 1)\n");
+    printf("  -a, --asap            Replay as fast as possible, ignoring the original timing\n");
+    printf("  -n, --repeat <count>  Number of times to replay the file, 0 = forever (default 1)\n");
+    printf("  -b, --batch <count>   Send up to <count> packets per system call (default 64)\n");
+    printf("  -i, --interval <sec>  Seconds between throughput reports (default 1)\n");
+    printf("  -q, --quiet           No output until the program is stopped\n");
+    printf("  -h, --help            Display this help\n");
+    exit(1);
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_command_line() - Parses the command line options
+//============================================================================
+void parse_command_line(int argc, char** argv)
+{
+    static const option long_options[] =
+    {
+        {"speed",    required_argument, NULL, 's'},
+        {"asap",     no_argument,       NULL, 'a'},
+        {"repeat",   required_argument, NULL, 'n'},
+        {"batch",    required_argument, NULL, 'b'},
+        {"interval", required_argument, NULL, 'i'},
+        {"quiet",    no_argument,       NULL, 'q'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL,       0,                 NULL,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "s:an:b:i:qh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                speed = atof(optarg);
+                if (speed <= 0) show_help();
+                break;
+            case 'a':
+                speed = 0;
+                break;
+            case 'n':
+                repeat_count = atoi(optarg);
+                break;
+            case 'b':
+                batch_size = atoi(optarg);
+                break;
+            case 'i':
+                report_interval_ms = (int)(atof(optarg) * 1000);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                show_help();
+        }
+    }
+
+    // Batch size has to be sane
+    if (batch_size < 1 || batch_size > 1024)
+    {
+        printf("Batch size must be between 1 and 1024\n");
+        exit(1);
+    }
+
+    // A report interval of zero would mean "report continuously"
+    if (report_interval_ms < 1)
+    {
+        printf("Report interval must be positive\n");
+        exit(1);
+    }
+
+    // There has to be a file to replay
+    if (optind >= argc) show_help();
+    capture_file = argv[optind++];
+
+    // If there's an IP address on the command line, use it.
+    if (optind < argc) dest_ip = argv[optind++];
+
+    // If there's a UDP port on the command line, use it
+    if (optind < argc) dest_port = atoi(argv[optind++]);
+}
+//============================================================================
+
+
+
+//============================================================================
+// on_signal() - Called on Ctrl-C.  The reporter displays a summary and
+//               ends the program
+//============================================================================
+void on_signal(int)
+{
+    reporter.request_stop();
+}
+//============================================================================
@@ -0,0 +1,330 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include "rdma_sender.h"
+#include "stats.h"
+#include "cmdline.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The (possibly broadcast) IP address and UDP port of the RDMA target
+string dest_ip = "10.1.1.255";
+int    dest_port = RDMA_PORT;
+
+// The number of payload bytes per packet
+int payload_size = RDMA_MAX_PAYLOAD;
+
+// The RDMA target address of the first byte of the region
+uint64_t base_addr = 0;
+
+// The number of packets handed to the kernel per system call
+int batch_size = 64;
+
+// If this isn't empty, the region is a mapping of this file.  Otherwise it's region_size bytes of memory
+string region_file;
+size_t region_size = 1 << 20;
+
+// The number of times to send the region.  0 means "forever"
+int repeat_count = 1;
+
+// The maximum transmit rate in Gbit/s.  0 means "as fast as possible"
+double rate_gbps = 0;
+
+// When rate-limited, the most bytes that may leave back-to-back
+size_t burst_size = PACER_DEFAULT_BURST;
+
+// When true, the kernel spaces packets out by their SO_TXTIME departure times
+bool txtime = false;
+
+// If this isn't 0, the receiver's credits hold us back, starting with a window of this many packets
+int credit_window = 0;
+
+// Milliseconds between throughput reports
+int report_interval_ms = 1000;
+
+// When true, nothing is displayed until the program is stopped
+bool quiet = false;
+
+// The transmitter, and the thread that reports its counters
+RdmaSender sender;
+StatsReporter reporter;
+
+void  parse_command_line(int argc, char** argv);
+void* map_region();
+void  on_signal(int);
+
+//============================================================================
+// This program is a host-side RDMA transmitter.   It streams a file (or a
+// block of memory) to an RDMA target as a series of RDMA packets whose
+// target addresses increment through the region, just as rdma_xmit.v does.
+//
+// The target can be the FPGA, or an rdma_loop running in --target mode.
+//============================================================================
+int main(int argc, char** argv)
+{
+    // Fetch the options and IP address/port from the command line
+    parse_command_line(argc, argv);
+
+    // Map the region we're going to send
+    void* region = map_region();
+
+    // Create the transmitter
+    if (!sender.create(dest_ip, dest_port, payload_size, base_addr, batch_size))
+    {
+        printf("Can't create a socket to send to %s:%d\n", dest_ip.c_str(), dest_port);
+        exit(1);
+    }
+    if (rate_gbps > 0 && !sender.set_rate(rate_gbps, burst_size, txtime))
+    {
+        printf("Can't enable %s pacing\n", txtime ? "SO_TXTIME" : "token-bucket");
+        exit(1);
+    }
+
+    // Display a summary when the user hits Ctrl-C
+    signal(SIGINT,  on_signal);
+    signal(SIGTERM, on_signal);
+
+    // With flow control, the receiver's credits decide how fast we go
+    if (credit_window)
+    {
+        sender.enable_flow_control(credit_window);
+        reporter.add_summary([]() {sender.get_credits().show_summary();});
+    }
+
+    // When rate-limited, the summary says what rate we achieved and how steadily
+    if (rate_gbps > 0)
+    {
+        reporter.add_summary([]()
+        {
+            const Pacer* pacer = &sender.get_pacer();
+            Pacer::show_summary(&pacer, 1, txtime);
+        });
+    }
+
+    // Start the thread that reports throughput
+    reporter.start(quiet ? 0 : report_interval_ms, {&sender.stats});
+
+    // Send the region as many times as we've been asked to
+    for (int i=0; repeat_count == 0 || i < repeat_count; ++i)
+    {
+        if (!sender.send(region, region_size))
+        {
+            perror("send");
+            break;
+        }
+    }
+
+    // The reporter displays the summary and ends the program
+    reporter.request_stop();
+    while (true) pause();
+}
+//============================================================================
+
+
+
+//============================================================================
+// map_region() - Maps the file we're going to send or, if there is no file,
+//                allocates and fills a block of memory of region_size bytes
+//============================================================================
+void* map_region()
+{
+    void* region;
+
+    if (region_file.empty())
+    {
+        // Allocate the memory
+        region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (region == MAP_FAILED)
+        {
+            printf("Can't allocate %zu bytes\n", region_size);
+            exit(1);
+        }
+
+        // Fill it with incrementing 32-bit words so that the target can tell where data landed
+        uint32_t* word = (uint32_t*)region;
+        for (size_t i=0; i<region_size / 4; ++i) word[i] = i;
+        return region;
+    }
+
+    // Open the file and find out how big it is
+    struct stat sb;
+    int fd = open(region_file.c_str(), O_RDONLY);
+    if (fd < 0 || fstat(fd, &sb) < 0 || sb.st_size == 0)
+    {
+        printf("Can't open %s, or it's empty\n", region_file.c_str());
+        exit(1);
+    }
+    region_size = sb.st_size;
+
+    // Map the file.  The mapping stays valid after the descriptor is closed
+    region = mmap(NULL, region_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED)
+    {
+        printf("Can't map %s\n", region_file.c_str());
+        exit(1);
+    }
+    return region;
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_help() - Displays usage information and exits
+//============================================================================
+void show_help()
+{
+    printf("usage: rdma_send [options] [dest_ip] [dest_port]\n");
+    printf("  -s, --size <bytes>    Payload bytes per packet (default %d)\n", RDMA_MAX_PAYLOAD);
+    printf("  -a, --address <addr>  RDMA target address of the start of the region (default 0)\n");
+    printf("  -f, --file <file>     Send the contents of <file>\n");
+    printf("  -m, --memory <size>   Send a <size> byte block of memory (K/M/G, default 1M)\n");
+    printf("  -n, --repeat <count>  Number of times to send the region, 0 = forever (default 1)\n");
+    printf("  -r, --rate <gbps>     Limit the transmit rate to <gbps> Gbit/s\n");
+    printf("  -B, --burst <size>    When rate-limited, send at most <size> bytes back-to-back (default 256K)\n");
+    printf("  -t, --txtime          Have an ETF qdisc space packets out by SO_TXTIME departure times\n");
+    printf("  -k, --credits <n>     Number the packets and let the receiver's credits hold us back,\n");
+    printf("                        assuming a window of <n> packets until the first credits arrive\n");
+    printf("  -b, --batch <count>   Send up to <count> packets per system call (default 64)\n");
+    printf("  -i, --interval <sec>  Seconds between throughput reports (default 1)\n");
+    printf("  -q, --quiet           No output until the program is stopped\n");
+    printf("  -h, --help            Display this help\n");
+    exit(1);
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_command_line() - Parses the command line options
+//============================================================================
+void parse_command_line(int argc, char** argv)
+{
+    static const option long_options[] =
+    {
+        {"size",     required_argument, NULL, 's'},
+        {"address",  required_argument, NULL, 'a'},
+        {"file",     required_argument, NULL, 'f'},
+        {"memory",   required_argument, NULL, 'm'},
+        {"repeat",   required_argument, NULL, 'n'},
+        {"rate",     required_argument, NULL, 'r'},
+        {"burst",    required_argument, NULL, 'B'},
+        {"txtime",   no_argument,       NULL, 't'},
+        {"credits",  required_argument, NULL, 'k'},
+        {"batch",    required_argument, NULL, 'b'},
+        {"interval", required_argument, NULL, 'i'},
+        {"quiet",    no_argument,       NULL, 'q'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL,       0,                 NULL,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "s:a:f:m:n:r:B:tk:b:i:qh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                payload_size = atoi(optarg);
+                break;
+            case 'a':
+                base_addr = strtoull(optarg, NULL, 0);
+                break;
+            case 'f':
+                region_file = optarg;
+                break;
+            case 'm':
+                if (!parse_size(optarg, &region_size)) show_help();
+                break;
+            case 'n':
+                repeat_count = atoi(optarg);
+                break;
+            case 'r':
+                rate_gbps = atof(optarg);
+                break;
+            case 'B':
+                if (!parse_size(optarg, &burst_size) || burst_size == 0) show_help();
+                break;
+            case 't':
+                txtime = true;
+                break;
+            case 'k':
+                credit_window = atoi(optarg);
+                if (credit_window < 1 || credit_window > RDMA_FC_WINDOW) show_help();
+                break;
+            case 'b':
+                batch_size = atoi(optarg);
+                break;
+            case 'i':
+                report_interval_ms = (int)(atof(optarg) * 1000);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                show_help();
+        }
+    }
+
+    // The packet has to fit in a UDP datagram
+    if (payload_size < 1 || payload_size > 65507 - RDMA_HDR_LEN)
+    {
+        printf("Payload size must be between 1 and %d\n", 65507 - RDMA_HDR_LEN);
+        exit(1);
+    }
+
+    // Batch size has to be sane
+    if (batch_size < 1 || batch_size > 1024)
+    {
+        printf("Batch size must be between 1 and 1024\n");
+        exit(1);
+    }
+
+    // There has to be something to send
+    if (region_file.empty() && region_size == 0)
+    {
+        printf("Memory size must be positive\n");
+        exit(1);
+    }
+
+    // Departure times only make sense with a rate to space the packets out to
+    if (txtime && rate_gbps <= 0)
+    {
+        printf("--txtime requires --rate\n");
+        exit(1);
+    }
+
+    // A report interval of zero would mean "report continuously"
+    if (report_interval_ms < 1)
+    {
+        printf("Report interval must be positive\n");
+        exit(1);
+    }
+
+    // If there's an IP address on the command line, use it.
+    if (optind < argc) dest_ip = argv[optind++];
+
+    // If there's a UDP port on the command line, use it
+    if (optind < argc) dest_port = atoi(argv[optind++]);
+}
+//============================================================================
+
+
+
+//============================================================================
+// on_signal() - Called on Ctrl-C.  The reporter displays a summary and
+//               ends the program
+//============================================================================
+void on_signal(int)
+{
+    reporter.request_stop();
+}
+//============================================================================
@@ -0,0 +1,101 @@
+//==========================================================================================================
+// rdma_sender.cpp - Implements a host-side RDMA transmitter that streams a memory region as RDMA packets
+//==========================================================================================================
+#include <errno.h>
+#include "rdma_sender.h"
+using namespace std;
+
+
+//==========================================================================================================
+// create() - Creates the socket and the scratch space used for sending
+//
+// Passed:  dest_ip      = the IP address (which may be a broadcast address) of the RDMA target
+//          port         = the UDP port of the RDMA target
+//          payload_size = the number of payload bytes in each packet
+//          base_addr    = the RDMA target address of the first byte of every region we send
+//          batch_size   = the number of packets handed to the kernel per system call
+//
+// Returns: true on success
+//==========================================================================================================
+bool RdmaSender::create(string dest_ip, int port, int payload_size, uint64_t base_addr, int batch_size)
+{
+    // Save our settings
+    m_payload_size = payload_size;
+    m_batch_size   = batch_size;
+    m_base         = base_addr;
+
+    // Allocate a header and a pair of iovecs for every packet in a batch
+    m_header.resize(batch_size);
+    m_iov.resize(batch_size * 2);
+
+    // The first iovec of each packet always points at that packet's header
+    for (int i=0; i<batch_size; ++i)
+    {
+        m_iov[i*2].iov_base = &m_header[i];
+        m_iov[i*2].iov_len  = sizeof(rdma_header_t);
+    }
+
+    // Create the socket in broadcast mode, so that dest_ip may be a broadcast address
+    return m_sock.create_broadcaster(port, dest_ip);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// send() - Sends an entire region as a stream of RDMA packets
+//
+// Passed:  region = the data to send
+//          length = the number of bytes in the region.  The last packet may be short
+//
+// Returns: true if the whole region was sent, false on a socket error
+//==========================================================================================================
+bool RdmaSender::send(const void* region, size_t length)
+{
+    const uint8_t* data = (const uint8_t*)region;
+    size_t offset = 0;
+
+    while (offset < length)
+    {
+        int count;
+
+        // With flow control, the batch may be no bigger than the receiver's credits allow
+        int room = m_credits.acquire(m_sock, m_batch_size);
+
+        // Point the headers and payload iovecs of a batch at the next chunks of the region
+        for (count = 0; count < room && offset < length; ++count)
+        {
+            size_t payload = length - offset;
+            if (payload > (size_t)m_payload_size) payload = m_payload_size;
+            m_header[count].set(m_base + offset);
+            if (m_credits.is_enabled())
+            {
+                m_header[count].set_sequence(m_credits.sequence() + count);
+                m_header[count].set_flow(RDMA_FC_DATA);
+            }
+            m_iov[count*2 + 1].iov_base = (void*)(data + offset);
+            m_iov[count*2 + 1].iov_len  = payload;
+            offset += payload;
+        }
+
+        // Send the batch (which the socket paces, if we're rate-limited).  If the kernel runs out of
+        // buffers, try again
+        int sent = 0;
+        while (sent < count)
+        {
+            int rc = m_sock.send_gather(&m_iov[sent*2], 2, count - sent);
+            if (rc < 0)
+            {
+                if (errno == ENOBUFS || errno == EAGAIN) continue;
+                return false;
+            }
+            for (int i=sent; i<sent+rc; ++i) stats.count(m_iov[i*2 + 1].iov_len + RDMA_HDR_LEN);
+            sent += rc;
+        }
+        m_credits.sent(count);
+    }
+
+    // Tell the caller that the whole region went out
+    return true;
+}
+//==========================================================================================================
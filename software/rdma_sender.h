@@ -0,0 +1,68 @@
+//==========================================================================================================
+// rdma_sender.h - Defines a host-side RDMA transmitter that streams a memory region as RDMA packets
+//
+// This does on the host what rdma_xmit.v does on the FPGA: the region is cut into packets of a fixed
+// payload size, and each packet carries an RDMA header whose target address is the base address plus
+// the offset of its payload within the region.  The header and the payload are handed to the kernel as
+// two separate iovecs, so payload bytes are never copied by the application.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "udpsock.h"
+#include "stats.h"
+#include "flow_control.h"
+
+//==========================================================================================================
+// RdmaSender - Streams memory regions to an RDMA target
+//==========================================================================================================
+class RdmaSender
+{
+public:
+
+    // Creates the sending socket and the per-batch headers
+    bool    create(std::string dest_ip, int port, int payload_size, uint64_t base_addr, int batch_size);
+
+    // Limits the transmit rate to this many Gbit/s, in bursts of at most "burst_bytes".  With txtime,
+    // the kernel spaces the packets out instead (see UDPSock::enable_pacing()).  Returns false if the
+    // pacing can't be set up
+    bool    set_rate(double gbps, uint64_t burst_bytes = PACER_DEFAULT_BURST, bool txtime = false)
+            {return m_sock.enable_pacing(gbps, burst_bytes, txtime);}
+
+    // Returns the pacer, which says what rate was achieved and how punctually
+    const Pacer& get_pacer() {return m_sock.get_pacer();}
+
+    // Numbers the packets and asks the receiver for credits, holding back whenever fewer than one
+    // packet's worth remain.  The receiver is assumed to take "window" packets before its first credits
+    void    enable_flow_control(int window = FC_DEFAULT_WINDOW) {m_credits.start(window);}
+
+    // Returns the credit window, which says how often the receiver held us back
+    const CreditWindow& get_credits() {return m_credits;}
+
+    // Sends an entire region, one packet per "payload_size" bytes.  Returns false on a socket error
+    bool    send(const void* region, size_t length);
+
+    // Packet counters, updated only by the thread that calls send()
+    packet_stats_t stats;
+
+protected:
+
+    // The socket we send on
+    UDPSock     m_sock;
+
+    // The number of payload bytes per packet, and the number of packets per system call
+    int         m_payload_size;
+    int         m_batch_size;
+
+    // The RDMA address that corresponds to the start of the region
+    uint64_t    m_base;
+
+    // One RDMA header per packet in a batch, and two iovecs (header, payload) per packet
+    std::vector<rdma_header_t> m_header;
+    std::vector<iovec>         m_iov;
+
+    // With flow control, the receiver's credits
+    CreditWindow m_credits;
+};
+//==========================================================================================================
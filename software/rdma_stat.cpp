@@ -0,0 +1,291 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include "metrics.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The name of the shared-memory segment to read
+string segment_name = "rdma_loop";
+
+// When true, the output is in Prometheus text exposition format
+bool prometheus = false;
+
+// Seconds between reads.  0 means "read once and exit"
+double watch_interval = 0;
+
+// If this isn't empty, each read replaces this file rather than going to stdout
+string output_file;
+
+// The segment we're reading
+MetricsReader reader;
+
+void parse_command_line(int argc, char** argv);
+void show_table(FILE* out, metrics_snapshot_t& now, metrics_snapshot_t* before);
+void show_prometheus(FILE* out, metrics_snapshot_t& now);
+
+//============================================================================
+// This program displays the counters that "rdma_loop --metrics" publishes
+// in shared memory.  It reads them without making a system call or taking
+// a lock, and without the cooperation of the worker threads, so it can be
+// run as often as you like.  The segment outlives rdma_loop, so the final
+// counters of a run that has ended can still be read.
+//
+// With --prometheus and --output, it serves as an exporter for the
+// node_exporter textfile collector.
+//============================================================================
+int main(int argc, char** argv)
+{
+    string error;
+    metrics_snapshot_t now, before;
+    bool have_before = false;
+
+    // Fetch the options and segment name from the command line
+    parse_command_line(argc, argv);
+
+    // Map the segment
+    if (!reader.open(segment_name, &error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        exit(1);
+    }
+
+    while (true)
+    {
+        // If rdma_loop died part way through publishing, show what it left behind, with a warning
+        if (!reader.snapshot(&now))
+        {
+            fprintf(stderr, "Warning: rdma_loop (pid %d) stopped in the middle of publishing, so these values"
+                            " may be inconsistent\n", now.pid);
+        }
+
+        // Write to stdout, or to a temporary file that replaces the output file when it's complete
+        string temp_file = output_file + ".tmp";
+        FILE*  out = output_file.empty() ? stdout : fopen(temp_file.c_str(), "w");
+        if (out == NULL)
+        {
+            perror(temp_file.c_str());
+            exit(1);
+        }
+
+        if (prometheus)
+            show_prometheus(out, now);
+        else
+            show_table(out, now, have_before ? &before : NULL);
+
+        if (out == stdout)
+            fflush(stdout);
+        else if (fclose(out) != 0 || rename(temp_file.c_str(), output_file.c_str()) != 0)
+        {
+            perror(output_file.c_str());
+            exit(1);
+        }
+
+        // If we're only reading once, we're done
+        if (watch_interval == 0) break;
+
+        before = now;
+        have_before = true;
+        usleep((useconds_t)(watch_interval * 1000000));
+    }
+}
+//============================================================================
+
+
+
+//============================================================================
+// now_ns() - Returns CLOCK_REALTIME in nanoseconds
+//============================================================================
+static uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+//============================================================================
+
+
+
+//============================================================================
+// is_running() - Returns true if the process that publishes the segment is
+//                still alive
+//============================================================================
+static bool is_running(int pid)
+{
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+//============================================================================
+
+
+
+//============================================================================
+// full_name() - Returns a metric name with its labels, e.g.
+//               rdma_loop_packets_total{worker="0"}
+//============================================================================
+static string full_name(const string& name, const string& labels)
+{
+    return labels.empty() ? name : name + "{" + labels + "}";
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_table() - Displays a snapshot for humans.  If there's an earlier
+//                snapshot, counters are shown with their rate since then
+//============================================================================
+void show_table(FILE* out, metrics_snapshot_t& now, metrics_snapshot_t* before)
+{
+    double age     = (int64_t)(now_ns() - now.publish_ns) / 1e9;
+    double uptime  = (now.publish_ns - now.start_ns) / 1e9;
+    double seconds = before ? (now.publish_ns - before->publish_ns) / 1e9 : 0;
+
+    fprintf(out, "%s: pid %d (%s), up %.1f sec, published %.1f sec ago\n", segment_name.c_str(), now.pid,
+            is_running(now.pid) ? "running" : "exited", uptime, age);
+
+    for (size_t i=0; i<now.metric.size(); ++i)
+    {
+        auto& metric = now.metric[i];
+        fprintf(out, "  %-60s %16llu", full_name(metric.name, metric.labels).c_str(),
+                (unsigned long long)metric.value);
+
+        // Counters get a rate, provided the layout hasn't changed under us
+        if (metric.type == METRIC_COUNTER && seconds > 0 && i < before->metric.size())
+        {
+            double rate = (metric.value - before->metric[i].value) / seconds;
+            fprintf(out, "  %14.1f/s", rate);
+        }
+        fprintf(out, "\n");
+    }
+
+    for (auto& hist : now.histogram)
+    {
+        LatencyHistogram values;
+        values.load(hist.bucket.data(), hist.max);
+        fprintf(out, "  %-60s %16llu  p50 %llu  p99 %llu  p99.9 %llu  max %llu ns\n",
+                full_name(hist.name, hist.labels).c_str(), (unsigned long long)values.count(),
+                (unsigned long long)values.percentile(50), (unsigned long long)values.percentile(99),
+                (unsigned long long)values.percentile(99.9), (unsigned long long)values.max());
+    }
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_prometheus() - Writes a snapshot in Prometheus text format.
+//                     Histograms are written as summaries
+//============================================================================
+void show_prometheus(FILE* out, metrics_snapshot_t& now)
+{
+    // Metrics that share a name have to be grouped under a single TYPE line
+    vector<string> names;
+    auto first_time = [&](const string& name)
+    {
+        for (auto& seen : names) if (seen == name) return false;
+        names.push_back(name);
+        return true;
+    };
+
+    fprintf(out, "# TYPE rdma_loop_up gauge\n");
+    fprintf(out, "rdma_loop_up %d\n", is_running(now.pid) ? 1 : 0);
+    fprintf(out, "# TYPE rdma_loop_publish_time_seconds gauge\n");
+    fprintf(out, "rdma_loop_publish_time_seconds %.3f\n", now.publish_ns / 1e9);
+
+    for (auto& metric : now.metric)
+    {
+        if (!first_time(metric.name)) continue;
+        fprintf(out, "# TYPE %s %s\n", metric.name.c_str(), metric.type == METRIC_GAUGE ? "gauge" : "counter");
+        for (auto& other : now.metric)
+        {
+            if (other.name != metric.name) continue;
+            fprintf(out, "%s %llu\n", full_name(other.name, other.labels).c_str(),
+                    (unsigned long long)other.value);
+        }
+    }
+
+    for (auto& hist : now.histogram)
+    {
+        if (!first_time(hist.name)) continue;
+        fprintf(out, "# TYPE %s summary\n", hist.name.c_str());
+        for (auto& other : now.histogram)
+        {
+            if (other.name != hist.name) continue;
+            LatencyHistogram values;
+            values.load(other.bucket.data(), other.max);
+            string separator = other.labels.empty() ? "" : ",";
+            for (double quantile : {0.5, 0.99, 0.999})
+            {
+                fprintf(out, "%s{%s%squantile=\"%g\"} %llu\n", other.name.c_str(), other.labels.c_str(),
+                        separator.c_str(), quantile, (unsigned long long)values.percentile(quantile * 100));
+            }
+            fprintf(out, "%s %llu\n", full_name(other.name + "_count", other.labels).c_str(),
+                    (unsigned long long)values.count());
+        }
+    }
+}
+//============================================================================
+
+
+
+//============================================================================
+// show_help() - Displays usage information and exits
+//============================================================================
+void show_help()
+{
+    printf("usage: rdma_stat [options] [segment]\n");
+    printf("  Displays the counters in /dev/shm/<segment> (default rdma_loop)\n");
+    printf("  -p, --prometheus      Write them in Prometheus text exposition format\n");
+    printf("  -w, --watch <sec>     Read them every <sec> seconds, showing rates\n");
+    printf("  -o, --output <file>   Atomically replace <file> rather than writing to stdout\n");
+    printf("  -h, --help            Display this help\n");
+    exit(1);
+}
+//============================================================================
+
+
+
+//============================================================================
+// parse_command_line() - Parses the command line options
+//============================================================================
+void parse_command_line(int argc, char** argv)
+{
+    static const option long_options[] =
+    {
+        {"prometheus", no_argument,       NULL, 'p'},
+        {"watch",      required_argument, NULL, 'w'},
+        {"output",     required_argument, NULL, 'o'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL,         0,                 NULL,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "pw:o:h", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'p':
+                prometheus = true;
+                break;
+            case 'w':
+                watch_interval = atof(optarg);
+                if (watch_interval <= 0) show_help();
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            default:
+                show_help();
+        }
+    }
+
+    // If there's a segment name on the command line, use it
+    if (optind < argc) segment_name = argv[optind++];
+}
+//============================================================================
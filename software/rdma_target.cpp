@@ -0,0 +1,121 @@
+//==========================================================================================================
+// rdma_target.cpp - Implements a host-side RDMA target that applies RDMA packets to a memory region
+//==========================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "rdma_target.h"
+using namespace std;
+
+
+//==========================================================================================================
+// create() - Maps the memory region that RDMA packets will be written into
+//
+// Passed:  size      = the size of the region in bytes
+//          base_addr = the RDMA target address that corresponds to the start of the region
+//          filename  = if not empty, the region is a shared mapping of this file (created if necessary)
+//          hugepages = for anonymous regions, true to back the region with hugepages
+//
+// Returns: true on success
+//==========================================================================================================
+bool RdmaTarget::create(size_t size, uint64_t base_addr, string filename, bool hugepages)
+{
+    void* region;
+
+    // If we already have a region, unmap it
+    close();
+
+    // Zero-sized regions aren't useful
+    if (size == 0) return false;
+
+    if (filename.empty())
+    {
+        // Map anonymous memory, in hugepages if the caller asked for them
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+        if (hugepages) flags |= MAP_HUGETLB;
+        region = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    }
+    else
+    {
+        // Open the file and make sure it's large enough
+        int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+        if (ftruncate(fd, size) < 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        // Map the file.  The mapping stays valid after the descriptor is closed
+        region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        ::close(fd);
+    }
+
+    // If the mapping failed, tell the caller
+    if (region == MAP_FAILED) return false;
+
+    // Save the geometry of the region
+    m_region = (uint8_t*)region;
+    m_size   = size;
+    m_base   = base_addr;
+
+    // Find the smallest power-of-two range size that divides the region into TARGET_RANGES or fewer
+    m_range_shift = 0;
+    while (((m_size - 1) >> m_range_shift) >= TARGET_RANGES) ++m_range_shift;
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Unmaps the region.  For a file-backed region, this writes the data back to the file
+//==========================================================================================================
+void RdmaTarget::close()
+{
+    if (m_region) munmap(m_region, m_size);
+    m_region = NULL;
+    m_size   = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays the totals of the counters from one or more workers
+//==========================================================================================================
+void RdmaTarget::show_summary(target_stats_t** stats, int count)
+{
+    uint64_t bad_magic = 0, short_packets = 0, out_of_bounds = 0;
+    uint64_t packets[TARGET_RANGES] = {0}, bytes[TARGET_RANGES] = {0};
+
+    // Add up the counters from every worker
+    for (int i=0; i<count; ++i)
+    {
+        bad_magic     += stats[i]->bad_magic.load(memory_order_relaxed);
+        short_packets += stats[i]->short_packets.load(memory_order_relaxed);
+        out_of_bounds += stats[i]->out_of_bounds.load(memory_order_relaxed);
+        for (int r=0; r<TARGET_RANGES; ++r)
+        {
+            packets[r] += stats[i]->range_packets[r].load(memory_order_relaxed);
+            bytes[r]   += stats[i]->range_bytes[r].load(memory_order_relaxed);
+        }
+    }
+
+    // Display the reasons that packets were dropped
+    printf("RDMA target drops: bad magic %llu, short %llu, out of bounds %llu\n",
+           (unsigned long long)bad_magic, (unsigned long long)short_packets,
+           (unsigned long long)out_of_bounds);
+
+    // Display the packets and bytes written to each address range
+    for (int r=0; r<range_count(); ++r)
+    {
+        uint64_t start = m_base + (uint64_t)r * range_size();
+        printf("  0x%012llx : %llu packets, %llu bytes\n", (unsigned long long)start,
+               (unsigned long long)packets[r], (unsigned long long)bytes[r]);
+    }
+}
+//==========================================================================================================
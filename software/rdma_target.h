@@ -0,0 +1,110 @@
+//==========================================================================================================
+// rdma_target.h - Defines a host-side RDMA target that applies RDMA packets to a memory region
+//
+// This does on the host what rdma_recv.v does on the FPGA: the 8-byte target address in the RDMA header
+// says where in the region the payload belongs, and the payload is copied there.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include "rdma.h"
+#include "stats.h"
+
+// The region is divided into this many equal address ranges, each with its own counters
+const int TARGET_RANGES = 16;
+
+//==========================================================================================================
+// target_stats_t - Counters for the packets one worker has applied to the region, written by that
+//                  worker's thread
+//==========================================================================================================
+struct alignas(64) target_stats_t
+{
+    std::atomic<uint64_t>   bad_magic{0};
+    std::atomic<uint64_t>   short_packets{0};
+    std::atomic<uint64_t>   out_of_bounds{0};
+    std::atomic<uint64_t>   range_packets[TARGET_RANGES] = {};
+    std::atomic<uint64_t>   range_bytes[TARGET_RANGES]   = {};
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// RdmaTarget - A memory region that RDMA packets are written into
+//==========================================================================================================
+class RdmaTarget
+{
+public:
+
+    // Constructor, marks the region as unmapped
+    RdmaTarget() {m_region = NULL; m_size = 0; m_base = 0; m_range_shift = 0;}
+
+    // Destructor - unmaps the region
+    ~RdmaTarget() {close();}
+
+    // Maps the region.  If filename is empty, the region is anonymous memory, optionally in hugepages
+    bool    create(size_t size, uint64_t base_addr, std::string filename = "", bool hugepages = false);
+
+    // Unmaps the region (and if it's file-backed, flushes it to the file)
+    void    close();
+
+    // Validates an RDMA packet and copies its payload into the region.  Returns false if it was dropped
+    bool    apply(const void* packet, int length, target_stats_t& stats)
+    {
+        const rdma_header_t* header = (const rdma_header_t*)packet;
+
+        // The packet must be long enough to hold an RDMA header
+        if (length < RDMA_HDR_LEN)
+        {
+            bump(stats.short_packets);
+            return false;
+        }
+
+        // And it must have the RDMA magic number
+        if (header->magic() != RDMA_MAGIC)
+        {
+            bump(stats.bad_magic);
+            return false;
+        }
+
+        // The payload has to fit entirely within the region
+        uint64_t offset  = header->target_addr() - m_base;
+        uint64_t payload = length - RDMA_HDR_LEN;
+        if (offset >= m_size || payload > m_size - offset)
+        {
+            bump(stats.out_of_bounds);
+            return false;
+        }
+
+        // Copy the payload to the target address
+        memcpy(m_region + offset, header + 1, payload);
+
+        // And count it against the address range it landed in
+        int range = offset >> m_range_shift;
+        bump(stats.range_packets[range]);
+        bump(stats.range_bytes[range], payload);
+        return true;
+    }
+
+    // Returns the number of address ranges, and the size of each one
+    int     range_count() {return ((m_size - 1) >> m_range_shift) + 1;}
+    size_t  range_size()  {return (size_t)1 << m_range_shift;}
+
+    // Returns the RDMA address of the start of the region
+    uint64_t base_addr()  {return m_base;}
+
+    // Displays the counters from one or more workers
+    void    show_summary(target_stats_t** stats, int count);
+
+protected:
+
+    // The mapped region, its size, and the RDMA address it starts at
+    uint8_t*    m_region;
+    size_t      m_size;
+    uint64_t    m_base;
+
+    // An offset shifted right by this many bits is the index of its address range
+    int         m_range_shift;
+};
+//==========================================================================================================
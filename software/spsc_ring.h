@@ -0,0 +1,83 @@
+//==========================================================================================================
+// spsc_ring.h - Defines a lock-free single-producer/single-consumer ring
+//
+// Exactly one thread may push and exactly one (other) thread may pop.  The head and tail live on their
+// own cache lines, and each side keeps a private copy of the other side's index so that it only touches
+// the shared line when the ring looks full (or empty).
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+//==========================================================================================================
+// SPSCRing - A ring of items of type T
+//==========================================================================================================
+template <class T> class SPSCRing
+{
+public:
+
+    // Allocates the ring.  The capacity is rounded up to a power of two
+    void    create(uint32_t capacity)
+    {
+        uint32_t size = 1;
+        while (size < capacity) size <<= 1;
+        m_slot.resize(size);
+        m_mask = size - 1;
+    }
+
+    // Producer: appends an item.  Returns false if the ring is full
+    bool    push(const T& item)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head_cache > m_mask)
+        {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (tail - m_head_cache > m_mask) return false;
+        }
+        m_slot[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: removes up to "count" items.  Returns the number removed
+    uint32_t pop(T* item, uint32_t count)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (m_tail_cache - head < count) m_tail_cache = m_tail.load(std::memory_order_acquire);
+        uint32_t avail = m_tail_cache - head;
+        if (avail > count) avail = count;
+        for (uint32_t i=0; i<avail; ++i) item[i] = m_slot[(head + i) & m_mask];
+        m_head.store(head + avail, std::memory_order_release);
+        return avail;
+    }
+
+    // Consumer: returns a pointer to the oldest item without removing it, or NULL if the ring is empty
+    const T* peek()
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (m_tail_cache == head) m_tail_cache = m_tail.load(std::memory_order_acquire);
+        return (m_tail_cache == head) ? NULL : &m_slot[head & m_mask];
+    }
+
+    // Either side: the number of items in the ring right now
+    uint32_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+protected:
+
+    // The slots, and the mask that turns an index into a slot number
+    std::vector<T>  m_slot;
+    uint32_t        m_mask = 0;
+
+    // The consumer's index, and the consumer's copy of the producer's index
+    alignas(64) std::atomic<uint32_t> m_head{0};
+    uint32_t        m_tail_cache = 0;
+
+    // The producer's index, and the producer's copy of the consumer's index
+    alignas(64) std::atomic<uint32_t> m_tail{0};
+    uint32_t        m_head_cache = 0;
+};
+//==========================================================================================================
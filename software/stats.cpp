@@ -0,0 +1,205 @@
+//==========================================================================================================
+// stats.cpp - Implements lock-free packet counters and a thread that periodically reports them
+//==========================================================================================================
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "stats.h"
+using namespace std;
+using namespace std::chrono;
+
+
+//==========================================================================================================
+// clear() - Clears all of the counters in a snapshot to zero
+//==========================================================================================================
+void stats_snapshot_t::clear()
+{
+    memset(this, 0, sizeof(*this));
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_to() - Adds the current value of our counters to a snapshot
+//==========================================================================================================
+void packet_stats_t::add_to(stats_snapshot_t& snapshot) const
+{
+    snapshot.packets           += packets.load(memory_order_relaxed);
+    snapshot.bytes             += bytes.load(memory_order_relaxed);
+    snapshot.short_packets     += short_packets.load(memory_order_relaxed);
+    snapshot.oversized_packets += oversized_packets.load(memory_order_relaxed);
+    for (int i=0; i<STATS_BUCKETS; ++i)
+    {
+        snapshot.histogram[i] += histogram[i].load(memory_order_relaxed);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// start() - Starts the reporting thread
+//
+// Passed:  interval_ms = milliseconds between reports.  0 = Only display a summary when stopping
+//          sources     = The counters to be reported on.  These are summed together
+//==========================================================================================================
+void StatsReporter::start(int interval_ms, const vector<packet_stats_t*>& sources)
+{
+    m_interval_ms = interval_ms;
+    m_sources     = sources;
+    m_thread      = thread(&StatsReporter::run, this);
+    m_thread.detach();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// snapshot() - Sums the counters from all of our sources into a single snapshot
+//==========================================================================================================
+void StatsReporter::snapshot(stats_snapshot_t& result)
+{
+    result.clear();
+    for (auto p_source : m_sources) p_source->add_to(result);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// snapshot() - Sums the counters from the sources in a group into a single snapshot
+//==========================================================================================================
+void StatsReporter::group_t::snapshot(stats_snapshot_t& result) const
+{
+    result.clear();
+    for (auto p_source : sources) p_source->add_to(result);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// run() - Once per interval, display packet rate and throughput.  When a stop is requested, display a
+//         summary and end the program
+//==========================================================================================================
+void StatsReporter::run()
+{
+    stats_snapshot_t prior, current;
+
+    // How often we check to see if we've been asked to stop
+    const int POLL_MS = 100;
+
+    // Fetch the starting values of the counters, overall and for each group
+    snapshot(prior);
+    vector<stats_snapshot_t> group_prior(m_group.size());
+    for (size_t i=0; i<m_group.size(); ++i) m_group[i].snapshot(group_prior[i]);
+
+    // Keep track of when we started, and when we last reported
+    auto start_time  = steady_clock::now();
+    auto prior_time  = start_time;
+
+    while (!m_stop_requested)
+    {
+        // Sleep for a short while
+        usleep(POLL_MS * 1000);
+
+        // If we're not displaying periodic reports, there's nothing more to do
+        if (m_interval_ms == 0) continue;
+
+        // If it's not time for a report yet, go back to sleep
+        auto now = steady_clock::now();
+        double seconds = duration<double>(now - prior_time).count();
+        if (seconds * 1000 < m_interval_ms) continue;
+
+        // Fetch the current state of the counters
+        snapshot(current);
+
+        // Compute the deltas since the last report
+        uint64_t packets   = current.packets           - prior.packets;
+        uint64_t bytes     = current.bytes             - prior.bytes;
+        uint64_t short_pkt = current.short_packets     - prior.short_packets;
+        uint64_t oversized = current.oversized_packets - prior.oversized_packets;
+
+        // Display packets-per-second and throughput
+        printf
+        (
+            "%12.0f pkts/s  %8.3f Gbit/s  total %llu  short +%llu  oversized +%llu\n",
+            packets / seconds, bytes * 8 / seconds / 1e9,
+            (unsigned long long)current.packets,
+            (unsigned long long)short_pkt,
+            (unsigned long long)oversized
+        );
+
+        // And underneath, the throughput of each group
+        for (size_t i=0; i<m_group.size(); ++i)
+        {
+            stats_snapshot_t group;
+            m_group[i].snapshot(group);
+            printf
+            (
+                "%12.0f pkts/s  %8.3f Gbit/s  total %llu  on %s\n",
+                (group.packets - group_prior[i].packets) / seconds,
+                (group.bytes - group_prior[i].bytes) * 8 / seconds / 1e9,
+                (unsigned long long)group.packets, m_group[i].label.c_str()
+            );
+            group_prior[i] = group;
+        }
+        fflush(stdout);
+
+        // The current values become the prior values for the next report
+        prior      = current;
+        prior_time = now;
+    }
+
+    // Display the final totals
+    snapshot(current);
+    show_summary(current, duration<double>(steady_clock::now() - start_time).count());
+
+    // And end the program.  The worker threads are still running, so we skip the global destructors
+    fflush(stdout);
+    _exit(0);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays the final totals and the packet-size histogram
+//==========================================================================================================
+void StatsReporter::show_summary(stats_snapshot_t& total, double seconds)
+{
+    printf("\n");
+    printf("packets   : %llu\n", (unsigned long long)total.packets);
+    printf("bytes     : %llu\n", (unsigned long long)total.bytes);
+    printf("short     : %llu\n", (unsigned long long)total.short_packets);
+    printf("oversized : %llu\n", (unsigned long long)total.oversized_packets);
+    printf("average   : %.3f Gbit/s over %.1f seconds\n", total.bytes * 8 / seconds / 1e9, seconds);
+
+    // Display how the traffic was split among the groups
+    for (auto& group : m_group)
+    {
+        stats_snapshot_t totals;
+        group.snapshot(totals);
+        printf("  %-16s: %llu packets, %llu bytes, %.3f Gbit/s\n", group.label.c_str(),
+               (unsigned long long)totals.packets, (unsigned long long)totals.bytes,
+               totals.bytes * 8 / seconds / 1e9);
+    }
+
+    // Display each non-empty bucket of the packet-size histogram
+    printf("packet sizes:\n");
+    for (int i=0; i<STATS_BUCKETS; ++i)
+    {
+        if (total.histogram[i] == 0) continue;
+        int low  = (i == 0) ? 0 : 1 << (i-1);
+        int high = (1 << i) - 1;
+        printf("  %5d - %5d : %llu\n", low, high, (unsigned long long)total.histogram[i]);
+    }
+
+    // Display whatever else our owner wants reported
+    for (auto& show : m_extra_summary) show();
+    fflush(stdout);
+}
+//==========================================================================================================
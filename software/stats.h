@@ -0,0 +1,142 @@
+//==========================================================================================================
+// stats.h - Defines lock-free packet counters and a thread that periodically reports them
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rdma.h"
+
+// The packet-size histogram has one bucket per power of two (bucket N holds sizes 2^(N-1) thru 2^N - 1)
+const int STATS_BUCKETS = 17;
+
+//==========================================================================================================
+// stats_snapshot_t - A plain copy of the counters in one or more packet_stats_t objects
+//==========================================================================================================
+struct stats_snapshot_t
+{
+    uint64_t    packets;
+    uint64_t    bytes;
+    uint64_t    short_packets;
+    uint64_t    oversized_packets;
+    uint64_t    histogram[STATS_BUCKETS];
+
+    // Clear all counters to zero
+    void        clear();
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// bump() - Adds to a counter that is updated by exactly one thread and read by any number of others.
+//
+// Because there is only a single writer, the counter is updated with a relaxed load and store rather than
+// an atomic read-modify-write instruction.  This keeps the hot path free of locked instructions.  Every
+// struct of counters in rdma_loop and its tools follows this rule and uses this function.
+//==========================================================================================================
+inline void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// packet_stats_t - Counters that are updated by exactly one thread (with bump) and read by any number of
+//                  others
+//==========================================================================================================
+struct alignas(64) packet_stats_t
+{
+    std::atomic<uint64_t>   packets{0};
+    std::atomic<uint64_t>   bytes{0};
+    std::atomic<uint64_t>   short_packets{0};
+    std::atomic<uint64_t>   oversized_packets{0};
+    std::atomic<uint64_t>   histogram[STATS_BUCKETS] = {};
+
+    // Call this from the owning thread to count a packet of the specified length
+    void count(int length)
+    {
+        bump(packets);
+        bump(bytes, length);
+        if (length < RDMA_HDR_LEN)    bump(short_packets);
+        if (length > RDMA_MAX_PACKET) bump(oversized_packets);
+        bump(histogram[bucket(length)]);
+    }
+
+    // Adds the current value of these counters to a snapshot
+    void add_to(stats_snapshot_t& snapshot) const;
+
+    // Returns the index of the histogram bucket for a packet of the specified length
+    static int bucket(int length)
+    {
+        int index = (length < 1) ? 0 : 32 - __builtin_clz(length);
+        return (index < STATS_BUCKETS) ? index : STATS_BUCKETS - 1;
+    }
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// StatsReporter - Runs a thread that periodically displays throughput and, when asked to stop, a summary
+//==========================================================================================================
+class StatsReporter
+{
+public:
+
+    // Starts the reporting thread.  An interval of 0 means "only report the summary at the end"
+    void    start(int interval_ms, const std::vector<packet_stats_t*>& sources);
+
+    // Async-signal-safe: asks the reporting thread to display the summary and exit the program
+    void    request_stop() {m_stop_requested = true;}
+
+    // Sums the counters of all the sources into a snapshot
+    void    snapshot(stats_snapshot_t& result);
+
+    // Registers a function that displays additional totals after the summary.  Call before start()
+    void    add_summary(std::function<void()> show) {m_extra_summary.push_back(show);}
+
+    // Registers a subset of the sources (such as the workers serving one port) whose throughput is
+    // also displayed on its own line under each report, and in the summary.  Call before start()
+    void    add_group(std::string label, const std::vector<packet_stats_t*>& sources)
+            {m_group.push_back({label, sources});}
+
+protected:
+
+    // This is the body of the reporting thread
+    void    run();
+
+    // Displays the final totals and the packet-size histogram
+    void    show_summary(stats_snapshot_t& total, double seconds);
+
+    // A labelled subset of the sources
+    struct group_t
+    {
+        std::string                  label;
+        std::vector<packet_stats_t*> sources;
+
+        // Sums the counters of this group's sources into a snapshot
+        void    snapshot(stats_snapshot_t& result) const;
+    };
+
+    // The interval between reports, in milliseconds
+    int     m_interval_ms;
+
+    // The counters we are reporting on
+    std::vector<packet_stats_t*> m_sources;
+
+    // Subsets of those counters that are also reported on separately
+    std::vector<group_t> m_group;
+
+    // Functions that display additional totals after the summary
+    std::vector<std::function<void()>> m_extra_summary;
+
+    // This becomes true when the reporting thread should shut down
+    std::atomic<bool> m_stop_requested{false};
+
+    // The reporting thread
+    std::thread m_thread;
+};
+//==========================================================================================================
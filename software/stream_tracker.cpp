@@ -0,0 +1,224 @@
+//==========================================================================================================
+// stream_tracker.cpp - Implements a tracker that detects lost, duplicated and reordered RDMA packets
+//==========================================================================================================
+#include <stdio.h>
+#include <string.h>
+#include "stream_tracker.h"
+#include "rdma.h"
+using namespace std;
+
+
+
+//==========================================================================================================
+// find() - Finds the stream that belongs to a sender
+//
+// Passed:  source = the key that identifies the sender
+//          stats  = counters to update if this is a new stream
+//
+// Returns: the stream, or NULL if the sender is new and every stream is already in use
+//==========================================================================================================
+StreamTracker::stream_t* StreamTracker::find(uint64_t source, stream_stats_t& stats)
+{
+    // Packets tend to arrive in long runs from the same sender
+    if (m_stream_count && m_stream[m_last].source == source) return &m_stream[m_last];
+
+    // Otherwise, look through the streams we know about
+    for (int i=0; i<m_stream_count; ++i)
+    {
+        if (m_stream[i].source == source)
+        {
+            m_last = i;
+            return &m_stream[i];
+        }
+    }
+
+    // If there's no room for another stream, we can't track this sender
+    if (m_stream_count == STREAM_MAX) return NULL;
+
+    // Start a new stream.  It's initialized by the first packet
+    m_last = m_stream_count++;
+    m_stream[m_last].source = source;
+    m_stream[m_last].stride = 0;
+    bump(stats.streams);
+    return &m_stream[m_last];
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// restart() - Starts a stream over, with the specified address or sequence number as packet number 0
+//
+// Passed:  stream      = the stream to restart
+//          by_sequence = true if packets are numbered by their sequence numbers rather than by address
+//          base        = the target address (or sequence number) of the packet that starts the stream
+//          stride      = the payload length of that packet.  Later packets are numbered in these units.
+//                        1 when numbering by sequence
+//==========================================================================================================
+void StreamTracker::restart(stream_t& stream, bool by_sequence, uint64_t base, uint64_t stride)
+{
+    stream.by_sequence = by_sequence;
+    stream.base        = base;
+    stream.stride      = stride;
+    stream.first       = 0;
+    stream.next        = 1;
+    memset(stream.seen, 0, sizeof stream.seen);
+    stream.seen[0]     = 1;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// track() - Checks where an RDMA packet falls in its sender's stream
+//
+// Passed:  source = the key that identifies the sender of the packet
+//          packet = the packet, starting with its RDMA header
+//          length = the length of the packet in bytes
+//          stats  = the counters to update
+//==========================================================================================================
+void StreamTracker::track(uint64_t source, const void* packet, int length, stream_stats_t& stats)
+{
+    // Packets without a valid RDMA header or with no payload don't belong to any stream
+    const rdma_header_t* header = (const rdma_header_t*)packet;
+    if (length <= RDMA_HDR_LEN || header->magic() != RDMA_MAGIC) return;
+
+    // A flow-controlled sender numbers its packets, and otherwise we go by address and payload length
+    bool     by_sequence = (header->flow() & RDMA_FC_DATA) != 0;
+    uint64_t position    = by_sequence ? header->sequence() : header->target_addr();
+    uint64_t stride      = by_sequence ? 1 : length - RDMA_HDR_LEN;
+
+    // Find the stream this packet belongs to
+    stream_t* p_stream = find(source, stats);
+    if (p_stream == NULL)
+    {
+        bump(stats.untracked);
+        return;
+    }
+    stream_t& stream = *p_stream;
+    bump(stats.packets);
+
+    // The first packet of a stream sets the base and the packet size
+    if (stream.stride == 0)
+    {
+        restart(stream, by_sequence, position, stride);
+        return;
+    }
+
+    // If the sender has switched between sequence numbers and addresses, or the stream began with a
+    // short packet (the tail of a region) and this one is longer, number the stream afresh from here
+    if (by_sequence != stream.by_sequence || stride > stream.stride)
+    {
+        bump(stats.restarts);
+        restart(stream, by_sequence, position, stride);
+        return;
+    }
+
+    // Work out the packet's number.  Sequence numbers wrap at 32 bits.  A packet that doesn't start on a
+    // packet boundary can't be placed in the stream.  One below the base gets a negative number, and is
+    // placed like any other
+    int64_t number;
+    if (by_sequence)
+        number = (int32_t)(uint32_t)(position - stream.base);
+    else
+    {
+        int64_t offset = (int64_t)(position - stream.base);
+        if (offset % (int64_t)stream.stride)
+        {
+            bump(stats.misaligned);
+            return;
+        }
+        number = offset / (int64_t)stream.stride;
+    }
+
+    // Which bit in the window belongs to a packet number.  Negative numbers wrap like positive ones
+    auto slot = [](int64_t n) {return (uint64_t)n % STREAM_WINDOW;};
+    auto bit  = [&](int64_t n) -> uint64_t& {return stream.seen[slot(n) / 64];};
+    auto mask = [&](int64_t n) {return 1ULL << (slot(n) % 64);};
+
+    // The packet we expected, or one further on: anything we skipped over is a gap
+    if (number >= stream.next)
+    {
+        uint64_t skipped = number - stream.next;
+        if (skipped) bump(stats.gaps, skipped);
+
+        // Slide the window forward, clearing the bits of the packets we skipped
+        if (skipped >= STREAM_WINDOW)
+            memset(stream.seen, 0, sizeof stream.seen);
+        else
+            for (int64_t n = stream.next; n < number; ++n) bit(n) &= ~mask(n);
+
+        bit(number) |= mask(number);
+        stream.next = number + 1;
+        return;
+    }
+
+    // A packet from before the window means the sender has started a new pass, and so does seeing the
+    // lowest-numbered packet of the stream again once we've moved past it: a region shorter than the
+    // window being sent over again.  (A genuine duplicate of that one packet is mistaken for a new pass)
+    uint64_t depth = stream.next - 1 - number;
+    bool     seen  = (bit(number) & mask(number)) != 0;
+    if (depth >= STREAM_WINDOW || (seen && depth && number == stream.first))
+    {
+        bump(stats.restarts);
+        restart(stream, by_sequence, position, stride);
+        return;
+    }
+
+    // A packet within the window that we've already seen is a duplicate
+    if (seen)
+    {
+        bump(stats.duplicates);
+        return;
+    }
+
+    // Otherwise it's a late arrival that fills in part of a gap
+    bit(number) |= mask(number);
+    if (number < stream.first) stream.first = number;
+    bump(stats.reordered);
+    if (depth > stats.max_reorder_depth.load(memory_order_relaxed))
+    {
+        stats.max_reorder_depth.store(depth, memory_order_relaxed);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// show_summary() - Displays the stream counters of one or more workers
+//==========================================================================================================
+void StreamTracker::show_summary(stream_stats_t** stats, int count)
+{
+    uint64_t streams = 0, packets = 0, gaps = 0, reordered = 0, depth = 0, duplicates = 0;
+    uint64_t restarts = 0, misaligned = 0, untracked = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+        streams    += stats[i]->streams.load(memory_order_relaxed);
+        packets    += stats[i]->packets.load(memory_order_relaxed);
+        gaps       += stats[i]->gaps.load(memory_order_relaxed);
+        reordered  += stats[i]->reordered.load(memory_order_relaxed);
+        duplicates += stats[i]->duplicates.load(memory_order_relaxed);
+        restarts   += stats[i]->restarts.load(memory_order_relaxed);
+        misaligned += stats[i]->misaligned.load(memory_order_relaxed);
+        untracked  += stats[i]->untracked.load(memory_order_relaxed);
+        uint64_t worker_depth = stats[i]->max_reorder_depth.load(memory_order_relaxed);
+        if (worker_depth > depth) depth = worker_depth;
+    }
+
+    // Gaps that were later filled in were reordering, not loss
+    uint64_t lost = (gaps > reordered) ? gaps - reordered : 0;
+
+    printf("streams   : %llu from %llu senders, %llu lost, %llu reordered (max depth %llu), %llu duplicates\n",
+           (unsigned long long)packets, (unsigned long long)streams, (unsigned long long)lost,
+           (unsigned long long)reordered, (unsigned long long)depth, (unsigned long long)duplicates);
+
+    // These only show up when something unusual is going on
+    if (restarts || misaligned || untracked)
+    {
+        printf("            %llu restarts, %llu misaligned, %llu from untracked senders\n",
+               (unsigned long long)restarts, (unsigned long long)misaligned, (unsigned long long)untracked);
+    }
+}
+//==========================================================================================================
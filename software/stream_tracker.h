@@ -0,0 +1,95 @@
+//==========================================================================================================
+// stream_tracker.h - Defines a tracker that detects lost, duplicated and reordered RDMA packets
+//
+// The FPGA (like rdma_send) walks through a region, so each packet's target address is the previous
+// packet's address plus the previous packet's payload length.  A stream is the packets from one sender.
+// The tracker numbers each packet of a stream by its offset from the first address it saw, in units of
+// the longest payload it has seen.  Packets below that first address get negative numbers, so it doesn't
+// matter whether the first packet was at the start of a pass.  A sender that asks for flow control
+// (RDMA_FC_DATA) numbers its packets itself, and the tracker uses those sequence numbers instead, which
+// keep counting from one pass to the next.  It then keeps a sliding bitmap of the most recent
+// STREAM_WINDOW packet numbers:
+//
+//     - a packet past the end of the window moves the window forward. Any skipped numbers count as a gap
+//     - a packet inside the window whose bit is already set is a duplicate
+//     - a packet inside the window whose bit is clear arrived out of order and fills part of an earlier
+//       gap.  How far behind the newest packet it arrived is its reorder depth
+//     - a packet from before the window, or a second visit to the lowest-numbered packet after the stream
+//       has moved past it, means the sender has started over (a new pass through the region), so the
+//       stream is restarted
+//
+// Packets lost for good are the gaps that were never filled.  Each tracker has a fixed number of streams
+// and is used by exactly one thread.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "stats.h"
+
+// The number of packets the sliding bitmap of each stream covers.  Must be a multiple of 64
+const int STREAM_WINDOW = 1024;
+
+// The number of senders each tracker follows.  Packets from any more are counted but not tracked
+const int STREAM_MAX = 64;
+
+//==========================================================================================================
+// stream_stats_t - Counters for the streams one worker is tracking, written by that worker's thread
+//==========================================================================================================
+struct alignas(64) stream_stats_t
+{
+    std::atomic<uint64_t>   streams{0};
+    std::atomic<uint64_t>   packets{0};
+    std::atomic<uint64_t>   gaps{0};
+    std::atomic<uint64_t>   reordered{0};
+    std::atomic<uint64_t>   max_reorder_depth{0};
+    std::atomic<uint64_t>   duplicates{0};
+    std::atomic<uint64_t>   restarts{0};
+    std::atomic<uint64_t>   misaligned{0};
+    std::atomic<uint64_t>   untracked{0};
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// StreamTracker - Follows the RDMA packet streams arriving from up to STREAM_MAX senders
+//==========================================================================================================
+class StreamTracker
+{
+public:
+
+    // Constructor, allocates room for every stream up front
+    StreamTracker() {m_stream.resize(STREAM_MAX); m_stream_count = 0; m_last = 0;}
+
+    // Examines one RDMA packet from the specified sender (see UDPSock::source_key())
+    void    track(uint64_t source, const void* packet, int length, stream_stats_t& stats);
+
+    // Displays the stream counters of one or more workers
+    static void show_summary(stream_stats_t** stats, int count);
+
+protected:
+
+    // The state of one stream
+    struct stream_t
+    {
+        uint64_t    source;
+        bool        by_sequence;
+        uint64_t    base;
+        uint64_t    stride;
+        int64_t     first;
+        int64_t     next;
+        uint64_t    seen[STREAM_WINDOW / 64];
+    };
+
+    // Finds the stream for a sender, creating it if need be.  Returns NULL if there's no room
+    stream_t* find(uint64_t source, stream_stats_t& stats);
+
+    // Starts a stream over at the specified address or sequence number
+    void    restart(stream_t& stream, bool by_sequence, uint64_t base, uint64_t stride);
+
+    // The streams, the number in use, and the index of the one that was used most recently
+    std::vector<stream_t> m_stream;
+    int     m_stream_count;
+    int     m_last;
+};
+//==========================================================================================================
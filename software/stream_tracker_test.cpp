@@ -0,0 +1,153 @@
+//==========================================================================================================
+// stream_tracker_test.cpp - Feeds StreamTracker synthetic packet streams and checks what it counts
+//==========================================================================================================
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "stream_tracker.h"
+#include "rdma.h"
+using namespace std;
+
+// The number of checks that have failed
+int failures = 0;
+
+// The size of each payload and of the region the senders walk through
+const int PAYLOAD = 8192;
+const int REGION  = 1 << 20;
+
+// The sender every test packet comes from
+const uint64_t SOURCE = 0x7F0000017D02ULL;
+
+//==========================================================================================================
+// feeder_t - Builds RDMA packets and hands them to a tracker
+//==========================================================================================================
+struct feeder_t
+{
+    StreamTracker   tracker;
+    stream_stats_t  stats;
+    vector<uint8_t> packet = vector<uint8_t>(RDMA_HDR_LEN + PAYLOAD);
+
+    // Sends one packet for "addr" with a payload of "length" bytes.  A sequence number of -1 means the
+    // packet isn't flow-controlled
+    void send(uint64_t addr, int length = PAYLOAD, int64_t sequence = -1)
+    {
+        rdma_header_t& header = *(rdma_header_t*)packet.data();
+        header.set(addr);
+        if (sequence >= 0)
+        {
+            header.set_sequence(sequence);
+            header.set_flow(RDMA_FC_DATA);
+        }
+        tracker.track(SOURCE, packet.data(), RDMA_HDR_LEN + length, stats);
+    }
+
+    // Sends every packet of the region, in order
+    void send_pass(int64_t* sequence = NULL)
+    {
+        for (int offset = 0; offset < REGION; offset += PAYLOAD)
+        {
+            send(offset, PAYLOAD, sequence ? (*sequence)++ : -1);
+        }
+    }
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// check() - Compares one counter with what it should be, and reports a mismatch
+//==========================================================================================================
+void check(const char* test, const char* name, const atomic<uint64_t>& counter, uint64_t expected)
+{
+    uint64_t actual = counter.load();
+    if (actual == expected) return;
+    printf("FAIL %s: %s is %llu, expected %llu\n", test, name, (unsigned long long)actual,
+           (unsigned long long)expected);
+    ++failures;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// A region shorter than the window, sent three times, is three passes rather than one pass followed by
+// duplicates
+//==========================================================================================================
+void test_repeated_short_region()
+{
+    const char* test = "repeated short region";
+    feeder_t f;
+    for (int pass = 0; pass < 3; ++pass) f.send_pass();
+    check(test, "packets",    f.stats.packets,    3 * REGION / PAYLOAD);
+    check(test, "gaps",       f.stats.gaps,       0);
+    check(test, "duplicates", f.stats.duplicates, 0);
+    check(test, "reordered",  f.stats.reordered,  0);
+    check(test, "restarts",   f.stats.restarts,   2);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// With flow control, sequence numbers keep counting from pass to pass, so there's nothing to restart
+//==========================================================================================================
+void test_sequence_numbers()
+{
+    const char* test = "sequence numbers";
+    feeder_t f;
+    int64_t sequence = 0xFFFFFF00;
+    for (int pass = 0; pass < 3; ++pass) f.send_pass(&sequence);
+    check(test, "gaps",       f.stats.gaps,       0);
+    check(test, "duplicates", f.stats.duplicates, 0);
+    check(test, "restarts",   f.stats.restarts,   0);
+    check(test, "misaligned", f.stats.misaligned, 0);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// A stream first seen on the short tail of a region is renumbered in units of the full-sized packets
+// that follow, rather than finding them all misaligned
+//==========================================================================================================
+void test_short_first_packet()
+{
+    const char* test = "short first packet";
+    feeder_t f;
+    f.send(REGION - 100, 100);
+    for (int pass = 0; pass < 2; ++pass) f.send_pass();
+    check(test, "misaligned", f.stats.misaligned, 0);
+    check(test, "gaps",       f.stats.gaps,       0);
+    check(test, "duplicates", f.stats.duplicates, 0);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// Loss, duplication and reordering in the middle of a pass are still told apart
+//==========================================================================================================
+void test_loss_duplicate_reorder()
+{
+    const char* test = "loss, duplicate and reorder";
+    feeder_t f;
+    for (int n = 0; n < 20; ++n)
+    {
+        if (n == 5 || n == 10) continue;
+        f.send(n * PAYLOAD);
+        if (n == 7)  f.send(n * PAYLOAD);
+        if (n == 11) f.send(10 * PAYLOAD);
+    }
+    check(test, "gaps",       f.stats.gaps,       2);
+    check(test, "reordered",  f.stats.reordered,  1);
+    check(test, "duplicates", f.stats.duplicates, 1);
+    check(test, "restarts",   f.stats.restarts,   0);
+}
+//==========================================================================================================
+
+
+int main()
+{
+    test_repeated_short_region();
+    test_sequence_numbers();
+    test_short_first_packet();
+    test_loss_duplicate_reorder();
+
+    printf("stream_tracker_test: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
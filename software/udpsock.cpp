@@ -2,10 +2,78 @@
 // udpsock.cpp - Implements a class that manages UDP sockets
 //==========================================================================================================
 #include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <time.h>
+#include <errno.h>
 #include "udpsock.h"
 #include "netutil.h"
 using namespace std;
 
+// The size of the control-message buffer for each message in a batch.  This is big enough for a GRO
+// segment size and a set of timestamps at the same time
+static const int CONTROL_LEN = 128;
+
+// The most datagrams the kernel will split a single GSO send into
+static const int GSO_MAX_SEGMENTS = 64;
+
+// The most zero-copy messages that may be outstanding at once.  Must be a power of two
+static const uint32_t ZC_WINDOW = 65536;
+
+// The most timestamped messages that may be waiting for their transmit timestamp.  Must be a power of 2
+static const uint32_t TS_WINDOW = 4096;
+
+// send_batch() reads transmit timestamps whenever this many are waiting
+static const uint32_t TS_REAP_THRESHOLD = 64;
+
+
+//==========================================================================================================
+// realtime_ns() - Returns CLOCK_REALTIME in nanoseconds.  Kernel timestamps are on this clock
+//==========================================================================================================
+static uint64_t realtime_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// gso_messages() - Returns the number of messages send_batch() needs to send a packet
+//==========================================================================================================
+static int gso_messages(const udp_packet_t& packet)
+{
+    return (UDPSock::segment_count(packet) + GSO_MAX_SEGMENTS - 1) / GSO_MAX_SEGMENTS;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// Constructor - Marks the socket as closed, with none of the optional features enabled
+//==========================================================================================================
+UDPSock::UDPSock()
+{
+    m_sd           = -1;
+    m_family       = AF_UNSPEC;
+    m_gro          = false;
+    m_zc_threshold = 0;
+    m_zc_issued    = 0;
+    m_zc_completed = 0;
+    m_zc_copied    = 0;
+    m_rx_stamps    = false;
+    m_tx_histogram = NULL;
+    m_ts_issued    = 0;
+    m_ts_reported  = 0;
+    m_paced        = false;
+    m_txtime       = false;
+}
+//==========================================================================================================
+
 
 
 //==========================================================================================================
@@ -21,6 +89,7 @@ bool UDPSock::create_sender(int port, string server, int family)
 
     // Create the socket
     m_sd = socket(m_target.family, m_target.socktype, m_target.protocol);
+    m_family = m_target.family;
 
     // If that failed, tell the caller
     if (m_sd < 0) return false;
@@ -47,6 +116,7 @@ bool UDPSock::create_broadcaster(int port, string server, int family)
 
     // Create the socket
     m_sd = socket(m_target.family, m_target.socktype, m_target.protocol);
+    m_family = m_target.family;
 
     // If that failed, tell the caller
     if (m_sd < 0) return false;
@@ -69,8 +139,10 @@ bool UDPSock::create_broadcaster(int port, string server, int family)
 //==========================================================================================================
 // create_server() - Creates a socket for listening on a UDP port
 //==========================================================================================================
-bool UDPSock::create_server(int port, string bind_to, int family)
+bool UDPSock::create_server(int port, string bind_to, int family, bool reuse_port, string device)
 {
+    int one = 1;
+
     // If the socket is open, close it
     close();
 
@@ -79,10 +151,23 @@ bool UDPSock::create_server(int port, string bind_to, int family)
 
     // Create the socket
     m_sd = socket(info.family, info.socktype, info.protocol);
+    m_family = info.family;
 
     // If that failed, tell the caller
     if (m_sd < 0) return false;
 
+    // If we're sharing this port with other sockets, say so before we bind
+    if (reuse_port && setsockopt(m_sd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one) == -1)
+    {
+        return false;
+    }
+
+    // Sockets tied to different interfaces may bind the same port, provided they're tied before binding
+    if (!device.empty() && setsockopt(m_sd, SOL_SOCKET, SO_BINDTODEVICE, device.c_str(), device.size()) < 0)
+    {
+        return false;
+    }
+
     // Bind the socket to the specified port
     if (bind(m_sd, info, info.addrlen) < 0) return false;
 
@@ -93,11 +178,47 @@ bool UDPSock::create_server(int port, string bind_to, int family)
 
 
 
+//==========================================================================================================
+// bind_to_interface() - Ties a sender or broadcaster to one network interface.  Packets (broadcasts
+//                       included) leave through that interface, with its IP address as their source
+//
+// Passed:  iface = Name of the interface ("eth0", "eth1", etc)
+//
+// Returns: true on success, false if the interface has no IPv4 address or the socket can't be bound
+//==========================================================================================================
+bool UDPSock::bind_to_interface(string iface)
+{
+    ipv4_t local;
+
+    // Find out what IP address the interface has
+    if (!NetUtil::get_local_ip(iface, &local)) return false;
+
+    // Route every packet from this socket out through the interface
+    if (setsockopt(m_sd, SOL_SOCKET, SO_BINDTODEVICE, iface.c_str(), iface.size()) < 0) return false;
+
+    // And send from the interface's address, on whatever port the kernel picks
+    addrinfo_t info = NetUtil::get_local_addrinfo(SOCK_DGRAM, 0, local.text(), AF_INET);
+    return bind(m_sd, info, info.addrlen) == 0;
+}
+//==========================================================================================================
+
+
+
 //==========================================================================================================
 // send() - Call this to transmit data on a "Sender" socket
 //==========================================================================================================
 void UDPSock::send(const void* msg, int length)
 {
+    // A paced message goes through the same path as a batch of them
+    if (m_paced)
+    {
+        udp_packet_t packet = {};
+        packet.data   = (void*)msg;
+        packet.length = length;
+        send_batch(&packet, 1);
+        return;
+    }
+
     sendto(m_sd, msg, length, 0, m_target, m_target.addrlen);
 }
 //==========================================================================================================
@@ -135,6 +256,767 @@ int UDPSock::receive(void* buffer, int buf_size, string* p_source)
 
 
 
+//==========================================================================================================
+// reserve_batch() - Ensures that the recvmmsg()/sendmmsg() scratch space can describe "count" messages
+//==========================================================================================================
+void UDPSock::reserve_batch(int count)
+{
+    if (m_mmsg.size() < count)
+    {
+        m_mmsg.resize(count);
+        m_iov.resize(count);
+        m_control.resize((size_t)count * CONTROL_LEN);
+        m_name.resize(count);
+        m_msg_zc.resize(count);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// receive_batch() - Waits for at least one packet to arrive on a server socket, then fetches as many
+//                   more as are already queued, up to "count" packets, in a single system call
+//
+// Passed:  packet = array of packet descriptors.  "data" and "capacity" must be filled in by the caller
+//          count  = the number of entries in the packet array
+//
+// Returns: The number of packets received (with "length" filled in), or -1 on error
+//==========================================================================================================
+int UDPSock::receive_batch(udp_packet_t* packet, int count)
+{
+    // Make sure we have enough scratch space to describe "count" messages
+    reserve_batch(count);
+
+    // Point each message header at the caller's buffer
+    for (int i=0; i<count; ++i)
+    {
+        m_iov[i].iov_base = packet[i].data;
+        m_iov[i].iov_len  = packet[i].capacity;
+        memset(&m_mmsg[i].msg_hdr, 0, sizeof(msghdr));
+        m_mmsg[i].msg_hdr.msg_iov     = &m_iov[i];
+        m_mmsg[i].msg_hdr.msg_iovlen  = 1;
+        m_mmsg[i].msg_hdr.msg_name    = &m_name[i];
+        m_mmsg[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+
+        // With GRO or timestamps, the kernel tells us the segment size or the time in control messages
+        if (m_gro || m_rx_stamps)
+        {
+            m_mmsg[i].msg_hdr.msg_control    = &m_control[i * CONTROL_LEN];
+            m_mmsg[i].msg_hdr.msg_controllen = CONTROL_LEN;
+        }
+    }
+
+    // Block until at least one packet arrives, then grab everything else that is waiting
+    int packet_count = recvmmsg(m_sd, m_mmsg.data(), count, MSG_WAITFORONE, NULL);
+
+    // Tell the caller how long each packet is, whether it holds several coalesced datagrams, and when
+    // it arrived
+    for (int i=0; i<packet_count; ++i)
+    {
+        packet[i].length         = m_mmsg[i].msg_len;
+        packet[i].segment_size   = 0;
+        packet[i].rx_software_ns = 0;
+        packet[i].rx_hardware_ns = 0;
+        packet[i].source         = source_key(m_name[i]);
+        if (!m_gro && !m_rx_stamps) continue;
+
+        msghdr* p_msg = &m_mmsg[i].msg_hdr;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(p_msg); cmsg; cmsg = CMSG_NXTHDR(p_msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                int segment_size;
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof segment_size);
+                if (segment_size < packet[i].length) packet[i].segment_size = segment_size;
+            }
+
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+            {
+                scm_timestamping stamps;
+                memcpy(&stamps, CMSG_DATA(cmsg), sizeof stamps);
+                packet[i].rx_software_ns = stamps.ts[0].tv_sec * 1000000000ULL + stamps.ts[0].tv_nsec;
+                packet[i].rx_hardware_ns = stamps.ts[2].tv_sec * 1000000000ULL + stamps.ts[2].tv_nsec;
+            }
+        }
+    }
+
+    // Tell the caller how many packets we fetched
+    return packet_count;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// send_batch() - Sends an array of packets to the target of a "Sender" socket
+//
+// Passed:  packet = array of packet descriptors.  "data" and "length" must be filled in by the caller
+//          count  = the number of entries in the packet array
+//
+// Returns: The number of packets sent, or -1 on error
+//==========================================================================================================
+int UDPSock::send_batch(const udp_packet_t* packet, int count)
+{
+    // A packet with more datagrams than one GSO send allows is sent as several messages
+    int message_count = 0;
+    for (int i=0; i<count; ++i) message_count += gso_messages(packet[i]);
+
+    // Make sure we have enough scratch space to describe that many messages
+    reserve_batch(message_count);
+
+    // Build a message header for each packet (or each GSO-sized piece of one)
+    int m = 0;
+    for (int i=0; i<count; ++i)
+    {
+        char* data   = (char*)packet[i].data;
+        int   length = packet[i].length;
+        int   seg    = packet[i].segment_size;
+        int   piece  = (seg && length > seg) ? seg * GSO_MAX_SEGMENTS : length;
+        int   offset = 0;
+
+        do
+        {
+            int piece_len = (length - offset < piece) ? length - offset : piece;
+            m_iov[m].iov_base = data + offset;
+            m_iov[m].iov_len  = piece_len;
+            memset(&m_mmsg[m].msg_hdr, 0, sizeof(msghdr));
+            m_mmsg[m].msg_hdr.msg_name    = (sockaddr*)m_target;
+            m_mmsg[m].msg_hdr.msg_namelen = m_target.addrlen;
+            m_mmsg[m].msg_hdr.msg_iov     = &m_iov[m];
+            m_mmsg[m].msg_hdr.msg_iovlen  = 1;
+
+            // Large enough messages go out without being copied
+            m_msg_zc[m] = m_zc_threshold && piece_len >= m_zc_threshold;
+
+            // If this piece holds more than one datagram, tell the kernel where to split it
+            if (seg && piece_len > seg)
+            {
+                msghdr* p_msg = &m_mmsg[m].msg_hdr;
+                p_msg->msg_control    = &m_control[m * CONTROL_LEN];
+                p_msg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                cmsghdr* cmsg    = CMSG_FIRSTHDR(p_msg);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type  = UDP_SEGMENT;
+                cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gso_size = seg;
+                memcpy(CMSG_DATA(cmsg), &gso_size, sizeof gso_size);
+            }
+
+            offset += piece_len;
+            ++m;
+        }
+        while (offset < length);
+    }
+
+    // With transmit timestamps, we need to know when each message was handed to the kernel
+    uint64_t send_ns = m_tx_histogram ? realtime_ns() : 0;
+
+    // sendmmsg() is allowed to send fewer than we ask for, so keep going until they're all gone
+    int sent = 0, paced = 0;
+    while (sent < message_count)
+    {
+        // When we're paced, the messages go in bursts that the token bucket allows
+        if (m_paced && sent == paced) paced += pace(sent, message_count - sent);
+        int limit = m_paced ? paced : message_count;
+
+        // MSG_ZEROCOPY applies to a whole sendmmsg(), so send runs of messages that agree about it
+        int run = 1;
+        bool zerocopy = m_msg_zc[sent];
+        while (sent + run < limit && m_msg_zc[sent + run] == zerocopy) ++run;
+
+        int rc = sendmmsg(m_sd, &m_mmsg[sent], run, zerocopy ? MSG_ZEROCOPY : 0);
+        if (rc < 0)
+        {
+            // If the kernel has run out of room to pin pages, wait for earlier sends to complete
+            if (zerocopy && errno == ENOBUFS)
+            {
+                reap_zerocopy();
+                continue;
+            }
+            break;
+        }
+
+        // Every zero-copy message gets the next message number
+        if (zerocopy) m_zc_issued += rc;
+        sent += rc;
+
+        // Every message gets the next timestamp ID
+        if (m_tx_histogram)
+        {
+            for (int i=0; i<rc; ++i) m_ts_sent[m_ts_issued++ & (TS_WINDOW - 1)] = send_ns;
+        }
+    }
+
+    // If enough transmit timestamps are waiting, go read them.  With SO_TXTIME, the kernel reports
+    // packets that missed their departure time there too
+    if (m_tx_histogram && m_ts_issued - m_ts_reported >= TS_REAP_THRESHOLD) reap_error_queue();
+    else if (m_txtime) reap_error_queue();
+
+    // Figure out how many packets went out in their entirety
+    int packets_sent = 0;
+    for (int i=0, messages=0; i<count; ++i)
+    {
+        messages += gso_messages(packet[i]);
+        if (messages > sent) break;
+        ++packets_sent;
+    }
+
+    // Tell the caller how many packets were sent
+    return (sent || message_count == 0) ? packets_sent : -1;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// send_gather() - Sends an array of packets, each of which is gathered from several pieces of memory.
+//                 This allows a header and a payload that live in different places to be sent as one
+//                 datagram without first copying them together
+//
+// Passed:  iov            = array of count * iov_per_packet iovecs.  Each group of iov_per_packet
+//                           consecutive entries describes one packet
+//          iov_per_packet = the number of iovecs that make up each packet
+//          count          = the number of packets
+//
+// Returns: The number of packets sent, or -1 on error
+//==========================================================================================================
+int UDPSock::send_gather(const iovec* iov, int iov_per_packet, int count)
+{
+    // Make sure we have enough scratch space to describe "count" messages
+    reserve_batch(count);
+
+    // Build a message header for each packet
+    for (int i=0; i<count; ++i)
+    {
+        memset(&m_mmsg[i].msg_hdr, 0, sizeof(msghdr));
+        m_mmsg[i].msg_hdr.msg_name    = (sockaddr*)m_target;
+        m_mmsg[i].msg_hdr.msg_namelen = m_target.addrlen;
+        m_mmsg[i].msg_hdr.msg_iov     = (iovec*)&iov[(size_t)i * iov_per_packet];
+        m_mmsg[i].msg_hdr.msg_iovlen  = iov_per_packet;
+    }
+
+    // sendmmsg() is allowed to send fewer than we ask for, so keep going until they're all gone.  When
+    // we're paced, they go in bursts that the token bucket allows
+    int sent = 0, paced = 0;
+    while (sent < count)
+    {
+        if (m_paced && sent == paced) paced += pace(sent, count - sent);
+        int limit = m_paced ? paced : count;
+        int rc = sendmmsg(m_sd, &m_mmsg[sent], limit - sent, 0);
+        if (rc < 0) return sent ? sent : -1;
+        sent += rc;
+    }
+
+    // With SO_TXTIME, the kernel reports packets that missed their departure time on the error queue
+    if (m_txtime) reap_error_queue();
+
+    // Tell the caller how many packets were sent
+    return sent;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// enable_zerocopy() - Turns on MSG_ZEROCOPY for large sends
+//
+// With zero-copy, the kernel transmits straight out of the caller's buffer, so the buffer must not be
+// reused until the kernel says it's done with it.   Use zerocopy_issued() after a send, and
+// reap_zerocopy()/zerocopy_completed() to find out when that point has been reached.
+//
+// Passed:  threshold = sends shorter than this are copied as usual, since pinning pages costs more than
+//                      copying a small packet
+//
+// Returns: true if the kernel supports zero-copy on this socket
+//==========================================================================================================
+bool UDPSock::enable_zerocopy(int threshold)
+{
+    int one = 1;
+    if (setsockopt(m_sd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof one) < 0) return false;
+    m_zc_threshold = threshold > 0 ? threshold : 1;
+    m_zc_issued    = 0;
+    m_zc_completed = 0;
+    m_zc_copied    = 0;
+    m_zc_done.assign(ZC_WINDOW, 0);
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// enable_rx_timestamps() - Asks the kernel to report when each received packet arrived
+//
+// Software timestamps are always available.  Hardware timestamps are reported only if the NIC has been
+// told to timestamp incoming packets (for instance by ptp4l, or "hwstamp_ctl -r 1")
+//==========================================================================================================
+bool UDPSock::enable_rx_timestamps()
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE
+              | SOF_TIMESTAMPING_SOFTWARE    | SOF_TIMESTAMPING_RAW_HARDWARE;
+    if (!add_timestamping(flags)) return false;
+    m_rx_stamps = true;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// enable_tx_timestamps() - Asks the kernel to report when each sent packet was handed to the NIC driver
+//
+// Passed:  histogram = where to record the time between send_batch() and that point, in nanoseconds
+//==========================================================================================================
+bool UDPSock::enable_tx_timestamps(LatencyHistogram* histogram)
+{
+    int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+              | SOF_TIMESTAMPING_OPT_ID      | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (!add_timestamping(flags)) return false;
+    m_tx_histogram = histogram;
+    m_ts_issued    = 0;
+    m_ts_reported  = 0;
+    m_ts_sent.assign(TS_WINDOW, 0);
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_timestamping() - Turns on SO_TIMESTAMPING flags without turning off any that are already on.  The
+//                      socket option replaces the whole set, so we read it back and add to it
+//
+// Passed:  flags = the SOF_TIMESTAMPING_* flags to turn on
+//
+// Returns: true on success
+//==========================================================================================================
+bool UDPSock::add_timestamping(int flags)
+{
+    int       current = 0;
+    socklen_t length  = sizeof current;
+    if (getsockopt(m_sd, SOL_SOCKET, SO_TIMESTAMPING, &current, &length) < 0) current = 0;
+
+    flags |= current;
+    return setsockopt(m_sd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof flags) == 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// reap_error_queue() - Reads every notification waiting on the socket's error queue, without blocking.
+//                      These are zero-copy completions and transmit timestamps
+//==========================================================================================================
+void UDPSock::reap_error_queue()
+{
+    char control[CONTROL_LEN];
+
+    while (true)
+    {
+        msghdr msg = {};
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof control;
+        if (recvmsg(m_sd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        // A transmit timestamp arrives as a pair of control messages: the time, and its ID
+        uint64_t stamp_ns = 0;
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+            {
+                scm_timestamping stamps;
+                memcpy(&stamps, CMSG_DATA(cmsg), sizeof stamps);
+                stamp_ns = stamps.ts[0].tv_sec * 1000000000ULL + stamps.ts[0].tv_nsec;
+                continue;
+            }
+
+            bool is_recverr = (cmsg->cmsg_level == SOL_IP   && cmsg->cmsg_type == IP_RECVERR)
+                           || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!is_recverr) continue;
+
+            sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof err);
+
+            // A transmit timestamp: record how long after send_batch() the packet reached the driver
+            if (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING && m_tx_histogram)
+            {
+                uint64_t sent_ns = m_ts_sent[err.ee_data & (TS_WINDOW - 1)];
+                if (stamp_ns >= sent_ns) m_tx_histogram->record(stamp_ns - sent_ns);
+                m_ts_reported = err.ee_data + 1;
+                continue;
+            }
+
+            // A packet that the qdisc dropped because its departure time had passed (or was invalid)
+            if (err.ee_origin == SO_EE_ORIGIN_TXTIME)
+            {
+                bump(m_pacer.stats.missed);
+                continue;
+            }
+
+            // Anything else we care about is a zero-copy completion
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+            // Each zero-copy notification covers a range of message numbers
+            uint32_t first = err.ee_info, last = err.ee_data;
+
+            // Keep track of how often the kernel had to copy the data after all
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) m_zc_copied += last - first + 1;
+
+            // Mark each message in the range as complete
+            for (uint32_t id = first; id != last + 1; ++id) m_zc_done[id & (ZC_WINDOW - 1)] = 1;
+        }
+    }
+
+    // Move past every zero-copy message that has completed, in order
+    while (m_zc_completed != m_zc_issued && m_zc_done[m_zc_completed & (ZC_WINDOW - 1)])
+    {
+        m_zc_done[m_zc_completed++ & (ZC_WINDOW - 1)] = 0;
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// send_to() - Sends a datagram back to the IPv4 sender of a packet we received
+//
+// Passed:  msg    = the datagram
+//          length = its length in bytes
+//          source = the "source" of the received packet (see source_key())
+//
+// Returns: true if the datagram was sent, false if it couldn't be, or if the sender wasn't IPv4
+//==========================================================================================================
+bool UDPSock::send_to(const void* msg, int length, uint64_t source)
+{
+    sockaddr_storage address = {};
+    socklen_t        address_len;
+
+    // IPv6 senders are only known by a hash, so they can't be replied to
+    if (source >> 63) return false;
+    uint32_t ipv4_be = htonl(source >> 16);
+    uint16_t port_be = htons(source & 0xFFFF);
+
+    // A dual-stack IPv6 socket reaches IPv4 senders through v4-mapped addresses
+    if (m_family == AF_INET6)
+    {
+        sockaddr_in6& sin6 = (sockaddr_in6&)address;
+        sin6.sin6_family = AF_INET6;
+        sin6.sin6_port   = port_be;
+        sin6.sin6_addr.s6_addr[10] = 0xFF;
+        sin6.sin6_addr.s6_addr[11] = 0xFF;
+        memcpy(&sin6.sin6_addr.s6_addr[12], &ipv4_be, sizeof ipv4_be);
+        address_len = sizeof sin6;
+    }
+    else
+    {
+        sockaddr_in& sin = (sockaddr_in&)address;
+        sin.sin_family      = AF_INET;
+        sin.sin_port        = port_be;
+        sin.sin_addr.s_addr = ipv4_be;
+        address_len = sizeof sin;
+    }
+
+    return sendto(m_sd, msg, length, 0, (sockaddr*)&address, address_len) == length;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// enable_gro() - Asks the kernel to coalesce runs of same-sized datagrams from the same flow into one
+//                receive.  receive_batch() reports the size of the coalesced datagrams in "segment_size"
+//==========================================================================================================
+bool UDPSock::enable_gro()
+{
+    int one = 1;
+    if (setsockopt(m_sd, SOL_UDP, UDP_GRO, &one, sizeof one) < 0) return false;
+    m_gro = true;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// enable_pacing() - Holds everything this socket sends to a steady rate
+//
+// In token-bucket mode, send_batch() and send_gather() sleep until the bucket holds enough tokens for
+// the next burst of messages, then hand the whole burst to the kernel at once.  In SO_TXTIME mode, every
+// message is stamped with the time it is due to leave at exactly the configured rate, and an ETF qdisc
+// (e.g. "tc qdisc add dev <iface> parent <queue> etf clockid CLOCK_TAI delta 200000") holds it until then.
+// Without such a qdisc, the departure times are ignored and the messages leave in bursts
+//
+// Passed:  gbps        = the rate in Gbit/s
+//          burst_bytes = the depth of the token bucket: the most that may leave back-to-back or, with
+//                        SO_TXTIME, how much the qdisc is given to hold ahead of its departure times
+//          txtime      = true to hand departure times to the kernel
+//
+// Returns: true on success, false if the kernel doesn't support SO_TXTIME
+//==========================================================================================================
+bool UDPSock::enable_pacing(double gbps, uint64_t burst_bytes, bool txtime)
+{
+    if (gbps <= 0 || burst_bytes == 0) return false;
+
+    // Ask the kernel to honor departure times, and to tell us about packets that miss theirs
+    if (txtime)
+    {
+        sock_txtime config = {CLOCK_TAI, SOF_TXTIME_REPORT_ERRORS};
+        if (setsockopt(m_sd, SOL_SOCKET, SO_TXTIME, &config, sizeof config) < 0) return false;
+    }
+
+    m_pacer.set_rate(gbps);
+    m_pacer.set_burst(burst_bytes);
+    m_pacer.start();
+    m_paced  = true;
+    m_txtime = txtime;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// pace() - Waits until a burst of messages may be sent or, with SO_TXTIME, stamps each message in the
+//          burst with its departure time and waits until the burst is due
+//
+// Passed:  first = the index in m_mmsg of the first message waiting to be sent
+//          count = the number of messages waiting
+//
+// Returns: the number of messages (always at least 1) that are now free to be handed to sendmmsg()
+//==========================================================================================================
+int UDPSock::pace(int first, int count)
+{
+    // Returns the number of bytes in one message
+    auto message_bytes = [this](int m)
+    {
+        uint64_t bytes = 0;
+        const msghdr& msg = m_mmsg[m].msg_hdr;
+        for (size_t i=0; i<msg.msg_iovlen; ++i) bytes += msg.msg_iov[i].iov_len;
+        return bytes;
+    };
+
+    // Take as many messages as fit in one burst
+    uint64_t bytes = message_bytes(first);
+    int      n = 1;
+    while (n < count && bytes + message_bytes(first + n) <= m_pacer.burst())
+    {
+        bytes += message_bytes(first + n++);
+    }
+
+    // In token-bucket mode, wait for the tokens
+    if (!m_txtime)
+    {
+        m_pacer.wait(bytes);
+        return n;
+    }
+
+    // Pacer times are on the monotonic clock, and departure times are on CLOCK_TAI
+    timespec ts;
+    clock_gettime(CLOCK_TAI, &ts);
+    int64_t tai_offset = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - Pacer::now_ns();
+
+    // Give each message the time it's due to leave.  Departure times trail the schedule by one burst,
+    // so even the first message after an idle spell is still in the future when it reaches the qdisc
+    int64_t first_due = 0;
+    for (int i=first; i<first+n; ++i)
+    {
+        int64_t  due_ns  = m_pacer.schedule(message_bytes(i));
+        uint64_t txtime  = due_ns + m_pacer.burst_ns() + tai_offset;
+        if (i == first) first_due = due_ns;
+
+        // The departure time follows whatever control message (a GSO segment size) is already there
+        msghdr* p_msg = &m_mmsg[i].msg_hdr;
+        if (p_msg->msg_control == NULL)
+        {
+            p_msg->msg_control    = &m_control[i * CONTROL_LEN];
+            p_msg->msg_controllen = 0;
+        }
+        cmsghdr* cmsg    = (cmsghdr*)((char*)p_msg->msg_control + p_msg->msg_controllen);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_TXTIME;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof txtime);
+        memcpy(CMSG_DATA(cmsg), &txtime, sizeof txtime);
+        p_msg->msg_controllen += CMSG_SPACE(sizeof txtime);
+    }
+
+    // Hand the burst over once it's due, so the qdisc never holds much more than a burst
+    m_pacer.release(first_due);
+    return n;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// enable_busy_poll() - Has each receive on this socket poll the NIC's receive queue directly (for up to
+//                      "usec" microseconds) rather than waiting for an interrupt, prefers that busy
+//                      polling over interrupt-driven processing, and puts the socket in non-blocking
+//                      mode so that the caller can spin on it.  Raising the busy-poll time above the
+//                      net.core.busy_read sysctl requires CAP_NET_ADMIN
+//==========================================================================================================
+bool UDPSock::enable_busy_poll(int usec)
+{
+    int one = 1;
+    if (setsockopt(m_sd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof usec) < 0) return false;
+    if (setsockopt(m_sd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof one) < 0) return false;
+    return set_blocking(false);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// set_receive_buffer() - Asks the kernel for a receive buffer of the specified size.  SO_RCVBUFFORCE
+//                        (which needs CAP_NET_ADMIN) can exceed the net.core.rmem_max sysctl, and plain
+//                        SO_RCVBUF is the fallback
+//
+// Passed:  bytes = the size of the receive buffer we'd like
+//
+// Returns: the size the kernel granted, which it counts against the memory each packet really takes up
+//==========================================================================================================
+int UDPSock::set_receive_buffer(int bytes)
+{
+    if (setsockopt(m_sd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof bytes) < 0)
+    {
+        setsockopt(m_sd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof bytes);
+    }
+
+    int       granted = 0;
+    socklen_t length  = sizeof granted;
+    getsockopt(m_sd, SOL_SOCKET, SO_RCVBUF, &granted, &length);
+    return granted;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// queue_empty() - Checks whether the socket's receive queue is empty by peeking at it without waiting.
+//                 A zero-length peek succeeds if any datagram is queued (even an empty one, which
+//                 FIONREAD couldn't tell apart from an empty queue) and fails with EAGAIN if none is
+//
+// Returns: true if no packets are waiting to be received
+//==========================================================================================================
+bool UDPSock::queue_empty()
+{
+    if (recv(m_sd, NULL, 0, MSG_PEEK | MSG_DONTWAIT) >= 0) return false;
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// source_key() - Packs the address and port of the sender of a packet into a 64-bit key
+//
+// Passed:  address = the sender's address, as filled in by recvmmsg()
+//
+// Returns: for IPv4 (including IPv4-mapped IPv6), the address in bits 16-47 and the port in bits 0-15.
+//          For IPv6, a hash of the address and port with bit 63 set.  0 for anything else
+//==========================================================================================================
+uint64_t UDPSock::source_key(const sockaddr_storage& address)
+{
+    if (address.ss_family == AF_INET)
+    {
+        const sockaddr_in& sin = (const sockaddr_in&)address;
+        return source_key(sin.sin_addr.s_addr, sin.sin_port);
+    }
+
+    if (address.ss_family == AF_INET6)
+    {
+        const sockaddr_in6& sin6 = (const sockaddr_in6&)address;
+        if (IN6_IS_ADDR_V4MAPPED(&sin6.sin6_addr))
+        {
+            uint32_t ipv4_be;
+            memcpy(&ipv4_be, &sin6.sin6_addr.s6_addr[12], sizeof ipv4_be);
+            return source_key(ipv4_be, sin6.sin6_port);
+        }
+
+        // FNV-1a over the address and port
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (int i=0; i<16; ++i) hash = (hash ^ sin6.sin6_addr.s6_addr[i]) * 0x100000001b3ULL;
+        hash = (hash ^ sin6.sin6_port) * 0x100000001b3ULL;
+        return hash | (1ULL << 63);
+    }
+
+    return 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// source_name() - Turns a key made by source_key() back into something a human can read
+//==========================================================================================================
+string UDPSock::source_name(uint64_t key)
+{
+    char text[64];
+
+    if (key == 0)
+        return "unknown";
+    else if (key >> 63)
+        snprintf(text, sizeof text, "ipv6:%016llx", (unsigned long long)key);
+    else
+    {
+        uint32_t ip = key >> 16;
+        snprintf(text, sizeof text, "%u.%u.%u.%u:%u", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF,
+                 ip & 0xFF, (unsigned)(key & 0xFFFF));
+    }
+    return text;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// split_segments() - Splits a packet that holds several coalesced datagrams into one descriptor per
+//                    datagram, without copying any data
+//
+// Passed:  packet = the packet to split
+//          out    = where to store the descriptors.  It must have room for segment_count(packet) entries
+//
+// Returns: The number of descriptors stored in "out"
+//==========================================================================================================
+int UDPSock::split_segments(const udp_packet_t& packet, udp_packet_t* out)
+{
+    int count = segment_count(packet);
+    int size  = (count == 1) ? packet.length : packet.segment_size;
+    char* data = (char*)packet.data;
+
+    for (int i=0; i<count; ++i)
+    {
+        // Each datagram inherits the timestamps and sender of the packet it came in
+        int offset = i * size;
+        out[i]              = packet;
+        out[i].data         = data + offset;
+        out[i].capacity     = size;
+        out[i].length       = (packet.length - offset < size) ? packet.length - offset : size;
+        out[i].segment_size = 0;
+    }
+
+    return count;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// set_blocking() - Puts the socket into blocking or non-blocking mode.   In non-blocking mode, receive()
+//                  and receive_batch() return -1 (with errno == EAGAIN) when no packet is waiting
+//==========================================================================================================
+bool UDPSock::set_blocking(bool blocking)
+{
+    int flags = fcntl(m_sd, F_GETFL);
+    if (flags < 0) return false;
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    return fcntl(m_sd, F_SETFL, flags) == 0;
+}
+//==========================================================================================================
+
+
+
 //==========================================================================================================
 // wait_for_data() - Waits for the specified amount of time for data to be available for reading
 //
@@ -6,7 +6,40 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string>
+#include <vector>
 #include "netutil.h"
+#include "histogram.h"
+#include "pacer.h"
+
+//==========================================================================================================
+// udp_packet_t - Describes one datagram for receive_batch() and send_batch()
+//==========================================================================================================
+struct udp_packet_t
+{
+    // Points to the packet data
+    void*   data;
+
+    // On receive, the size of the buffer that "data" points to
+    int     capacity;
+
+    // The number of bytes in the packet
+    int     length;
+
+    // If this isn't zero, "data" holds several back-to-back datagrams of this size (the last one may be
+    // shorter).  receive_batch() sets this when GRO has coalesced datagrams, and send_batch() uses GSO
+    // to send them as separate datagrams again
+    int     segment_size;
+
+    // With receive timestamps enabled, when the kernel (software) and the NIC (hardware) saw the packet,
+    // in nanoseconds.  0 if not available.  The software stamp is on CLOCK_REALTIME.  The hardware stamp
+    // is raw, on the NIC's own PTP hardware clock, so it's only comparable with the software stamp when
+    // something (phc2sys, say) keeps that clock synchronised with the system clock
+    uint64_t rx_software_ns;
+    uint64_t rx_hardware_ns;
+
+    // On receive, identifies who sent the packet (see UDPSock::source_key()).  0 if not known
+    uint64_t source;
+};
 
 //==========================================================================================================
 // UDPSock() - UDP socket for sending or receiving UDP datagrams
@@ -16,7 +49,7 @@ class UDPSock
 public:
 
     // Constructor, marks the socket as closed
-    UDPSock() {m_sd = -1;}
+    UDPSock();
     
     // Destructor - Closes the socket
     ~UDPSock() {close();}
@@ -27,12 +60,22 @@ public:
     // Create a socket that we will send UDP packets on.
     bool    create_sender(int port, std::string dest, int family = AF_INET);
 
-    // Create a socket that we will use to receive UDP packets
-    bool    create_server(int port, std::string bind_to = "", int family = AF_UNSPEC);
+    // Create a socket that we will use to receive UDP packets.  With reuse_port, several sockets
+    // may bind the same port and the kernel spreads incoming packets across them.  With a device,
+    // only packets that arrive on that interface are received
+    bool    create_server(int port, std::string bind_to = "", int family = AF_UNSPEC, bool reuse_port = false,
+                          std::string device = "");
+
+    // Makes a sender or broadcaster transmit only through the specified interface, from its address
+    bool    bind_to_interface(std::string iface);
 
     // Closes the socket
     void    close();
 
+    // Sends a datagram back to whoever sent a received packet, identified by its "source" key.  Only
+    // IPv4 senders can be replied to
+    bool    send_to(const void* msg, int length, uint64_t source);
+
     // Call this to send a message
     void    send(const void* msg, int length);
 
@@ -42,15 +85,149 @@ public:
     // Call this to wait for a UDP packet to arrive
     int     receive(void* buffer, int buffer_length, std::string* p_peer_ip = NULL);
 
+    // Waits for at least one packet, then fetches as many as are available (up to count)
+    int     receive_batch(udp_packet_t* packet, int count);
+
+    // Sends "count" packets to the target with as few system calls as possible
+    int     send_batch(const udp_packet_t* packet, int count);
+
+    // Sends "count" packets, each gathered from "iov_per_packet" consecutive entries of the iov array
+    int     send_gather(const iovec* iov, int iov_per_packet, int count);
+
+    // Packets received into caller-owned buffers don't need to be handed back
+    void    release_batch(const udp_packet_t* packet, int count) {}
+
+    // Turns on MSG_ZEROCOPY for sends of at least "threshold" bytes.  Smaller sends are still copied
+    bool    enable_zerocopy(int threshold = 8192);
+
+    // Drains zero-copy completion notifications.  Returns zerocopy_completed()
+    uint32_t reap_zerocopy() {reap_error_queue(); return m_zc_completed;}
+
+    // Asks the kernel to timestamp received packets.  receive_batch() fills in rx_software_ns, and if
+    // the NIC has been configured to timestamp packets, rx_hardware_ns
+    bool    enable_rx_timestamps();
+
+    // Asks the kernel to timestamp each sent packet as it is handed to the NIC driver.  The time from
+    // send_batch() to that point is recorded in "histogram", which must be written only by this socket
+    bool    enable_tx_timestamps(LatencyHistogram* histogram);
+
+    // Reads zero-copy completions and transmit timestamps from the error queue without blocking
+    void    reap_error_queue();
+
+    // Every zero-copy message is numbered, starting at 0.  zerocopy_issued() is the number of
+    // zero-copy messages sent so far, and zerocopy_completed() is the number whose buffers the kernel
+    // has released (all messages numbered below it are done with)
+    uint32_t zerocopy_issued()    {return m_zc_issued;}
+    uint32_t zerocopy_completed() {return m_zc_completed;}
+
+    // Returns the number of zero-copy messages that the kernel ended up copying anyway
+    uint64_t zerocopy_copied()    {return m_zc_copied;}
+
+    // Asks the kernel to coalesce runs of datagrams from the same flow into a single receive (UDP GRO)
+    bool    enable_gro();
+
+    // Holds send(), send_batch() and send_gather() to "gbps" Gbit/s, in bursts of at most "burst_bytes".
+    // With txtime, each message instead carries its departure time (SO_TXTIME on CLOCK_TAI) and an ETF
+    // qdisc on the interface releases it then, with the sender staying no more than a burst ahead
+    bool    enable_pacing(double gbps, uint64_t burst_bytes = PACER_DEFAULT_BURST, bool txtime = false);
+
+    // Returns the pacer, whose counters say what rate was achieved and how punctually
+    const Pacer& get_pacer() {return m_pacer;}
+
+    // Splits a packet that holds several GRO-coalesced datagrams into one descriptor per datagram.  The
+    // descriptors point into the original buffer.  Returns the number of datagrams
+    static int split_segments(const udp_packet_t& packet, udp_packet_t* out);
+
+    // Returns the number of datagrams in a packet that may hold several GRO-coalesced datagrams
+    static int segment_count(const udp_packet_t& packet)
+    {
+        if (packet.segment_size == 0 || packet.length <= packet.segment_size) return 1;
+        return (packet.length + packet.segment_size - 1) / packet.segment_size;
+    }
+
+    // Returns a key that identifies the sender of a packet: for IPv4, the address and port packed into
+    // 48 bits, and for IPv6, a hash of them with the top bit set
+    static uint64_t source_key(const sockaddr_storage& address);
+    static uint64_t source_key(uint32_t ipv4_be, uint16_t port_be)
+    {
+        return ((uint64_t)ntohl(ipv4_be) << 16) | ntohs(port_be);
+    }
+
+    // Turns a source key back into "ip:port" for display
+    static std::string source_name(uint64_t key);
+
+    // Puts the socket in blocking or non-blocking mode
+    bool    set_blocking(bool blocking);
+
+    // Puts the socket in non-blocking mode, and has each receive poll the NIC for up to "usec"
+    // microseconds instead of waiting for an interrupt
+    bool    enable_busy_poll(int usec);
+
+    // Asks for a receive buffer of "bytes", and returns the size the kernel actually granted
+    int     set_receive_buffer(int bytes);
+
+    // Returns true if no packets are waiting to be received.  Doesn't block, and doesn't consume any
+    bool    queue_empty();
+
     // Returns the socket descriptor of this socket
     int     get_sd() {return m_sd;}
 
+    // Returns the address that send() and send_batch() transmit to
+    const addrinfo_t& get_target() {return m_target;}
+
 protected:
 
-    // The file descriptor
+    // The file descriptor, and its address family
     int        m_sd;
+    int        m_family;
 
     // The address IP address/port/etc of the UDP target
     addrinfo_t m_target;
+
+    // True if UDP GRO is enabled on this socket
+    bool       m_gro;
+
+    // If non-zero, messages at least this long are sent with MSG_ZEROCOPY
+    int        m_zc_threshold;
+
+    // Zero-copy message numbers: the number issued, the number known to be complete, the number the
+    // kernel copied anyway, and a flag per outstanding message number that is set when it completes
+    uint32_t   m_zc_issued, m_zc_completed;
+    uint64_t   m_zc_copied;
+    std::vector<uint8_t> m_zc_done;
+
+    // True if receive timestamps are enabled
+    bool       m_rx_stamps;
+
+    // Adds to the SO_TIMESTAMPING flags already set on the socket, so receive and transmit timestamps
+    // can be enabled one after the other
+    bool       add_timestamping(int flags);
+
+    // For transmit timestamps: where to record send-completion latency, the number of messages sent
+    // and reported on, and the time each outstanding message was sent
+    LatencyHistogram*     m_tx_histogram;
+    uint32_t              m_ts_issued, m_ts_reported;
+    std::vector<uint64_t> m_ts_sent;
+
+    // Scratch space for recvmmsg() and sendmmsg(), including one control-message buffer per message.
+    // These only ever grow
+    std::vector<mmsghdr> m_mmsg;
+    std::vector<iovec>   m_iov;
+    std::vector<char>    m_control;
+    std::vector<sockaddr_storage> m_name;
+
+    // For each message in m_mmsg, true if it is to be sent with MSG_ZEROCOPY
+    std::vector<uint8_t> m_msg_zc;
+
+    // Ensures that the scratch space above can hold "count" messages
+    void       reserve_batch(int count);
+
+    // With pacing enabled: the token bucket, and whether departure times are handed to the kernel
+    bool       m_paced, m_txtime;
+    Pacer      m_pacer;
+
+    // Waits until the next burst of the "count" messages starting at m_mmsg[first] may go, or stamps
+    // them with their departure times.  Returns how many messages are in the burst
+    int        pace(int first, int count);
 };
 //==========================================================================================================
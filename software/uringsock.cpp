@@ -0,0 +1,453 @@
+//==========================================================================================================
+// uringsock.cpp - Implements an io_uring packet I/O engine that drives a pair of UDPSock objects
+//==========================================================================================================
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uringsock.h"
+using namespace std;
+
+// The number of submission queue entries
+static const uint32_t SQ_ENTRIES = 1024;
+
+// The buffer group ID of our provided-buffer ring
+static const int BUFFER_GROUP = 0;
+
+// The user_data of the multishot receive.  Sends carry the ID of the buffer they're sending
+static const uint64_t RECV_TAG = ~0ULL;
+
+
+//==========================================================================================================
+// These manipulate the head and tail indices that we share with the kernel
+//==========================================================================================================
+static inline uint32_t load_acquire(uint32_t* p) {return __atomic_load_n(p, __ATOMIC_ACQUIRE);}
+static inline void store_release(uint32_t* p, uint32_t v) {__atomic_store_n(p, v, __ATOMIC_RELEASE);}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// There are no glibc wrappers for the io_uring system calls
+//==========================================================================================================
+static int io_uring_setup(unsigned entries, io_uring_params* p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// Constructor - Marks the ring as closed
+//==========================================================================================================
+UringSock::UringSock()
+{
+    m_fd       = -1;
+    m_sq_map   = NULL;
+    m_sqes     = NULL;
+    m_buf_ring = NULL;
+    m_buffers  = NULL;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// create() - Creates the io_uring, registers a provided-buffer ring, and arms the multishot receive
+//
+// Passed:  server       = the socket to receive packets on
+//          sender       = the socket to send packets on.  Packets go to this socket's target
+//          buffer_count = the number of receive buffers.  Must be a power of 2
+//          buffer_size  = the size of each receive buffer
+//
+// Returns: true on success
+//==========================================================================================================
+bool UringSock::create(UDPSock& server, UDPSock& sender, int buffer_count, int buffer_size)
+{
+    io_uring_params params;
+
+    // If the ring is open, close it
+    close();
+
+    // Save the sockets we work with
+    m_server_sd = server.get_sd();
+    m_sender_sd = sender.get_sd();
+    m_target    = sender.get_target();
+
+    // Every buffer can have both a receive and a send completion outstanding at once.  The kernel also
+    // insists that the completion queue be at least as large as the submission queue
+    memset(&params, 0, sizeof params);
+    params.flags      = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * (buffer_count > SQ_ENTRIES ? buffer_count : SQ_ENTRIES);
+
+    // Create the ring
+    m_fd = io_uring_setup(SQ_ENTRIES, &params);
+    if (m_fd < 0) return false;
+
+    // We depend on the SQ and CQ rings sharing a single mapping
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) return false;
+
+    // Map the SQ and CQ rings
+    size_t cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_sq_map_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    if (cq_map_len > m_sq_map_len) m_sq_map_len = cq_map_len;
+    m_sq_map = mmap(NULL, m_sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                    IORING_OFF_SQ_RING);
+    if (m_sq_map == MAP_FAILED)
+    {
+        m_sq_map = NULL;
+        return false;
+    }
+
+    // Map the array of submission queue entries
+    m_sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(NULL, m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 m_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+    {
+        m_sqes = NULL;
+        return false;
+    }
+
+    // Find the fields of the submission queue
+    uint8_t* sq = (uint8_t*)m_sq_map;
+    m_sq_head    = (uint32_t*)(sq + params.sq_off.head);
+    m_sq_tail    = (uint32_t*)(sq + params.sq_off.tail);
+    m_sq_array   = (uint32_t*)(sq + params.sq_off.array);
+    m_sq_mask    = *(uint32_t*)(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_pending = 0;
+
+    // Find the fields of the completion queue.   It shares the mapping with the submission queue
+    uint8_t* cq = (uint8_t*)m_sq_map;
+    m_cq_head = (uint32_t*)(cq + params.cq_off.head);
+    m_cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+    m_cqes    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    m_cq_mask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+
+    // Allocate the provided-buffer ring and the buffers themselves
+    m_buffer_count = buffer_count;
+    m_buffer_size  = buffer_size;
+    m_buf_ring_len = buffer_count * sizeof(io_uring_buf);
+    m_buf_ring = (io_uring_buf*)mmap(NULL, m_buf_ring_len, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (m_buf_ring == MAP_FAILED)
+    {
+        m_buf_ring = NULL;
+        return false;
+    }
+
+    // The tail index overlays the "resv" field of the first entry.  We don't use the "bufs" member of
+    // io_uring_buf_ring because in C++ its flexible-array declaration puts it at the wrong offset
+    m_buf_tail = &((io_uring_buf_ring*)m_buf_ring)->tail;
+    m_buffers = (uint8_t*)mmap(NULL, (size_t)buffer_count * buffer_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (m_buffers == MAP_FAILED)
+    {
+        m_buffers = NULL;
+        return false;
+    }
+
+    // Register the provided-buffer ring with the kernel
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr    = (uint64_t)m_buf_ring;
+    reg.ring_entries = buffer_count;
+    reg.bgid         = BUFFER_GROUP;
+    if (io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+
+    // Build the message header and iovec that each buffer's send will use
+    m_send_msg.resize(buffer_count);
+    m_send_iov.resize(buffer_count);
+    for (int bid=0; bid<buffer_count; ++bid)
+    {
+        memset(&m_send_msg[bid], 0, sizeof(msghdr));
+        m_send_msg[bid].msg_name    = (sockaddr*)m_target;
+        m_send_msg[bid].msg_namelen = m_target.addrlen;
+        m_send_msg[bid].msg_iov     = &m_send_iov[bid];
+        m_send_msg[bid].msg_iovlen  = 1;
+    }
+
+    // Hand every buffer to the kernel
+    *m_buf_tail = 0;
+    for (int bid=0; bid<buffer_count; ++bid) recycle(bid);
+
+    // The multishot receive wants room for the sender's address (so packets can be told apart by
+    // source), but no control messages.  The kernel puts the address between the header and the payload
+    memset(&m_recv_msg, 0, sizeof m_recv_msg);
+    m_recv_msg.msg_namelen = sizeof(sockaddr_storage);
+
+    // And start receiving
+    arm_receive();
+    return enter(false) >= 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Tears down the ring and frees the buffers
+//==========================================================================================================
+void UringSock::close()
+{
+    if (m_fd != -1) ::close(m_fd);
+    m_fd = -1;
+
+    if (m_sqes) munmap(m_sqes, m_sqes_len);
+    m_sqes = NULL;
+
+    if (m_sq_map) munmap(m_sq_map, m_sq_map_len);
+    m_sq_map = NULL;
+
+    if (m_buf_ring) munmap(m_buf_ring, m_buf_ring_len);
+    m_buf_ring = NULL;
+
+    if (m_buffers) munmap(m_buffers, (size_t)m_buffer_count * m_buffer_size);
+    m_buffers = NULL;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// get_sqe() - Returns a zeroed submission queue entry.  If the queue is full, pending entries are
+//             submitted first
+//==========================================================================================================
+io_uring_sqe* UringSock::get_sqe()
+{
+    uint32_t tail = *m_sq_tail + m_sq_pending;
+
+    // If the submission queue is full, submit what's in it
+    if (tail - load_acquire(m_sq_head) >= m_sq_entries)
+    {
+        enter(false);
+        tail = *m_sq_tail;
+    }
+
+    // Fetch the SQE and clear it
+    uint32_t index = tail & m_sq_mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    // The SQE at this position in the ring is the one with the same index
+    m_sq_array[index] = index;
+    ++m_sq_pending;
+    return sqe;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// enter() - Submits pending SQEs, and if "wait" is true, waits for at least one completion
+//==========================================================================================================
+int UringSock::enter(bool wait)
+{
+    // Publish the pending SQEs to the kernel
+    uint32_t to_submit = m_sq_pending;
+    store_release(m_sq_tail, *m_sq_tail + to_submit);
+    m_sq_pending = 0;
+
+    // If there's nothing to submit and nothing to wait for, there's no need for a system call
+    if (to_submit == 0 && !wait) return 0;
+
+    // Submit them, and wait for a completion if the caller asked us to
+    int rc;
+    do
+    {
+        rc = io_uring_enter(m_fd, to_submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+    }
+    while (rc < 0 && errno == EINTR);
+
+    return rc;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// arm_receive() - Queues a multishot RECVMSG on the server socket
+//==========================================================================================================
+void UringSock::arm_receive()
+{
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = m_server_sd;
+    sqe->addr      = (uint64_t)&m_recv_msg;
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = RECV_TAG;
+    m_need_arm     = false;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// recycle() - Returns a buffer to the provided-buffer ring so the kernel can receive into it again
+//==========================================================================================================
+void UringSock::recycle(int bid)
+{
+    uint16_t tail = *m_buf_tail;
+    io_uring_buf& buf = m_buf_ring[tail & (m_buffer_count - 1)];
+    buf.addr = (uint64_t)(m_buffers + (size_t)bid * m_buffer_size);
+    buf.len  = m_buffer_size;
+    buf.bid  = bid;
+    __atomic_store_n(m_buf_tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// buffer_id() - Returns the ID of the buffer that holds a packet from receive_batch()
+//==========================================================================================================
+int UringSock::buffer_id(const udp_packet_t& packet)
+{
+    return ((uint8_t*)packet.data - m_buffers) / m_buffer_size;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// receive_batch() - Waits for at least one packet to arrive, then fetches as many more as have already
+//                   completed, up to "count" packets
+//
+// On return, each descriptor points into one of our buffers.  Each packet must subsequently be passed to
+// send_batch() or release_batch() to return its buffer to the kernel.
+//
+// Returns: The number of packets received
+//==========================================================================================================
+int UringSock::receive_batch(udp_packet_t* packet, int count)
+{
+    int n = 0;
+
+    while (true)
+    {
+        uint32_t head = *m_cq_head;
+        uint32_t tail = load_acquire(m_cq_tail);
+
+        // Walk through the completions that are waiting for us
+        while (head != tail && n < count)
+        {
+            io_uring_cqe& cqe = m_cqes[head++ & m_cq_mask];
+
+            // A completed send means that buffer is free again
+            if (cqe.user_data != RECV_TAG)
+            {
+                recycle(cqe.user_data);
+                continue;
+            }
+
+            // If the multishot receive has stopped (usually because we ran out of buffers), re-arm it
+            if (!(cqe.flags & IORING_CQE_F_MORE)) m_need_arm = true;
+
+            // If this completion doesn't carry a packet, ignore it
+            if (cqe.res < 0 || !(cqe.flags & IORING_CQE_F_BUFFER)) continue;
+
+            // Find the buffer this packet landed in
+            int bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t* buffer = m_buffers + (size_t)bid * m_buffer_size;
+
+            // The buffer starts with a header that tells us how long the packet is, followed by the
+            // sender's address and then the packet
+            io_uring_recvmsg_out* out = (io_uring_recvmsg_out*)buffer;
+            int offset   = sizeof(io_uring_recvmsg_out) + m_recv_msg.msg_namelen;
+            int capacity = m_buffer_size - offset;
+            int length   = out->payloadlen;
+            if (length > capacity) length = capacity;
+
+            // Fetch the sender's address
+            sockaddr_storage source;
+            memset(&source, 0, sizeof source);
+            size_t namelen = out->namelen;
+            if (namelen > sizeof source) namelen = sizeof source;
+            memcpy(&source, out + 1, namelen);
+
+            // Point the caller's descriptor at the packet
+            packet[n].data           = buffer + offset;
+            packet[n].capacity       = capacity;
+            packet[n].length         = length;
+            packet[n].segment_size   = 0;
+            packet[n].rx_software_ns = 0;
+            packet[n].rx_hardware_ns = 0;
+            packet[n].source         = UDPSock::source_key(source);
+            ++n;
+        }
+
+        // Tell the kernel we've consumed those completions
+        store_release(m_cq_head, head);
+
+        // If the receive needs to be re-armed, do so
+        if (m_need_arm) arm_receive();
+
+        // If we have packets for the caller, we're done
+        if (n) break;
+
+        // Otherwise, submit anything that's pending and wait for a completion
+        enter(true);
+    }
+
+    // Tell the caller how many packets we fetched
+    return n;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// send_batch() - Queues packets that were returned by receive_batch() for transmission
+//
+// Each buffer is returned to the provided-buffer ring when its send completes.
+//
+// Returns: The number of packets queued
+//==========================================================================================================
+int UringSock::send_batch(const udp_packet_t* packet, int count)
+{
+    for (int i=0; i<count; ++i)
+    {
+        int bid = buffer_id(packet[i]);
+
+        // Point this buffer's message header at the packet
+        m_send_iov[bid].iov_base = packet[i].data;
+        m_send_iov[bid].iov_len  = packet[i].length;
+
+        // And queue the send
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode    = IORING_OP_SENDMSG;
+        sqe->fd        = m_sender_sd;
+        sqe->addr      = (uint64_t)&m_send_msg[bid];
+        sqe->len       = 1;
+        sqe->user_data = bid;
+    }
+
+    // Submit the whole batch with a single system call
+    enter(false);
+    return count;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// release_batch() - Returns the buffers of received packets without transmitting them
+//==========================================================================================================
+void UringSock::release_batch(const udp_packet_t* packet, int count)
+{
+    for (int i=0; i<count; ++i) recycle(buffer_id(packet[i]));
+}
+//==========================================================================================================
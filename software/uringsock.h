@@ -0,0 +1,113 @@
+//==========================================================================================================
+// uringsock.h - Defines an io_uring packet I/O engine that drives a pair of UDPSock objects
+//
+// A single multishot RECVMSG stays armed on the server socket.  The kernel places each datagram into a
+// buffer from a provided-buffer ring, and posts one completion per datagram, so receiving requires no
+// system call per packet and no readiness polling.   Sends are queued as SENDMSG SQEs directly from those
+// same buffers, and a buffer goes back to the provided-buffer ring once its send has completed.
+//
+// receive_batch() and send_batch() work like the ones in UDPSock, except that receive_batch() points the
+// packet descriptors at the engine's buffers.  Every received packet must be handed to either send_batch()
+// or release_batch() so that its buffer can be reused.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <linux/io_uring.h>
+#include "udpsock.h"
+
+//==========================================================================================================
+// UringSock - An io_uring instance with a provided-buffer ring
+//==========================================================================================================
+class UringSock
+{
+public:
+
+    // Constructor, marks the ring as closed
+    UringSock();
+
+    // Destructor - Tears down the ring and frees the buffers
+    ~UringSock() {close();}
+
+    // Creates the ring, registers the buffers, and arms a multishot receive on the server socket
+    bool    create(UDPSock& server, UDPSock& sender, int buffer_count = 1024, int buffer_size = 16384);
+
+    // Tears down the ring and frees the buffers
+    void    close();
+
+    // Waits for at least one packet, then points the descriptors at as many as are available
+    int     receive_batch(udp_packet_t* packet, int count);
+
+    // Queues received packets for transmission to the sender socket's target
+    int     send_batch(const udp_packet_t* packet, int count);
+
+    // Hands the buffers of received packets back to the kernel without transmitting them
+    void    release_batch(const udp_packet_t* packet, int count);
+
+protected:
+
+    // Fetches a free submission queue entry, submitting pending entries if the queue is full
+    io_uring_sqe* get_sqe();
+
+    // Submits pending SQEs and optionally waits for at least one completion
+    int     enter(bool wait);
+
+    // Arms the multishot receive on the server socket
+    void    arm_receive();
+
+    // Returns a buffer to the provided-buffer ring
+    void    recycle(int bid);
+
+    // Returns the buffer ID of a packet returned by receive_batch()
+    int     buffer_id(const udp_packet_t& packet);
+
+    // The io_uring file descriptor
+    int     m_fd;
+
+    // The descriptors of the sockets we receive on and send from
+    int     m_server_sd, m_sender_sd;
+
+    // The mapping that holds both the submission and completion queues, and the mapped SQE array
+    void*       m_sq_map;
+    size_t      m_sq_map_len;
+    io_uring_sqe* m_sqes;
+    size_t      m_sqes_len;
+
+    // Pointers to the fields of the submission queue
+    uint32_t*   m_sq_head;
+    uint32_t*   m_sq_tail;
+    uint32_t*   m_sq_array;
+    uint32_t    m_sq_mask;
+    uint32_t    m_sq_entries;
+
+    // The number of SQEs we've filled in but not yet submitted
+    uint32_t    m_sq_pending;
+
+    // Pointers to the fields of the completion queue
+    uint32_t*   m_cq_head;
+    uint32_t*   m_cq_tail;
+    io_uring_cqe* m_cqes;
+    uint32_t    m_cq_mask;
+
+    // The provided-buffer ring, its tail index, and the buffers it hands out
+    io_uring_buf* m_buf_ring;
+    uint16_t*   m_buf_tail;
+    size_t      m_buf_ring_len;
+    uint8_t*    m_buffers;
+    int         m_buffer_count;
+    int         m_buffer_size;
+
+    // True when the multishot receive has ended and needs to be re-armed
+    bool        m_need_arm;
+
+    // The message header used by the multishot receive
+    msghdr      m_recv_msg;
+
+    // One message header and iovec per buffer, used by the send that echoes that buffer
+    std::vector<msghdr> m_send_msg;
+    std::vector<iovec>  m_send_iov;
+
+    // The address that sends go to
+    addrinfo_t  m_target;
+};
+//==========================================================================================================
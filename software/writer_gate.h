@@ -0,0 +1,45 @@
+//==========================================================================================================
+// writer_gate.h - Defines the handshake that lets one thread stop another that writes into a shared buffer
+//
+// The writing thread wraps each write in enter() and leave(), and checks stopped() in between.  Any other
+// thread can call stop(), which returns once the writer has left, after which the writer never touches the
+// buffer again.  A writer that's blocked somewhere outside enter()/leave() isn't waited for, so stop()
+// can't hang on a thread that's waiting for packets.
+//==========================================================================================================
+#pragma once
+#include <sched.h>
+#include <atomic>
+
+//==========================================================================================================
+// WriterGate - The two flags the handshake needs
+//==========================================================================================================
+class WriterGate
+{
+public:
+
+    // Writer: announces that it's about to use the buffer.  Call stopped() afterwards
+    void    enter() {m_writing.store(true);}
+
+    // Writer: returns true if stop() has been called, in which case the buffer is no longer ours to fill
+    bool    stopped() const {return m_stopped.load();}
+
+    // Writer: announces that it's done with the buffer
+    void    leave() {m_writing.store(false, std::memory_order_release);}
+
+    // Any thread: tells the writer to stop and waits for it to leave.  The writer raises m_writing before
+    // it looks at m_stopped, and we raise m_stopped before we look at m_writing.  Both are sequentially
+    // consistent, so either the writer sees m_stopped or we see m_writing and wait for it.  Returns false
+    // if the gate was already stopped
+    bool    stop()
+    {
+        if (m_stopped.exchange(true)) return false;
+        while (m_writing.load()) sched_yield();
+        return true;
+    }
+
+protected:
+
+    std::atomic<bool> m_stopped{false};
+    std::atomic<bool> m_writing{false};
+};
+//==========================================================================================================
@@ -0,0 +1,672 @@
+//==========================================================================================================
+// xdpsock.cpp - Implements an AF_XDP packet I/O backend for RDMA packets
+//==========================================================================================================
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_ether.h>
+#include <vector>
+#include "xdpsock.h"
+#include "rdma.h"
+using namespace std;
+
+// The number of UMEM frames per socket.  The fill and completion rings are large enough to hold them all
+static const int NUM_FRAMES = 4096;
+
+// The number of descriptors in the RX and TX rings
+static const int RING_SIZE = 2048;
+
+// The largest queue number that can be directed to an AF_XDP socket
+static const int MAX_QUEUES = 64;
+
+// The length of the Ethernet, IPv4 and UDP headers in front of the RDMA header
+static const int ETH_HDR_LEN = 14;
+static const int IP_HDR_LEN  = 20;
+static const int UDP_HDR_LEN = 8;
+static const int PKT_HDR_LEN = ETH_HDR_LEN + IP_HDR_LEN + UDP_HDR_LEN;
+
+
+//==========================================================================================================
+// These manipulate the producer and consumer indices that we share with the kernel
+//==========================================================================================================
+static inline uint32_t load_acquire(uint32_t* p) {return __atomic_load_n(p, __ATOMIC_ACQUIRE);}
+static inline void store_release(uint32_t* p, uint32_t v) {__atomic_store_n(p, v, __ATOMIC_RELEASE);}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// bpf() - There's no glibc wrapper for the bpf() system call
+//==========================================================================================================
+static int bpf(int cmd, bpf_attr* attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// insn() - Builds a single eBPF instruction
+//==========================================================================================================
+static bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+{
+    bpf_insn result;
+    result.code    = code;
+    result.dst_reg = dst;
+    result.src_reg = src;
+    result.off     = off;
+    result.imm     = imm;
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// build_program() - Builds the XDP program that steers RDMA packets to our AF_XDP sockets
+//
+// The test is the same one rdma_pkt_filter.v performs: an IPv4 packet, protocol UDP, addressed to the
+// RDMA server port, whose UDP payload begins with the RDMA magic number.  Matching packets are redirected
+// to the socket in the XSK map that corresponds to their receive queue.  Everything else gets XDP_PASS.
+//==========================================================================================================
+static vector<bpf_insn> build_program(int map_fd, int server_port)
+{
+    vector<bpf_insn> prog;
+
+    // Indices of the instructions that jump to the "pass" label
+    vector<int> to_pass;
+
+    // Packet fields are big-endian, and are compared against a value loaded in host byte order
+    auto check16 = [&](int offset, uint16_t value)
+    {
+        prog.push_back(insn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, offset, 0));
+        to_pass.push_back(prog.size());
+        prog.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(value)));
+    };
+
+    auto check8 = [&](int offset, uint8_t value)
+    {
+        prog.push_back(insn(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, offset, 0));
+        to_pass.push_back(prog.size());
+        prog.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, value));
+    };
+
+    // r6 = ctx, r2 = data, r3 = data_end
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0));
+    prog.push_back(insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, data), 0));
+    prog.push_back(insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, offsetof(xdp_md, data_end), 0));
+
+    // If the packet is too short to hold the headers and the RDMA magic number, pass it
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, PKT_HDR_LEN + 2));
+    to_pass.push_back(prog.size());
+    prog.push_back(insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0));
+
+    // IPv4, with no IP options
+    check16(12, ETH_P_IP);
+    check8 (ETH_HDR_LEN, 0x45);
+
+    // Not a fragment.  We have no way to reassemble those
+    prog.push_back(insn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HDR_LEN + 6, 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(IP_MF | IP_OFFMASK)));
+    to_pass.push_back(prog.size());
+    prog.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, 0));
+
+    // Protocol is UDP
+    check8 (ETH_HDR_LEN + 9, IPPROTO_UDP);
+
+    // Addressed to the RDMA server port
+    check16(ETH_HDR_LEN + IP_HDR_LEN + 2, server_port);
+
+    // The UDP payload starts with the RDMA magic number
+    check16(PKT_HDR_LEN, RDMA_MAGIC);
+
+    // return bpf_redirect_map(&xsk_map, ctx->rx_queue_index, XDP_PASS)
+    prog.push_back(insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(xdp_md, rx_queue_index), 0));
+    prog.push_back(insn(BPF_LD  | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd));
+    prog.push_back(insn(0, 0, 0, 0, 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS));
+    prog.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+    prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+    // pass: return XDP_PASS
+    int pass = prog.size();
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS));
+    prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+    // Point all of the "not an RDMA packet" jumps at the "pass" label
+    for (int i : to_pass) prog[i].off = pass - (i + 1);
+
+    // Hand the finished program to the caller
+    return prog;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// attach() - Loads the XDP program and attaches it to a network interface
+//
+// Passed:  iface       = The name of the network interface ("eth0", "enp1s0f0", etc)
+//          server_port = The UDP port that RDMA packets are addressed to
+//
+// Returns: true on success.   Native (driver) mode is tried first, then generic (SKB) mode
+//==========================================================================================================
+bool XDPProgram::attach(string iface, int server_port)
+{
+    bpf_attr attr;
+    char     log[4096] = {0};
+
+    // If we're already attached to an interface, detach
+    detach();
+
+    // Find the index of the interface
+    m_iface   = iface;
+    m_ifindex = if_nametoindex(iface.c_str());
+    if (m_ifindex == 0) return false;
+
+    // Create the map of receive-queue -> AF_XDP socket
+    memset(&attr, 0, sizeof attr);
+    attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size    = sizeof(int);
+    attr.value_size  = sizeof(int);
+    attr.max_entries = MAX_QUEUES;
+    m_map_fd = bpf(BPF_MAP_CREATE, &attr);
+    if (m_map_fd < 0) return false;
+
+    // Build the program
+    vector<bpf_insn> prog = build_program(m_map_fd, server_port);
+
+    // And load it into the kernel
+    memset(&attr, 0, sizeof attr);
+    attr.prog_type            = BPF_PROG_TYPE_XDP;
+    attr.insns                = (uint64_t)prog.data();
+    attr.insn_cnt             = prog.size();
+    attr.license              = (uint64_t)"GPL";
+    attr.log_buf              = (uint64_t)log;
+    attr.log_size             = sizeof(log);
+    attr.log_level            = 1;
+    attr.expected_attach_type = BPF_XDP;
+    m_prog_fd = bpf(BPF_PROG_LOAD, &attr);
+    if (m_prog_fd < 0)
+    {
+        fprintf(stderr, "XDP program rejected:\n%s\n", log);
+        return false;
+    }
+
+    // Attach the program in native mode if the driver supports it, otherwise in generic mode
+    const uint32_t mode[] = {XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE};
+    for (uint32_t flags : mode)
+    {
+        memset(&attr, 0, sizeof attr);
+        attr.link_create.prog_fd        = m_prog_fd;
+        attr.link_create.target_ifindex = m_ifindex;
+        attr.link_create.attach_type    = BPF_XDP;
+        attr.link_create.flags          = flags;
+        m_link_fd = bpf(BPF_LINK_CREATE, &attr);
+        m_generic = (flags == XDP_FLAGS_SKB_MODE);
+        if (m_link_fd >= 0) return true;
+    }
+
+    // If we get here, we couldn't attach the program in either mode
+    return false;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// add_socket() - Directs RDMA packets arriving on the specified queue to an AF_XDP socket
+//==========================================================================================================
+bool XDPProgram::add_socket(int queue, int xsk_fd)
+{
+    bpf_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_fd = m_map_fd;
+    attr.key    = (uint64_t)&queue;
+    attr.value  = (uint64_t)&xsk_fd;
+    attr.flags  = BPF_ANY;
+    return bpf(BPF_MAP_UPDATE_ELEM, &attr) == 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// detach() - Detaches the program from the interface and frees the map
+//==========================================================================================================
+void XDPProgram::detach()
+{
+    // Closing the link detaches the program from the interface
+    if (m_link_fd >= 0) ::close(m_link_fd);
+    if (m_prog_fd >= 0) ::close(m_prog_fd);
+    if (m_map_fd  >= 0) ::close(m_map_fd);
+
+    // And mark everything as closed
+    m_map_fd = m_prog_fd = m_link_fd = -1;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// map_ring() - Maps one of the rings that is shared with the kernel into our address space
+//==========================================================================================================
+template <class T>
+static bool map_ring(int sd, xdp_ring_t<T>& ring, const xdp_ring_offset& off, uint32_t size, off_t pgoff)
+{
+    ring.map_len = off.desc + size * sizeof(T);
+    ring.map     = mmap(NULL, ring.map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sd, pgoff);
+
+    // If the mapping failed, tell the caller
+    if (ring.map == MAP_FAILED)
+    {
+        ring.map = NULL;
+        return false;
+    }
+
+    // Find the fields of the ring within the mapping
+    uint8_t* base = (uint8_t*)ring.map;
+    ring.producer = (uint32_t*)(base + off.producer);
+    ring.consumer = (uint32_t*)(base + off.consumer);
+    ring.flags    = (uint32_t*)(base + off.flags);
+    ring.desc     = (T*)(base + off.desc);
+    ring.mask     = size - 1;
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// unmap_ring() - Unmaps a ring that is shared with the kernel
+//==========================================================================================================
+template <class T> static void unmap_ring(xdp_ring_t<T>& ring)
+{
+    if (ring.map) munmap(ring.map, ring.map_len);
+    ring.map = NULL;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// Constructor - Marks the socket as closed
+//==========================================================================================================
+XDPSock::XDPSock()
+{
+    m_sd   = -1;
+    m_umem = NULL;
+    m_rx.map = m_tx.map = m_fq.map = m_cq.map = NULL;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// create() - Creates an AF_XDP socket with its own UMEM, and binds it to a receive queue
+//
+// Passed:  program    = The XDP program attached to the interface we're binding to
+//          queue      = The receive queue to bind to
+//          src_port   = The UDP source port of the packets we transmit
+//          dest_ip    = The IPv4 address we transmit packets to
+//          dest_port  = The UDP port we transmit packets to
+//          frame_size = The size of a UMEM frame.   Frames larger than a page need hugepages
+//
+// Returns: true on success
+//==========================================================================================================
+bool XDPSock::create(XDPProgram& program, int queue, int src_port, string dest_ip, int dest_port,
+                     int frame_size)
+{
+    xdp_mmap_offsets off;
+    ipv4_t           local_ip;
+
+    // If the socket is open, close it
+    close();
+
+    // Save the UMEM geometry
+    m_frame_size  = frame_size;
+    m_frame_count = NUM_FRAMES;
+
+    // Save the ports we send to and from in network byte order
+    m_src_port  = htons(src_port);
+    m_dest_port = htons(dest_port);
+
+    // Fetch the IP address of our interface
+    if (!NetUtil::get_local_ip(program.get_iface(), &local_ip)) return false;
+    memcpy(&m_src_ip, local_ip.octet, 4);
+
+    // Convert the destination IP address to binary
+    if (inet_pton(AF_INET, dest_ip.c_str(), &m_dest_ip) != 1) return false;
+
+    // Fetch the MAC address of our interface
+    if (!NetUtil::get_local_mac(program.get_iface(), m_src_mac)) return false;
+
+    // Create the socket
+    m_sd = socket(AF_XDP, SOCK_RAW, 0);
+    if (m_sd < 0) return false;
+
+    // Allocate the UMEM.  Frames that are larger than a page must live in hugepages
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+    if (frame_size > getpagesize()) flags |= MAP_HUGETLB;
+    m_umem_len = (size_t)frame_size * NUM_FRAMES;
+    m_umem = (uint8_t*)mmap(NULL, m_umem_len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (m_umem == MAP_FAILED)
+    {
+        m_umem = NULL;
+        return false;
+    }
+
+    // Register the UMEM with the socket
+    xdp_umem_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.addr       = (uint64_t)m_umem;
+    reg.len        = m_umem_len;
+    reg.chunk_size = frame_size;
+    if (setsockopt(m_sd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof reg) < 0) return false;
+
+    // Tell the kernel how big each ring should be
+    int fq_size = NUM_FRAMES, cq_size = NUM_FRAMES, rx_size = RING_SIZE, tx_size = RING_SIZE;
+    if (setsockopt(m_sd, SOL_XDP, XDP_UMEM_FILL_RING,       &fq_size, sizeof(int)) < 0) return false;
+    if (setsockopt(m_sd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &cq_size, sizeof(int)) < 0) return false;
+    if (setsockopt(m_sd, SOL_XDP, XDP_RX_RING,              &rx_size, sizeof(int)) < 0) return false;
+    if (setsockopt(m_sd, SOL_XDP, XDP_TX_RING,              &tx_size, sizeof(int)) < 0) return false;
+
+    // Find out where each ring lives, and map them into our address space
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(m_sd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) return false;
+    if (!map_ring(m_sd, m_fq, off.fr, fq_size, XDP_UMEM_PGOFF_FILL_RING))       return false;
+    if (!map_ring(m_sd, m_cq, off.cr, cq_size, XDP_UMEM_PGOFF_COMPLETION_RING)) return false;
+    if (!map_ring(m_sd, m_rx, off.rx, rx_size, XDP_PGOFF_RX_RING))              return false;
+    if (!map_ring(m_sd, m_tx, off.tx, tx_size, XDP_PGOFF_TX_RING))              return false;
+
+    // Bind to the queue in zero-copy mode.  If the driver can't do that, fall back to copy mode
+    sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof sxdp);
+    sxdp.sxdp_family   = AF_XDP;
+    sxdp.sxdp_ifindex  = program.get_ifindex();
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags    = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+    m_zerocopy = (bind(m_sd, (sockaddr*)&sxdp, sizeof sxdp) == 0);
+    if (!m_zerocopy)
+    {
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+        if (bind(m_sd, (sockaddr*)&sxdp, sizeof sxdp) < 0) return false;
+    }
+
+    // Hand every frame to the kernel to receive packets into
+    for (int i=0; i<NUM_FRAMES; ++i) fill((uint64_t)i * frame_size);
+
+    // Ask the XDP program to send this queue's RDMA packets to us
+    return program.add_socket(queue, m_sd);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// close() - Closes the socket and frees the rings and the UMEM
+//==========================================================================================================
+void XDPSock::close()
+{
+    unmap_ring(m_rx);
+    unmap_ring(m_tx);
+    unmap_ring(m_fq);
+    unmap_ring(m_cq);
+
+    if (m_sd != -1) ::close(m_sd);
+    m_sd = -1;
+
+    if (m_umem) munmap(m_umem, m_umem_len);
+    m_umem = NULL;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// fill() - Places a frame on the fill ring, making it available to receive a packet
+//==========================================================================================================
+void XDPSock::fill(uint64_t addr)
+{
+    uint32_t prod = *m_fq.producer;
+    m_fq.desc[prod & m_fq.mask] = addr;
+    store_release(m_fq.producer, prod + 1);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// recycle_completed() - Moves frames that have finished transmitting back onto the fill ring
+//==========================================================================================================
+void XDPSock::recycle_completed()
+{
+    uint32_t cons  = *m_cq.consumer;
+    uint32_t avail = load_acquire(m_cq.producer) - cons;
+
+    // If nothing has finished transmitting, we're done
+    if (avail == 0) return;
+
+    // Every completed frame goes back to the fill ring
+    for (uint32_t i=0; i<avail; ++i) fill(m_cq.desc[(cons + i) & m_cq.mask]);
+
+    // Tell the kernel we've consumed those completions
+    store_release(m_cq.consumer, cons + avail);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// kick_tx() - Tells the kernel to transmit whatever is on the TX ring
+//
+// Copy-mode sockets always need a kick, and the kernel only transmits a limited number of frames per
+// kick.  Zero-copy drivers tell us when they need one
+//==========================================================================================================
+void XDPSock::kick_tx()
+{
+    // If there's nothing waiting on the TX ring, there's nothing to do
+    if (*m_tx.producer == load_acquire(m_tx.consumer)) return;
+
+    // Wake up the kernel if it needs it
+    if (!m_zerocopy || (*m_tx.flags & XDP_RING_NEED_WAKEUP))
+    {
+        sendto(m_sd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// frame_addr() - Returns the UMEM offset of the Ethernet header of a packet from receive_batch()
+//==========================================================================================================
+uint64_t XDPSock::frame_addr(const udp_packet_t& packet)
+{
+    return ((uint8_t*)packet.data - PKT_HDR_LEN) - m_umem;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// receive_batch() - Waits for at least one RDMA packet to arrive, then fetches as many more as are
+//                   already waiting, up to "count" packets
+//
+// On return, each packet descriptor points to the UDP payload (i.e., the RDMA header) of a packet that
+// is still sitting in the UMEM.   Each packet must subsequently be passed to either send_batch() or
+// release_batch() to return its frame to the kernel.
+//
+// Returns: The number of packets received
+//==========================================================================================================
+int XDPSock::receive_batch(udp_packet_t* packet, int count)
+{
+    uint32_t cons, avail;
+    int      n = 0;
+
+    while (n == 0)
+    {
+        // Frames that have finished transmitting can receive new packets
+        recycle_completed();
+
+        // Find out how many packets are waiting on the RX ring
+        cons  = *m_rx.consumer;
+        avail = load_acquire(m_rx.producer) - cons;
+        if (avail == 0)
+        {
+            // Make sure the kernel isn't sitting on frames we've asked it to transmit
+            kick_tx();
+
+            // Wait for packets to arrive.  We time out periodically to pick up transmit completions
+            pollfd pfd = {m_sd, POLLIN, 0};
+            poll(&pfd, 1, 10);
+            continue;
+        }
+
+        // We'll fetch no more packets than the caller has room for
+        if (avail > (uint32_t)count) avail = count;
+
+        // Point each descriptor at the RDMA header of a received packet
+        for (uint32_t i=0; i<avail; ++i)
+        {
+            const xdp_desc& desc = m_rx.desc[(cons + i) & m_rx.mask];
+            uint8_t* frame = m_umem + desc.addr;
+            iphdr*   ip    = (iphdr*)(frame + ETH_HDR_LEN);
+            udphdr*  udp   = (udphdr*)(frame + ETH_HDR_LEN + IP_HDR_LEN);
+
+            // The UDP length excludes any Ethernet padding on short frames
+            int length = ntohs(udp->len) - UDP_HDR_LEN;
+            if (length > (int)desc.len - PKT_HDR_LEN) length = desc.len - PKT_HDR_LEN;
+
+            // A frame too short for its headers, or whose UDP length is shorter than the UDP header
+            // itself, is malformed.  Hand it straight back to the kernel
+            if (length < 0)
+            {
+                fill(desc.addr / m_frame_size * m_frame_size);
+                continue;
+            }
+
+            packet[n].data     = frame + PKT_HDR_LEN;
+            packet[n].length   = length;
+            packet[n].capacity = m_frame_size - (desc.addr % m_frame_size) - PKT_HDR_LEN;
+
+            // The addresses are right there in the headers, but there are no kernel timestamps
+            packet[n].segment_size   = 0;
+            packet[n].rx_software_ns = 0;
+            packet[n].rx_hardware_ns = 0;
+            packet[n].source         = UDPSock::source_key(ip->saddr, udp->source);
+            ++n;
+        }
+
+        // Tell the kernel we've consumed those descriptors
+        store_release(m_rx.consumer, cons + avail);
+    }
+
+    // And tell the caller how many packets we fetched
+    return n;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// ip_checksum() - Computes the checksum of an IPv4 header with no options
+//==========================================================================================================
+static uint16_t ip_checksum(const void* header)
+{
+    const uint16_t* p = (const uint16_t*)header;
+    uint32_t sum = 0;
+    for (int i=0; i<IP_HDR_LEN/2; ++i) sum += p[i];
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// send_batch() - Transmits packets that were returned by receive_batch()
+//
+// The Ethernet, IP and UDP headers of each packet are rewritten in place to address the packet to our
+// destination, then the frame itself is placed on the TX ring.   When the kernel is done transmitting
+// the frame, recycle_completed() puts it back on the fill ring.
+//
+// Returns: The number of packets queued for transmission.   Packets that don't fit on the TX ring
+//          are dropped
+//==========================================================================================================
+int XDPSock::send_batch(const udp_packet_t* packet, int count)
+{
+    // Reclaim frames that have finished transmitting
+    recycle_completed();
+
+    // Find out how much room there is on the TX ring
+    uint32_t prod = *m_tx.producer;
+    uint32_t room = (m_tx.mask + 1) - (prod - load_acquire(m_tx.consumer));
+    int      n    = (count < (int)room) ? count : room;
+
+    for (int i=0; i<n; ++i)
+    {
+        uint64_t addr   = frame_addr(packet[i]);
+        uint8_t* frame  = m_umem + addr;
+        int      length = packet[i].length;
+
+        // Broadcast the frame from our MAC address
+        ethhdr* eth = (ethhdr*)frame;
+        memset(eth->h_dest, 0xFF, 6);
+        memcpy(eth->h_source, m_src_mac, 6);
+
+        // Address the IP header from us to the destination
+        iphdr* ip    = (iphdr*)(frame + ETH_HDR_LEN);
+        ip->tot_len  = htons(IP_HDR_LEN + UDP_HDR_LEN + length);
+        ip->id       = 0;
+        ip->frag_off = htons(IP_DF);
+        ip->ttl      = 64;
+        ip->saddr    = m_src_ip;
+        ip->daddr    = m_dest_ip;
+        ip->check    = 0;
+        ip->check    = ip_checksum(ip);
+
+        // Address the UDP header to the destination port.  A zero UDP checksum means "none"
+        udphdr* udp  = (udphdr*)(frame + ETH_HDR_LEN + IP_HDR_LEN);
+        udp->source  = m_src_port;
+        udp->dest    = m_dest_port;
+        udp->len     = htons(UDP_HDR_LEN + length);
+        udp->check   = 0;
+
+        // Place the frame on the TX ring
+        xdp_desc& desc = m_tx.desc[(prod + i) & m_tx.mask];
+        desc.addr    = addr;
+        desc.len     = PKT_HDR_LEN + length;
+        desc.options = 0;
+    }
+
+    // Hand the frames to the kernel
+    store_release(m_tx.producer, prod + n);
+    kick_tx();
+
+    // Any packets that didn't fit on the TX ring are dropped
+    release_batch(packet + n, count - n);
+
+    // Tell the caller how many packets were queued for transmission
+    return n;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// release_batch() - Returns the frames of received packets to the fill ring without transmitting them
+//==========================================================================================================
+void XDPSock::release_batch(const udp_packet_t* packet, int count)
+{
+    for (int i=0; i<count; ++i) fill(frame_addr(packet[i]) / m_frame_size * m_frame_size);
+}
+//==========================================================================================================
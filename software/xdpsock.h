@@ -0,0 +1,149 @@
+//==========================================================================================================
+// xdpsock.h - Defines an AF_XDP packet I/O backend for RDMA packets
+//
+// An XDPProgram is attached to a network interface once.  It steers RDMA packets (IPv4, UDP, the RDMA
+// server port, and the RDMA magic number - the same test that rdma_pkt_filter.v performs) to the AF_XDP
+// socket bound to the receive queue they arrived on.  Everything else is passed to the kernel as usual.
+//
+// An XDPSock is bound to one receive queue.  Its receive_batch() and send_batch() work like the ones in
+// UDPSock, except that receive_batch() points the packet descriptors directly at the UMEM frames the
+// packets landed in, and send_batch() turns those same frames around and transmits them.  No packet
+// data is ever copied by the application.
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <linux/if_xdp.h>
+#include "udpsock.h"
+
+//==========================================================================================================
+// XDPProgram - The XDP program and XSK map attached to one network interface
+//==========================================================================================================
+class XDPProgram
+{
+public:
+
+    // Constructor, marks everything as closed
+    XDPProgram() {m_map_fd = m_prog_fd = m_link_fd = -1; m_ifindex = 0; m_generic = false;}
+
+    // Destructor - detaches the program from the interface
+    ~XDPProgram() {detach();}
+
+    // Loads the program and attaches it to an interface.  Falls back to generic (SKB) mode
+    bool    attach(std::string iface, int server_port);
+
+    // Directs packets arriving on the specified receive queue to an AF_XDP socket
+    bool    add_socket(int queue, int xsk_fd);
+
+    // Detaches the program from the interface and frees the map
+    void    detach();
+
+    // Returns the name and index of the interface we're attached to
+    std::string get_iface()   {return m_iface;}
+    int         get_ifindex() {return m_ifindex;}
+
+    // Returns true if we had to fall back to generic (SKB) mode
+    bool    is_generic() {return m_generic;}
+
+protected:
+
+    // File descriptors of the XSK map, the program, and the link that attaches it to the interface
+    int         m_map_fd, m_prog_fd, m_link_fd;
+
+    // The interface we're attached to
+    std::string m_iface;
+    int         m_ifindex;
+
+    // True if the program is running in generic (SKB) mode
+    bool        m_generic;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// xdp_ring_t - One of the four single-producer/single-consumer rings shared with the kernel
+//==========================================================================================================
+template <class T> struct xdp_ring_t
+{
+    uint32_t*   producer;
+    uint32_t*   consumer;
+    uint32_t*   flags;
+    T*          desc;
+    uint32_t    mask;
+    void*       map;
+    size_t      map_len;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// XDPSock - An AF_XDP socket and its UMEM, bound to a single receive queue of an interface
+//==========================================================================================================
+class XDPSock
+{
+public:
+
+    // Constructor, marks the socket as closed
+    XDPSock();
+
+    // Destructor - Closes the socket and frees the UMEM
+    ~XDPSock() {close();}
+
+    // Creates the socket and binds it to a queue.  Tries zero-copy mode first, then copy mode
+    bool    create(XDPProgram& program, int queue, int src_port, std::string dest_ip, int dest_port,
+                   int frame_size = 4096);
+
+    // Closes the socket and frees the UMEM
+    void    close();
+
+    // Waits for at least one packet, then points the descriptors at the UDP payload of each packet
+    int     receive_batch(udp_packet_t* packet, int count);
+
+    // Rewrites the headers of received packets in place and transmits them to the destination
+    int     send_batch(const udp_packet_t* packet, int count);
+
+    // Hands the frames of received packets back to the kernel without transmitting them
+    void    release_batch(const udp_packet_t* packet, int count);
+
+    // Returns true if the socket is bound in zero-copy mode
+    bool    is_zerocopy() {return m_zerocopy;}
+
+    // Returns the socket descriptor of this socket
+    int     get_sd() {return m_sd;}
+
+protected:
+
+    // Moves transmitted frames from the completion ring back to the fill ring
+    void    recycle_completed();
+
+    // Tells the kernel to transmit whatever is on the TX ring
+    void    kick_tx();
+
+    // Places a frame on the fill ring
+    void    fill(uint64_t addr);
+
+    // Returns the UMEM offset of the Ethernet header of a packet returned by receive_batch()
+    uint64_t frame_addr(const udp_packet_t& packet);
+
+    // The AF_XDP socket
+    int         m_sd;
+
+    // The UMEM and its geometry
+    uint8_t*    m_umem;
+    size_t      m_umem_len;
+    int         m_frame_size;
+    int         m_frame_count;
+
+    // True if we are bound in zero-copy mode
+    bool        m_zerocopy;
+
+    // The rings we share with the kernel
+    xdp_ring_t<xdp_desc>    m_rx, m_tx;
+    xdp_ring_t<uint64_t>    m_fq, m_cq;
+
+    // The MAC and IP address of our interface, and the IP address and ports we send to
+    uint8_t     m_src_mac[6];
+    uint32_t    m_src_ip, m_dest_ip;
+    uint16_t    m_src_port, m_dest_port;
+};
+//==========================================================================================================